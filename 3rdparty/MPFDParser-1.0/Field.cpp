@@ -10,6 +10,8 @@ MPFD::Field::Field() {
 	type = 0;
 	FieldContent = NULL;
 	FieldContentLength = 0;
+	WhereToStoreUploadedFiles = Parser::StoreUploadedFilesInFilesystem;
+	MaxInMemoryFileSize = 0;
 #ifndef FSTREAM_FILE
 	file = NULL;
 #endif
@@ -18,7 +20,7 @@ MPFD::Field::Field() {
 MPFD::Field::~Field() {
 
 	if (FieldContent) {
-		delete FieldContent;
+		free(FieldContent);
 	}
 
 	if (type == FileType) {
@@ -28,7 +30,8 @@ MPFD::Field::~Field() {
 			file = NULL;
 		}
 		if(TempFile.length() > 0){
-			// remove((TempDir + "/" + TempFile).c_str());
+			// not moved uploaded file is removed at the end of request
+			remove((TempDir + "/" + TempFile).c_str());
 		}
 #else
 		if (file.is_open()) {
@@ -71,95 +74,98 @@ void MPFD::Field::FinishData()
 
 void MPFD::Field::AcceptSomeData(char *data, long length) {
 	if (type == TextType) {
-		if (FieldContent == NULL) {
-			FieldContent = new char[length + 1];
-		} else {
-			FieldContent = (char*) realloc(FieldContent, FieldContentLength + length + 1);
-		}
-
+		FieldContent = (char*) realloc(FieldContent, FieldContentLength + length + 1);
 		memcpy(FieldContent + FieldContentLength, data, length);
-		FieldContent[FieldContentLength + length] = 0;
+		FieldContentLength += length;
+		FieldContent[FieldContentLength] = 0;
 	} else if (type == FileType) {
-		if (WhereToStoreUploadedFiles == Parser::StoreUploadedFilesInFilesystem) {
-			if (TempDir.length() > 0) {
+		if (WhereToStoreUploadedFiles == Parser::StoreUploadedFilesInFilesystem
+			&& (TempFile.length() > 0 || FieldContentLength + length > (unsigned long)MaxInMemoryFileSize)) {
+			if (FieldContent) {
+				// the file is bigger than in memory limit, collected data is spooled first
+				WriteToTempFile(FieldContent, FieldContentLength);
+				free(FieldContent);
+				FieldContent = NULL;
+				FieldContentLength = 0;
+			}
+			WriteToTempFile(data, length);
+		} else { // If files are stored in memory
+			FieldContent = (char*) realloc(FieldContent, FieldContentLength + length);
+			memcpy(FieldContent + FieldContentLength, data, length);
+			FieldContentLength += length;
+		}
+	} else {
+		throw MPFD::Exception("Trying to AcceptSomeData but no type was set.");
+	}
+}
+
+void MPFD::Field::WriteToTempFile(char *data, long length) {
+	if (TempDir.length() > 0) {
 #ifndef FSTREAM_FILE
-				if (!file) {
-					int i = 1;
-					FILE * testfile = NULL;
-					std::string tempfile;
-					do {
-						if (testfile) {
-							fclose(testfile);
-							testfile = NULL;
-						}
-
-						std::stringstream ss;
-						ss << "os" << rand() << i << ".tmp";
-						TempFile = ss.str();
-
-						tempfile = TempDir + "/" + TempFile;
-
-						testfile = fopen(tempfile.c_str(), "rb");
-						i++;
-					} while (testfile);
-					if (testfile) {
-						fclose(testfile);
-						testfile = NULL;
-					}
-
-					file = fopen(tempfile.c_str(), "wb"); // std::ios::out | std::ios::binary | std::ios_base::trunc);
+		if (!file) {
+			int i = 1;
+			FILE * testfile = NULL;
+			std::string tempfile;
+			do {
+				if (testfile) {
+					fclose(testfile);
+					testfile = NULL;
 				}
 
-				if (file) {
-					fwrite(data, length, 1, file);
-					fflush(file);
-				} else {
-					throw Exception(std::string("Cannot write to file ") + TempDir + "/" + TempFile);
-				}
+				std::stringstream ss;
+				ss << "os" << rand() << i << ".tmp";
+				TempFile = ss.str();
+
+				tempfile = TempDir + "/" + TempFile;
+
+				testfile = fopen(tempfile.c_str(), "rb");
+				i++;
+			} while (testfile);
+			if (testfile) {
+				fclose(testfile);
+				testfile = NULL;
+			}
+
+			file = fopen(tempfile.c_str(), "wb"); // std::ios::out | std::ios::binary | std::ios_base::trunc);
+		}
+
+		if (file) {
+			fwrite(data, length, 1, file);
+		} else {
+			throw Exception(std::string("Cannot write to file ") + TempDir + "/" + TempFile);
+		}
 #else
-				if (!file.is_open()) {
-					int i = 1;
-					std::ifstream testfile;
-					std::string tempfile;
-					do {
-						if (testfile.is_open()) {
-							testfile.close();
-						}
-
-						std::stringstream ss;
-						ss << "MPFD_Temp_" << i;
-						TempFile = ss.str();
-
-						tempfile = TempDir + "/" + TempFile;
-
-						testfile.open(tempfile.c_str(), std::ios::in);
-						i++;
-					} while (testfile.is_open());
-
-					file.open(tempfile.c_str(), std::ios::out | std::ios::binary | std::ios_base::trunc);
+		if (!file.is_open()) {
+			int i = 1;
+			std::ifstream testfile;
+			std::string tempfile;
+			do {
+				if (testfile.is_open()) {
+					testfile.close();
 				}
 
-				if (file.is_open()) {
-					file.write(data, length);
-					file.flush();
-				} else {
-					throw Exception(std::string("Cannot write to file ") + TempDir + "/" + TempFile);
-				}
-#endif
-			} else {
-				throw MPFD::Exception("Trying to AcceptSomeData for a file but no TempDir is set.");
-			}
-		} else { // If files are stored in memory
-			if (FieldContent == NULL) {
-				FieldContent = new char[length];
-			} else {
-				FieldContent = (char*) realloc(FieldContent, FieldContentLength + length);
-			}
-			memcpy(FieldContent + FieldContentLength, data, length);
-			FieldContentLength += length;
+				std::stringstream ss;
+				ss << "MPFD_Temp_" << i;
+				TempFile = ss.str();
+
+				tempfile = TempDir + "/" + TempFile;
+
+				testfile.open(tempfile.c_str(), std::ios::in);
+				i++;
+			} while (testfile.is_open());
+
+			file.open(tempfile.c_str(), std::ios::out | std::ios::binary | std::ios_base::trunc);
+		}
+
+		if (file.is_open()) {
+			file.write(data, length);
+			file.flush();
+		} else {
+			throw Exception(std::string("Cannot write to file ") + TempDir + "/" + TempFile);
 		}
+#endif
 	} else {
-		throw MPFD::Exception("Trying to AcceptSomeData but no type was set.");
+		throw MPFD::Exception("Trying to AcceptSomeData for a file but no TempDir is set.");
 	}
 }
 
@@ -172,7 +178,7 @@ unsigned long MPFD::Field::GetFileContentSize() {
 		throw MPFD::Exception("Trying to get file content size, but no type was set.");
 	} else {
 		if (type == FileType) {
-			if (WhereToStoreUploadedFiles == Parser::StoreUploadedFilesInMemory) {
+			if (IsStoredInMemory()) {
 				return FieldContentLength;
 			} else {
 				throw MPFD::Exception("Trying to get file content size, but uploaded files are stored in filesystem.");
@@ -188,7 +194,7 @@ char * MPFD::Field::GetFileContent() {
 		throw MPFD::Exception("Trying to get file content, but no type was set.");
 	} else {
 		if (type == FileType) {
-			if (WhereToStoreUploadedFiles == Parser::StoreUploadedFilesInMemory) {
+			if (IsStoredInMemory()) {
 				return FieldContent;
 			} else {
 				throw MPFD::Exception("Trying to get file content, but uploaded files are stored in filesystem.");
@@ -220,7 +226,7 @@ std::string MPFD::Field::GetTempFileNameEx() {
 		throw MPFD::Exception("Trying to get file temp name, but no type was set.");
 	} else {
 		if (type == FileType) {
-			if (WhereToStoreUploadedFiles == Parser::StoreUploadedFilesInFilesystem) {
+			if (!IsStoredInMemory()) {
 				return std::string(TempDir + "/" + TempFile);
 			} else {
 				throw MPFD::Exception("Trying to get file temp name, but uplaoded files are stored in memory.");
@@ -252,6 +258,14 @@ void MPFD::Field::SetUploadedFilesStorage(int where) {
 	WhereToStoreUploadedFiles = where;
 }
 
+void MPFD::Field::SetMaxInMemoryFileSize(long size) {
+	MaxInMemoryFileSize = size;
+}
+
+bool MPFD::Field::IsStoredInMemory() {
+	return WhereToStoreUploadedFiles == Parser::StoreUploadedFilesInMemory || (MaxInMemoryFileSize > 0 && TempFile.length() == 0);
+}
+
 void MPFD::Field::SetFileContentType(std::string type) {
 	FileContentType = type;
 }
@@ -35,6 +35,8 @@ namespace MPFD {
 
         // File functions
         void SetUploadedFilesStorage(int where);
+        void SetMaxInMemoryFileSize(long size);
+        bool IsStoredInMemory();
         void SetTempDir(std::string dir);
 
         void SetFileName(std::string name);
@@ -58,12 +60,14 @@ namespace MPFD {
         unsigned long FieldContentLength;
 
         int WhereToStoreUploadedFiles;
+        long MaxInMemoryFileSize;
 
         std::string TempDir, TempFile;
         std::string FileContentType, FileName;
 
         int type;
         char * FieldContent;
+        void WriteToTempFile(char *data, long length);
 #ifndef FSTREAM_FILE
 		FILE * file;
 #else
@@ -18,6 +18,7 @@ MPFD::Parser::Parser() {
     CurrentStatus = Status_LookingForStartingBoundary;
 
     MaxDataCollectorLength = 16 * 1024 * 1024; // 16 Mb default data collector size.
+    MaxInMemoryFileSize = 0;
 
     SetUploadedFilesStorage(StoreUploadedFilesInFilesystem);
 }
@@ -29,7 +30,7 @@ MPFD::Parser::~Parser() {
     }
 
     if (DataCollector && !IsExternalDataBuffer) {
-        delete DataCollector;
+        free(DataCollector);
     }
 }
 
@@ -52,16 +53,10 @@ void MPFD::Parser::AcceptSomeData(const char *data, const long length) {
 		if(IsExternalDataBuffer){
 			throw MPFD::Exception("Accepting data, but external data was used.");
 		}
-        // Append data to existing accumulator
-        if (DataCollector == NULL) {
-            DataCollector = new char[length];
-            memcpy(DataCollector, data, length);
-            DataCollectorLength = length;
-        } else {
-            DataCollector = (char*) realloc(DataCollector, DataCollectorLength + length);
-            memcpy(DataCollector + DataCollectorLength, data, length);
-            DataCollectorLength += length;
-        }
+        // Append data to existing accumulator, it keeps only not processed tail of previous data
+        DataCollector = (char*) realloc(DataCollector, DataCollectorLength + length);
+        memcpy(DataCollector + DataCollectorLength, data, length);
+        DataCollectorLength += length;
 
         if (DataCollectorLength > MaxDataCollectorLength) {
             throw Exception("Maximum data collector length reached.");
@@ -81,6 +76,7 @@ void MPFD::Parser::SetExternalDataBuffer(const char *data, const long length)
 		}
 		DataCollector = (char*)data;
 		DataCollectorLength = length;
+		IsExternalDataBuffer = true;
         _ProcessData();
     } else {
         throw MPFD::Exception("Accepting data, but content type was not set.");
@@ -165,7 +161,7 @@ bool MPFD::Parser::WaitForHeadersEndAndParseThem() {
 
             TruncateDataCollectorFromTheBeginning(i + 4);
 
-            delete headers;
+            delete [] headers;
 
             return true;
         }
@@ -177,6 +173,10 @@ void MPFD::Parser::SetUploadedFilesStorage(int where) {
     WhereToStoreUploadedFiles = where;
 }
 
+void MPFD::Parser::SetMaxInMemoryFileSize(long size) {
+    MaxInMemoryFileSize = size;
+}
+
 void MPFD::Parser::SetTempDirForFileUpload(std::string dir) {
     TempDirForFileUpload = dir;
 }
@@ -209,6 +209,7 @@ void MPFD::Parser::_ParseHeaders(std::string headers) {
             Fields[ProcessingFieldName]->SetType(Field::FileType);
             Fields[ProcessingFieldName]->SetTempDir(TempDirForFileUpload);
             Fields[ProcessingFieldName]->SetUploadedFilesStorage(WhereToStoreUploadedFiles);
+            Fields[ProcessingFieldName]->SetMaxInMemoryFileSize(MaxInMemoryFileSize);
 
             int filename_end_pos = headers.find("\"", filename_pos + 10);
             if (filename_end_pos == (int)std::string::npos) {
@@ -244,35 +245,29 @@ void MPFD::Parser::SetMaxCollectedDataLength(long max) {
 }
 
 void MPFD::Parser::TruncateDataCollectorFromTheBeginning(long n) {
-    long TruncatedDataCollectorLength = DataCollectorLength - n;
-
-    char *tmp = DataCollector;
-
-    DataCollector = new char[TruncatedDataCollectorLength];
-    memcpy(DataCollector, tmp + n, TruncatedDataCollectorLength);
-
-    DataCollectorLength = TruncatedDataCollectorLength;
-
-    delete tmp;
-
+    // the tail is moved in place, the buffer is reused by the next chunk
+    if (IsExternalDataBuffer) {
+        DataCollector += n;
+    } else {
+        memmove(DataCollector, DataCollector + n, DataCollectorLength - n);
+    }
+    DataCollectorLength -= n;
 }
 
 long MPFD::Parser::BoundaryPositionInDataCollector() {
     const char *b = Boundary.c_str();
-    int bl = Boundary.length();
-    if (DataCollectorLength >= bl) {
-        bool found = false;
-        for (int i = 0; (i <= DataCollectorLength - bl) && (!found); i++) {
-            found = true;
-            for (int j = 0; (j < bl) && (found); j++) {
-                if (DataCollector[i + j] != b[j]) {
-                    found = false;
-                }
-            }
-
-            if (found) {
-                return i;
-            }
+    long bl = Boundary.length();
+    if (DataCollectorLength < bl) {
+        return -1;
+    }
+    const char *start = DataCollector, *end = DataCollector + DataCollectorLength - bl;
+    for (const char *cur = start; cur <= end; cur++) {
+        cur = (const char*) memchr(cur, b[0], end - cur + 1);
+        if (!cur) {
+            break;
+        }
+        if (memcmp(cur, b, bl) == 0) {
+            return cur - start;
         }
     }
     return -1;
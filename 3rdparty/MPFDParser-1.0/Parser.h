@@ -35,6 +35,8 @@ namespace MPFD {
         void SetMaxCollectedDataLength(long max);
         void SetTempDirForFileUpload(std::string dir);
         void SetUploadedFilesStorage(int where);
+        // files up to the size are kept in memory, bigger ones are spooled to temp dir
+        void SetMaxInMemoryFileSize(long size);
 
 		void FinishData();
 
@@ -42,6 +44,7 @@ namespace MPFD {
 
     private:
         int WhereToStoreUploadedFiles;
+        long MaxInMemoryFileSize;
 
         std::map<std::string, Field *> Fields;
 
@@ -27,6 +27,7 @@
 #include "ext-base64/os-base64.h"
 #include "ext-datetime/os-datetime.h"
 #include "ext-json/os-json.h"
+#include "ext-cache/os-cache.h"
 
 #ifndef OS_CURL_DISABLED
 #include "ext-curl/os-curl.h"
@@ -50,6 +51,7 @@
 
 #ifndef OS_ZLIB_DISABLED
 #include "ext-zlib/os-zlib.h"
+#include "ext-zlib/zlib/zlib.h"
 #endif
 
 #ifdef _MSC_VER
@@ -60,8 +62,15 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <dirent.h>
 #endif // _MSC_VER
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <errno.h>
+#define OS_FCGI_WATCH_SUPPORTED
+#endif
+
 #define PID_FILE "/var/run/os-fcgi.pid"
 
 using namespace ObjectScript;
@@ -70,36 +79,335 @@ char init_cache_path[128] =
 #ifdef _MSC_VER
 	"cache-osc"
 #else
-	"/tmp"
+	"/tmp/os-fcgi-cache" // dedicated dir, other files of /tmp are never touched
 #endif
 ;
 int listen_socket = 0;
 int post_max_size = 0;
+char upload_temp_path[256] = "/tmp";
+int upload_memory_size = 0;
+int gzip_level = 0; // 0 - response is not compressed
+int gzip_min_size = 1024;
+
+// bundle is loaded once and shared by OS instances of all threads
+OS::Bundle * bundle = NULL;
 
 #include <cstdio>
 
+// compiled files made before start could be built by previous version of compiler
 time_t start_time = 0;
 
 void initStartTime()
 {
-	char touch_filename[256];
-	strcpy(touch_filename, init_cache_path);
 #ifdef _MSC_VER
-	_mkdir(touch_filename);
+	_mkdir(init_cache_path);
 #else
-	mkdir(touch_filename, 0755);
+	mkdir(init_cache_path, 0700);
 #endif
-	strcat(touch_filename, "/os-cache-touch");
-	std::remove(touch_filename);
+	start_time = time(NULL);
+}
 
-	FILE * f = fopen(touch_filename, "wb");
-	OS_ASSERT(f);
-	if(f){
-		fclose(f);
-		struct stat filename_st;
-		stat(touch_filename, &filename_st);
-		start_time = filename_st.st_mtime;
+// compiled file name depends on source version so files of previous versions are left behind,
+// all of them are older than start time and would be recompiled anyway so they are removed,
+// cache dir made by another user is left as is
+void removeOldCompiledFiles()
+{
+#ifndef _MSC_VER
+	struct stat dir_st;
+	if(lstat(init_cache_path, &dir_st) != 0 || !S_ISDIR(dir_st.st_mode) || dir_st.st_uid != geteuid()){
+		return;
+	}
+	DIR * dir = opendir(init_cache_path);
+	if(!dir){
+		return;
+	}
+	int path_len = (int)strlen(init_cache_path);
+	for(struct dirent * entry; (entry = readdir(dir)) != NULL;){
+		if(strncmp(entry->d_name, "os-cache-", sizeof("os-cache-")-1) != 0){
+			continue;
+		}
+		char * filename = (char*)malloc(path_len + strlen(entry->d_name) + 2);
+		sprintf(filename, "%s/%s", init_cache_path, entry->d_name);
+		struct stat st;
+		if(stat(filename, &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime < start_time){
+			unlink(filename);
+		}
+		free(filename);
+	}
+	closedir(dir);
+#endif
+}
+
+#ifdef OS_FCGI_WATCH_SUPPORTED
+/*
+	Watcher thread drops cached file stats and resolved paths as soon as
+	any file of watched directories is changed, so workers trust cached
+	entries without any checks. Paths of cache entries could be written
+	in different ways (document root, require paths) so all entries are
+	dropped, it happens once per bunch of events only.
+*/
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF)
+
+struct WatchDir
+{
+	int wd;
+	char * path;
+};
+
+int watch_fd = -1;
+WatchDir * watch_dirs = NULL;
+int num_watch_dirs = 0;
+
+void addWatchDir(const char * path)
+{
+	if(strcmp(path, init_cache_path) == 0){
+		// compiled files are written there
+		return;
+	}
+	int wd = inotify_add_watch(watch_fd, path, WATCH_EVENTS | IN_ONLYDIR);
+	if(wd < 0){
+		return;
+	}
+	for(int i = 0; i < num_watch_dirs; i++){
+		if(watch_dirs[i].wd == wd){
+			return;
+		}
+	}
+	watch_dirs = (WatchDir*)realloc(watch_dirs, sizeof(WatchDir) * (num_watch_dirs + 1));
+	watch_dirs[num_watch_dirs].wd = wd;
+	watch_dirs[num_watch_dirs].path = strdup(path);
+	num_watch_dirs++;
+
+	DIR * dir = opendir(path);
+	if(!dir){
+		return;
+	}
+	int path_len = (int)strlen(path);
+	for(struct dirent * entry; (entry = readdir(dir)) != NULL;){
+		if(entry->d_name[0] == '.' || (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)){
+			continue;
+		}
+		char * child_path = (char*)malloc(path_len + strlen(entry->d_name) + 2);
+		sprintf(child_path, "%s/%s", path, entry->d_name);
+		addWatchDir(child_path);
+		free(child_path);
+	}
+	closedir(dir);
+}
+
+void removeWatchDir(int wd)
+{
+	for(int i = 0; i < num_watch_dirs; i++){
+		if(watch_dirs[i].wd == wd){
+			free(watch_dirs[i].path);
+			watch_dirs[i] = watch_dirs[--num_watch_dirs];
+			return;
+		}
+	}
+}
+
+const char * findWatchDir(int wd)
+{
+	for(int i = 0; i < num_watch_dirs; i++){
+		if(watch_dirs[i].wd == wd){
+			return watch_dirs[i].path;
+		}
+	}
+	return NULL;
+}
+
+void * watchThread(void*)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for(;;){
+		int len = (int)read(watch_fd, buf, sizeof(buf));
+		if(len <= 0){
+			if(len < 0 && errno == EINTR){
+				continue;
+			}
+			break;
+		}
+		bool changed = false;
+		for(char * cur = buf; cur < buf + len;){
+			struct inotify_event * event = (struct inotify_event*)cur;
+			cur += sizeof(struct inotify_event) + event->len;
+			if(event->mask & IN_IGNORED){
+				removeWatchDir(event->wd);
+				continue;
+			}
+			changed = true;
+			if((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) && event->len){
+				const char * path = findWatchDir(event->wd);
+				if(path){
+					char * child_path = (char*)malloc(strlen(path) + strlen(event->name) + 2);
+					sprintf(child_path, "%s/%s", path, event->name);
+					addWatchDir(child_path);
+					free(child_path);
+				}
+			}
+		}
+		if(changed){
+			invalidateFileCache();
+		}
+	}
+	return NULL;
+}
+
+bool initWatcher(OS * os)
+{
+	watch_fd = inotify_init();
+	if(watch_fd < 0){
+		printf("Error: inotify initialization is failed (%s)\n", strerror(errno));
+		return false;
+	}
+	int count = os->getLen();
+	for(int i = 0; i < count; i++){
+		os->pushStackValue();
+		os->pushNumber(i);
+		os->getProperty();
+		OS::String path = os->popString();
+		if(!path.isEmpty()){
+			addWatchDir(path.toChar());
+		}
 	}
+	printf("watch: %d dirs\n", num_watch_dirs);
+	return num_watch_dirs > 0;
+}
+
+void startWatcher()
+{
+	pthread_t id;
+	if(watch_fd >= 0 && pthread_create(&id, NULL, watchThread, NULL) == 0){
+		pthread_detach(id);
+	}
+}
+#endif // OS_FCGI_WATCH_SUPPORTED
+
+/*
+	Static files are read to memory shared by all threads, cached entry is used
+	while it matches cached file stat so changed file is read again. Files are
+	copied instead of mapped because mapped file rewritten in place raises SIGBUS
+	in the worker which sends it. Least recently used files are freed when total
+	size exceeds static_cache_size.
+*/
+struct StaticFile
+{
+	void * data;
+	int size;
+	time_t mtime;
+	int refs; // cache holds one reference while the file is in cache
+	unsigned int last_used;
+};
+
+std::map<std::string, StaticFile*> static_files;
+int static_files_size = 0;
+int static_cache_size = 1024*1024*64;
+unsigned int static_files_tick = 0;
+
+#ifndef _MSC_VER
+pthread_mutex_t static_files_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_STATIC_FILES() pthread_mutex_lock(&static_files_mutex)
+#define UNLOCK_STATIC_FILES() pthread_mutex_unlock(&static_files_mutex)
+#else
+#define LOCK_STATIC_FILES()
+#define UNLOCK_STATIC_FILES()
+#endif
+
+void releaseStaticFile(OS * os, StaticFile * file)
+{
+	LOCK_STATIC_FILES();
+	bool unused = --file->refs == 0;
+	UNLOCK_STATIC_FILES();
+	if(unused){
+		::free(file->data);
+		delete file;
+	}
+}
+
+// the function should be called with locked static_files_mutex, freeing is up to caller
+StaticFile * removeStaticFile(std::map<std::string, StaticFile*>::iterator it)
+{
+	StaticFile * file = it->second;
+	static_files.erase(it);
+	static_files_size -= file->size;
+	return --file->refs == 0 ? file : NULL;
+}
+
+StaticFile * acquireStaticFile(OS * os, const char * filename, const FileCacheStat& st)
+{
+	StaticFile * unused = NULL;
+	LOCK_STATIC_FILES();
+	std::map<std::string, StaticFile*>::iterator it = static_files.find(filename);
+	if(it != static_files.end()){
+		StaticFile * file = it->second;
+		if(file->mtime == st.mtime && file->size == st.size){
+			file->refs++;
+			file->last_used = ++static_files_tick;
+			UNLOCK_STATIC_FILES();
+			return file;
+		}
+		unused = removeStaticFile(it);
+	}
+	UNLOCK_STATIC_FILES();
+	if(unused){
+		::free(unused->data);
+		delete unused;
+	}
+	if(st.size <= 0 || st.size > static_cache_size / 4){
+		// too big file is sent by chunks
+		return NULL;
+	}
+
+	OS::FileHandle * f = os->openFile(filename, "rb");
+	if(!f){
+		return NULL;
+	}
+	int size = st.size;
+	void * data = ::malloc(size);
+	// one more byte is requested to see if file is grown after its stat is cached
+	char extra;
+	bool changed = !data || os->readFile(data, size, f) != size || os->readFile(&extra, 1, f) != 0;
+	os->closeFile(f);
+	if(changed){
+		::free(data);
+		return NULL;
+	}
+	StaticFile * file = new StaticFile();
+	file->data = data;
+	file->size = size;
+	file->mtime = st.mtime;
+	file->refs = 1;
+	file->last_used = 0;
+	StaticFile * evicted[16];
+	int num_evicted = 0;
+	LOCK_STATIC_FILES();
+	if(static_files.find(filename) == static_files.end()){
+		file->refs++;
+		file->last_used = ++static_files_tick;
+		static_files[filename] = file;
+		static_files_size += size;
+		while(static_files_size > static_cache_size && num_evicted < 16){
+			std::map<std::string, StaticFile*>::iterator oldest = static_files.begin();
+			for(it = static_files.begin(); it != static_files.end(); ++it){
+				if(it->second->last_used < oldest->second->last_used){
+					oldest = it;
+				}
+			}
+			if(oldest->second == file){
+				break;
+			}
+			StaticFile * old = removeStaticFile(oldest);
+			if(old){
+				evicted[num_evicted++] = old;
+			}
+		}
+	}
+	UNLOCK_STATIC_FILES();
+	for(int i = 0; i < num_evicted; i++){
+		::free(evicted[i]->data);
+		delete evicted[i];
+	}
+	return file;
 }
 
 void dolog(const char * format, ...)
@@ -123,9 +431,20 @@ protected:
 	// int shutdown_funcs_id;
 	bool headers_sent;
 	Core::String * cache_path;
+	MPFD::Parser * post_parser;
+	int body_state;
+	int body_remain;
+	int output_state;
+	bool gzip_accepted;
+	Core::Buffer * output_headers;
+	Core::Buffer * output_body;
+#ifndef OS_ZLIB_DISABLED
+	z_stream * gzip_stream;
+#endif
 
 	virtual ~FCGX_OS()
 	{
+		delete post_parser;
 	}
 
 	virtual bool init(MemoryManager * mem)
@@ -133,6 +452,8 @@ protected:
 		if(OS::init(mem)){
 			setGCStartWhenUsedBytes(32 * 1024 * 1024);
 			cache_path = new (malloc(sizeof(Core::String) OS_DBG_FILEPOS)) Core::String(this, init_cache_path);
+			output_headers = new (malloc(sizeof(Core::Buffer) OS_DBG_FILEPOS)) Core::Buffer(this);
+			output_body = new (malloc(sizeof(Core::Buffer) OS_DBG_FILEPOS)) Core::Buffer(this);
 
 			initProcessExtension(this);
 			initFileSystemExtension(this);
@@ -141,6 +462,9 @@ protected:
 			initBase64Extension(this);
 			initDateTimeExtension(this);
 			initJsonExtension(this);
+			initCacheExtension(this);
+
+			setBundle(bundle);
 
 #ifndef OS_CURL_DISABLED
 			initCurlExtension(this);
@@ -172,6 +496,15 @@ protected:
 
 	virtual void shutdown()
 	{
+#ifndef OS_ZLIB_DISABLED
+		if(gzip_stream){
+			deflateEnd(gzip_stream);
+			free(gzip_stream);
+			gzip_stream = NULL;
+		}
+#endif
+		deleteObj(output_headers);
+		deleteObj(output_body);
 		deleteObj(cache_path);
 		OS::shutdown();
 	}
@@ -182,6 +515,14 @@ public:
 	{
 		request = NULL;
 		headers_sent = false;
+		post_parser = NULL;
+		body_state = BODY_NOT_READ;
+		body_remain = 0;
+		output_state = OUTPUT_NOT_STARTED;
+		gzip_accepted = false;
+#ifndef OS_ZLIB_DISABLED
+		gzip_stream = NULL;
+#endif
 	}
 
 	void initSettings()
@@ -232,20 +573,245 @@ public:
 	{
 		if(!headers_sent){
 			headers_sent = true;
-			appendBuffer("Content-type: text/html; charset=utf-8\r\n\r\n");
+			if(gzip_accepted){
+				output_headers->append("Content-type: text/html; charset=utf-8\r\n");
+				output_state = OUTPUT_PENDING;
+			}else{
+				appendBuffer("Content-type: text/html; charset=utf-8\r\n\r\n");
+				output_state = OUTPUT_PLAIN;
+			}
+		}
+		writeOutput(buf, size);
+	}
+
+	/*
+		Response body is compressed by gzip stream while it's written if client
+		accepts gzip and content type is not compressed yet. Headers and body are
+		held until body reaches gzip_min_size, so small responses are sent as is.
+		Headers written by script itself (after notifyHeadersSent) are collected
+		till empty line to find out content type.
+	*/
+	enum EOutputState
+	{
+		OUTPUT_NOT_STARTED,
+		OUTPUT_SCRIPT_HEADERS,
+		OUTPUT_PENDING,
+		OUTPUT_PLAIN,
+		OUTPUT_GZIP
+	};
+
+	static bool isGzipAccepted(const char * accept_encoding)
+	{
+		float gzip_q = -1, any_q = -1;
+		for(const char * cur = accept_encoding; *cur;){
+			while(*cur == ' ' || *cur == ','){
+				cur++;
+			}
+			const char * name = cur;
+			while(*cur && *cur != ',' && *cur != ';' && *cur != ' '){
+				cur++;
+			}
+			int len = (int)(cur - name);
+			float q = 1;
+			for(; *cur && *cur != ','; cur++){
+				if(cur[0] == 'q' && cur[1] == '='){
+					q = (float)atof(cur + 2);
+				}
+			}
+			if(len == 4 && strncmp(name, "gzip", 4) == 0){
+				gzip_q = q;
+			}else if(len == 1 && *name == '*'){
+				any_q = q;
+			}
+		}
+		return gzip_q >= 0 ? gzip_q > 0 : any_q > 0;
+	}
+
+	static bool isHeader(const char * line, const char * name)
+	{
+		for(; *name; line++, name++){
+			if(tolower((unsigned char)*line) != *name){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static bool isCompressibleType(const char * type, int len)
+	{
+		static const char * types[] = {
+			"text/",
+			"application/json",
+			"application/javascript",
+			"application/x-javascript",
+			"application/xml",
+			"image/svg+xml",
+			NULL
+		};
+		for(int i = 0; types[i]; i++){
+			int type_len = (int)strlen(types[i]);
+			if(len >= type_len && isHeader(type, types[i])){
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// headers are "Name: value\r\n" lines, response is compressed only if its headers don't describe body already
+	static bool isCompressibleHeaders(const char * headers, int len)
+	{
+		for(const char * line = headers, * end = headers + len; line < end;){
+			const char * line_end = (const char*)memchr(line, '\n', end - line);
+			if(!line_end){
+				line_end = end;
+			}
+			if(isHeader(line, "content-encoding:") || isHeader(line, "content-length:") || isHeader(line, "content-range:")){
+				return false;
+			}
+			if(isHeader(line, "content-type:")){
+				const char * type = line + 13;
+				while(type < line_end && *type == ' '){
+					type++;
+				}
+				if(!isCompressibleType(type, (int)(line_end - type))){
+					return false;
+				}
+			}
+			line = line_end + 1;
+		}
+		return true;
+	}
+
+	void startOutput()
+	{
+		if(output_state == OUTPUT_NOT_STARTED){
+			output_state = gzip_accepted ? OUTPUT_SCRIPT_HEADERS : OUTPUT_PLAIN;
+		}
+	}
+
+	void writeScriptHeaders(const void * buf, int size)
+	{
+		int start = output_headers->buffer.count > 3 ? output_headers->buffer.count - 3 : 0;
+		output_headers->append(buf, size);
+		const char * headers = (const char*)output_headers->buffer.buf;
+		int count = output_headers->buffer.count;
+		for(int i = start; i + 4 <= count; i++){
+			if(memcmp(headers + i, "\r\n\r\n", 4) == 0){
+				if(isCompressibleHeaders(headers, i + 2)){
+					// empty line is written when compression is decided
+					output_headers->buffer.count = i + 2;
+					output_state = OUTPUT_PENDING;
+				}else{
+					appendBuffer(headers, i + 4);
+					output_headers->buffer.count = 0;
+					output_state = OUTPUT_PLAIN;
+				}
+				if(count > i + 4){
+					writeOutput(headers + i + 4, count - i - 4);
+				}
+				return;
+			}
+		}
+		if(count > 1024*64){
+			// it's not headers
+			appendBuffer(headers, count);
+			output_headers->clear();
+			output_state = OUTPUT_PLAIN;
+		}
+	}
+
+	void flushPendingOutput(bool compress)
+	{
+		appendBuffer(output_headers->buffer.buf, output_headers->buffer.count);
+		if(compress && startGzip()){
+			appendBuffer("Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n\r\n");
+			output_state = OUTPUT_GZIP;
+			writeGzip(output_body->buffer.buf, output_body->buffer.count, false);
+		}else{
+			appendBuffer("\r\n");
+			output_state = OUTPUT_PLAIN;
+			appendBuffer(output_body->buffer.buf, output_body->buffer.count);
+		}
+		output_headers->clear();
+		output_body->clear();
+	}
+
+	bool startGzip()
+	{
+#ifndef OS_ZLIB_DISABLED
+		gzip_stream = (z_stream*)malloc(sizeof(z_stream) OS_DBG_FILEPOS);
+		memset(gzip_stream, 0, sizeof(z_stream));
+		// window bits 15 + 16 makes gzip header & trailer
+		if(deflateInit2(gzip_stream, gzip_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK){
+			return true;
+		}
+		free(gzip_stream);
+		gzip_stream = NULL;
+#endif
+		return false;
+	}
+
+	void writeGzip(const void * buf, int size, bool finish)
+	{
+#ifndef OS_ZLIB_DISABLED
+		Bytef out[1024*16];
+		gzip_stream->next_in = (Bytef*)buf;
+		gzip_stream->avail_in = size;
+		do{
+			gzip_stream->next_out = out;
+			gzip_stream->avail_out = sizeof(out);
+			deflate(gzip_stream, finish ? Z_FINISH : Z_NO_FLUSH);
+			int len = (int)(sizeof(out) - gzip_stream->avail_out);
+			if(len > 0){
+				appendBuffer(out, len);
+			}
+		}while(gzip_stream->avail_out == 0);
+#endif
+	}
+
+	void writeOutput(const void * buf, int size)
+	{
+		switch(output_state){
+		case OUTPUT_SCRIPT_HEADERS:
+			writeScriptHeaders(buf, size);
+			return;
+
+		case OUTPUT_PENDING:
+			output_body->append(buf, size);
+			if(output_body->buffer.count >= gzip_min_size){
+				flushPendingOutput(true);
+			}
+			return;
+
+		case OUTPUT_GZIP:
+			writeGzip(buf, size, false);
+			return;
 		}
 		appendBuffer(buf, size);
 	}
 
-	String md5(const String& buf)
+	void finishOutput()
 	{
-		getGlobal(OS_TEXT("hashlib"));
-		getProperty(-1, OS_TEXT("md5"));
-		OS_ASSERT(isFunction());
-		pushString(buf);
-		callTF(1, 1);
-		OS_ASSERT(isString());
-		return popString();
+		switch(output_state){
+		case OUTPUT_SCRIPT_HEADERS:
+			appendBuffer(output_headers->buffer.buf, output_headers->buffer.count);
+			output_headers->clear();
+			break;
+
+		case OUTPUT_PENDING:
+			flushPendingOutput(false);
+			break;
+
+		case OUTPUT_GZIP:
+#ifndef OS_ZLIB_DISABLED
+			writeGzip(NULL, 0, true);
+			deflateEnd(gzip_stream);
+			free(gzip_stream);
+			gzip_stream = NULL;
+#endif
+			break;
+		}
+		output_state = OUTPUT_PLAIN;
 	}
 
 	String getCompiledFilename(const String& resolved_filename)
@@ -261,15 +827,35 @@ public:
 			return resolved_filename;
 		}
 #endif	
+		// name depends on source version so changed file is compiled to new file
+		// and workers which still use previous one are not disturbed
+		FileCacheStat st;
+		if(!getCachedFileStat(resolved_filename, &st)){
+			st.mtime = 0;
+			st.size = 0;
+		}
+		OS_U64 hash = getNameHash(14695981039346656037ULL, resolved_filename.toChar(), resolved_filename.getDataSize());
+		OS_U64 version[] = {(OS_U64)st.mtime, (OS_U64)st.size};
+		hash = getNameHash(hash, version, sizeof(version));
+
+		char name[64];
+		sprintf(name, "/os-cache-%08x%08x", (OS_U32)(hash >> 32), (OS_U32)hash);
 		Core::Buffer buf(this);
 		buf.append(*cache_path);
-		buf.append(OS_TEXT("/os-cache-"));
-		buf.append(md5(resolved_filename));
+		buf.append(name);
 		buf.append(OS_EXT_COMPILED);
-		// buf.append(changeFilenameExt(md5(resolved_filename), OS_EXT_COMPILED));
 		return buf.toStringOS(); 
 	}
 
+	static OS_U64 getNameHash(OS_U64 hash, const void * p_buf, int size)
+	{
+		const OS_BYTE * buf = (const OS_BYTE*)p_buf;
+		for(int i = 0; i < size; i++){
+			hash = (hash ^ buf[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
 	String getTextOpcodesFilename(const String& resolved_filename)
 	{
 		return changeFilenameExt(getCompiledFilename(resolved_filename), OS_EXT_TEXT_OPCODES);
@@ -277,19 +863,39 @@ public:
 
 	OS_EFileUseType checkFileUsage(const String& sourcecode_filename, const String& compiled_filename)
 	{
-		struct stat sourcecode_st, compiled_st;
-		stat(sourcecode_filename, &sourcecode_st);
-		stat(compiled_filename, &compiled_st);
-		if(sourcecode_st.st_mtime >= compiled_st.st_mtime || compiled_st.st_mtime < start_time){
+		FileCacheStat sourcecode_st, compiled_st;
+		if(!getCachedFileStat(sourcecode_filename, &sourcecode_st)){
+			sourcecode_st.mtime = 0;
+		}
+		if(!getCachedFileStat(compiled_filename, &compiled_st)){
+			compiled_st.mtime = 0;
+		}
+		if(sourcecode_st.mtime >= compiled_st.mtime || compiled_st.mtime < start_time){
+			// compiled file is going to be rewritten so its stat is not actual any more
+			invalidateFileCache(compiled_filename);
 			return COMPILE_SOURCECODE_FILE;
 		}
 		return LOAD_COMPILED_FILE;
 	}
 
+	// stats and resolved paths are shared by all threads so steady requires don't touch file system
+	bool isFileExist(const OS_CHAR * filename)
+	{
+		FileCacheStat st;
+		return getCachedFileStat(filename, &st);
+	}
+
+	using OS::resolvePath;
+	String resolvePath(const String& filename)
+	{
+		return resolveCachedPath(this, filename);
+	}
+
 	static int notifyHeadersSent(OS * p_os, int params, int, int, void*)
 	{
 		FCGX_OS * os = (FCGX_OS*)p_os;
 		os->headers_sent = true;
+		os->startOutput();
 		return 0;
 	}
 
@@ -340,6 +946,9 @@ public:
 		FuncDef funcs[] = {
 			{"notifyHeadersSent", FCGX_OS::notifyHeadersSent},
 			{"__get@OS_FCGI_VERSION", FCGX_OS::getFCGIVersion},
+			{"__get@_POST", FCGX_OS::getPOST},
+			{"__get@_FILES", FCGX_OS::getFILES},
+			{"readRequestBody", FCGX_OS::readRequestBody},
 			{}
 		};
 		pushGlobals();
@@ -347,52 +956,74 @@ public:
 		pop();
 	}
 
-	void processRequest(FCGX_Request * p_request)
+	enum EBodyState
 	{
-		request = p_request;
- 
-		initGlobalFunctions();
+		BODY_NOT_READ,
+		BODY_PARSED,
+		BODY_STREAMED
+	};
 
-		initEnv("_SERVER", request->envp);
+	// _POST & _FILES are made at first access so script is started without waiting for request body
+	static int getPOST(OS * p_os, int params, int, int, void*)
+	{
+		FCGX_OS * os = (FCGX_OS*)p_os;
+		os->parseRequestBody();
+		os->getGlobal("_POST");
+		return 1;
+	}
 
+	static int getFILES(OS * p_os, int params, int, int, void*)
+	{
+		FCGX_OS * os = (FCGX_OS*)p_os;
+		os->parseRequestBody();
+		os->getGlobal("_FILES");
+		return 1;
+	}
+
+	// returns next chunk of request body or null at the end, _POST & _FILES are empty if script reads body itself.
+	// multipart parts are not exposed as separate streams, big uploads are spooled to upload_temp_path
+	// by the parser, so script which needs parts as they arrive parses raw chunks itself
+	static int readRequestBody(OS * p_os, int params, int, int, void*)
+	{
+		FCGX_OS * os = (FCGX_OS*)p_os;
+		if(os->body_state == BODY_PARSED || os->body_remain <= 0){
+			return 0;
+		}
+		os->body_state = BODY_STREAMED;
+		int size = params > 0 ? os->toInt(-params) : 0;
+		if(size <= 0){
+			size = 1024*64;
+		}
+		if(size > os->body_remain){
+			size = os->body_remain;
+		}
+		char * buf = (char*)os->malloc(size OS_DBG_FILEPOS);
+		int len = FCGX_GetStr(buf, size, os->request->in);
+		if(len <= 0){
+			os->free(buf);
+			os->body_remain = 0;
+			return 0;
+		}
+		os->body_remain -= len;
+		os->pushString((const void*)buf, len);
+		os->free(buf);
+		return 1;
+	}
+
+	void parseRequestBody()
+	{
 		newObject();
-		setGlobal("_POST");
-		
-		newObject();
-		setGlobal("_GET");
-		
-		newObject();
-		setGlobal("_FILES");
+		setGlobal("_POST", false);
 		
 		newObject();
-		setGlobal("_COOKIE");
-
-#ifdef _MSC_VER
-		pushBool(true);
-		setGlobal("_PLATFORM_WINDOWS");
-		
-		pushBool(false);
-		setGlobal("_PLATFORM_UNIX");
-#else
-		pushBool(false);
-		setGlobal("_PLATFORM_WINDOWS");
-		
-		pushBool(true);
-		setGlobal("_PLATFORM_UNIX");
-#endif
-		pushString(*cache_path);
-		setGlobal("OS_CACHE_PATH");
-
-		getGlobal("_SERVER");
-		getProperty("CONTENT_LENGTH");
-		int content_length = popInt();
+		setGlobal("_FILES", false);
 
-		// int post_max_size = 1024*1024*8;
-		if(content_length > post_max_size){
-			FCGX_FPrintF(request->out, "POST Content-Length of %d bytes exceeds the limit of %d bytes", content_length, post_max_size);
+		if(body_state != BODY_NOT_READ){
 			return;
 		}
+		body_state = BODY_PARSED;
 
+		int content_length = body_remain;
 		getGlobal("_SERVER");
 		getProperty("CONTENT_TYPE");
 		String content_type = popString();
@@ -403,37 +1034,37 @@ public:
 		const char * form_urlencoded = "application/x-www-form-urlencoded";
 		int form_urlencoded_len = (int)strlen(form_urlencoded);
 
-		bool is_valid_headers = true;
-
-		MPFD::Parser POSTParser = MPFD::Parser();
 		if(content_length > 0 && content_type.getLen() > 0 && strncmp(content_type.toChar(), multipart_form_data, multipart_form_data_len) == 0){
+			// parser lives until the end of request because it removes not moved uploaded files
+			post_parser = new MPFD::Parser();
+			bool is_valid_body = true;
 			char * temp_buf = NULL;
 			try{
 				// dolog("begin multipart_form_data");
-				POSTParser.SetTempDirForFileUpload("/tmp");
-				// POSTParser.SetMaxCollectedDataLength(20*1024);
-				POSTParser.SetContentType(content_type.toChar());
+				post_parser->SetTempDirForFileUpload(upload_temp_path);
+				post_parser->SetMaxInMemoryFileSize(upload_memory_size);
+				post_parser->SetContentType(content_type.toChar());
 
 				int max_temp_buf_size = (int)(1024*1024*0.1);
 				int temp_buf_size = content_length < max_temp_buf_size ? content_length : max_temp_buf_size;
 				temp_buf = (char*)malloc(temp_buf_size + 1 OS_DBG_FILEPOS); // new char[temp_buf_size + 1];
-				for(int cur_len; (cur_len = FCGX_GetStr(temp_buf, temp_buf_size, request->in)) > 0;){
-					POSTParser.AcceptSomeData(temp_buf, cur_len);
+				for(int cur_len; body_remain > 0 && (cur_len = FCGX_GetStr(temp_buf, temp_buf_size, request->in)) > 0;){
+					body_remain -= cur_len;
+					post_parser->AcceptSomeData(temp_buf, cur_len);
 				}
 				free(temp_buf); // delete [] temp_buf;
 				temp_buf = NULL;
 			
-				// POSTParser.SetExternalDataBuffer(buf, len);
-				POSTParser.FinishData();
+				post_parser->FinishData();
 			}catch(MPFD::Exception& e){
-				is_valid_headers = false;
+				is_valid_body = false;
 				free(temp_buf);
 #if defined _MSC_VER && 1
 				fprintf(stderr, "error post data: %s\n", e.GetError().c_str());
 #endif
 			}
-			if(is_valid_headers){
-				std::map<std::string, MPFD::Field *> fields = POSTParser.GetFieldsMap();
+			if(is_valid_body){
+				std::map<std::string, MPFD::Field *> fields = post_parser->GetFieldsMap();
 				// FCGX_FPrintF(request->out, "Have %d fields<p>\n", fields.size());
 
 				std::map<std::string, MPFD::Field *>::iterator it;
@@ -455,13 +1086,24 @@ public:
 							pushString(field->GetFileMimeType().c_str());
 							setProperty("type");
 						
-							pushStackValue();
-							pushString(field->GetTempFileNameEx().c_str());
-							setProperty("temp");
+							if(field->IsStoredInMemory()){
+								// small file is not spooled to disk
+								pushStackValue();
+								pushString((const void*)field->GetFileContent(), (int)field->GetFileContentSize());
+								setProperty("content");
+
+								pushStackValue();
+								pushNumber(field->GetFileContentSize());
+								setProperty("size");
+							}else{
+								pushStackValue();
+								pushString(field->GetTempFileNameEx().c_str());
+								setProperty("temp");
 						
-							pushStackValue();
-							pushNumber(getFileSize(field->GetTempFileNameEx().c_str()));
-							setProperty("size");
+								pushStackValue();
+								pushNumber(getFileSize(field->GetTempFileNameEx().c_str()));
+								setProperty("size");
+							}
 						}
 						setSmartProperty(it->first.c_str());
 					}
@@ -473,48 +1115,66 @@ public:
 			Core::Buffer buf(this);
 			buf.reserveCapacity(content_length+4);
 			for(int cur_len; (cur_len = FCGX_GetStr((char*)buf.buffer.buf, content_length, request->in)) > 0;){
+				body_remain -= cur_len;
 				buf.buffer.count = cur_len;
 				OS_ASSERT(content_length == cur_len);
 				int temp; (void)temp;
 				OS_ASSERT(FCGX_GetStr((char*)&temp, sizeof(temp), request->in) == 0);
 				break;
 			}
-			buf.buffer.buf[buf.buffer.count] = '\0';
-			char * form = (char*)buf.buffer.buf;
-			for(; form ;){
-				char * assign = strchr(form, '=');
-				if(assign){
-					getGlobal("url");
-					getProperty(-1, "decode");
-					OS_ASSERT(isFunction());
-					pushString(form, assign - form);
-					callTF(1, 1);
-					String name = popString();
-
-					getGlobal("url");
-					getProperty(-1, "decode");
-					OS_ASSERT(isFunction());
-					char * value_str = assign+1;
-					char * end_str = strchr(value_str, '&');
-					if(end_str){
-						pushString(value_str, end_str - value_str);
-						form = end_str+1;
-					}else{
-						pushString(value_str);
-						form = NULL;
-					}
-					callTF(1, 1);
-					String value = popString();
-					
-					getGlobal("_POST");
-					pushString(value);
-					setSmartProperty(name);
-				}else{
-					break;
-				}
-			}
+			getGlobal("_POST");
+			parseUrlQuery(this, buf.buffer.buf, buf.buffer.count);
+			pop();
 			// dolog("end form_urlencoded");
 		}
+	}
+
+	void processRequest(FCGX_Request * p_request)
+	{
+		request = p_request;
+ 
+		initGlobalFunctions();
+
+		initEnv("_SERVER", request->envp);
+		gzip_accepted = gzip_level > 0 && isGzipAccepted(getServerVar("HTTP_ACCEPT_ENCODING"));
+
+		newObject();
+		String query = getServerVar("QUERY_STRING");
+		parseUrlQuery(this, query.toChar(), query.getDataSize());
+		setGlobal("_GET");
+		
+		newObject();
+		String cookie = getServerVar("HTTP_COOKIE");
+		parseUrlQuery(this, cookie.toChar(), cookie.getDataSize(), ";");
+		setGlobal("_COOKIE");
+
+#ifdef _MSC_VER
+		pushBool(true);
+		setGlobal("_PLATFORM_WINDOWS");
+		
+		pushBool(false);
+		setGlobal("_PLATFORM_UNIX");
+#else
+		pushBool(false);
+		setGlobal("_PLATFORM_WINDOWS");
+		
+		pushBool(true);
+		setGlobal("_PLATFORM_UNIX");
+#endif
+		pushString(*cache_path);
+		setGlobal("OS_CACHE_PATH");
+
+		getGlobal("_SERVER");
+		getProperty("CONTENT_LENGTH");
+		int content_length = popInt();
+
+		// int post_max_size = 1024*1024*8;
+		if(content_length > post_max_size){
+			FCGX_FPrintF(request->out, "POST Content-Length of %d bytes exceeds the limit of %d bytes", content_length, post_max_size);
+			return;
+		}
+		body_remain = content_length > 0 ? content_length : 0;
+		body_state = BODY_NOT_READ;
 		
 		extern char **environ;
 		initEnv("_ENV", environ);
@@ -562,7 +1222,7 @@ public:
 					OS_OPENSOURCE
 				"</center></body></html>";
 
-			if(script_filename.isEmpty() || !is_valid_headers){
+			if(script_filename.isEmpty()){
 				if(!headers_sent){
 					headers_sent = true;
 					FCGX_PutS(just_ready, request->out);
@@ -581,7 +1241,7 @@ public:
 				bool found = false;
 				for(int i = 0; ext[i]; i++){
 					String new_script_filename = script_filename + OS_TEXT("index") + ext[i];
-					if(isFileExist(new_script_filename)){
+					if(isBundleFile(new_script_filename) || isFileExist(new_script_filename)){
 						script_filename = new_script_filename;
 						found = true;
 						break;
@@ -604,44 +1264,183 @@ public:
 					headers_sent = true;
 					FCGX_PutS(just_ready, request->out);
 				}
-			}else{
-				// print requested file, it's not recommended, only ObjectScript scripts are recommended
-				FileHandle * f = openFile(script_filename, "rb");
-				if(f){
-					if(!headers_sent){
-						headers_sent = true;
-						FCGX_PutS("Content-type: ", request->out);
-						FCGX_PutS(getContentType(ext), request->out);
-						FCGX_PutS("\r\n\r\n", request->out);
-					}
-					const int BUF_SIZE = 1024*256;
-					int size = getFileSize(f);
-					void * buf = malloc(BUF_SIZE < size ? BUF_SIZE : size OS_DBG_FILEPOS);
-					for(int i = 0; i < size; i += BUF_SIZE){
-						int len = BUF_SIZE < size - i ? BUF_SIZE : size - i;
-						readFile(buf, len, f);
-						FCGX_PutStr((const char*)buf, len, request->out);
-					}
-					free(buf);				
-					closeFile(f);
+			}else if(!sendStaticFile(script_filename, ext)){ // it's not recommended, only ObjectScript scripts are recommended
+				if(!headers_sent){
+					headers_sent = true;
+					FCGX_FPrintF(request->out, not_found, getFilename(script_filename).toChar());
 				}else{
-					if(!headers_sent){
-						headers_sent = true;
-						FCGX_FPrintF(request->out, not_found, getFilename(script_filename).toChar());
-					}else{
-						FCGX_FPrintF(request->out, "404 Not Found %s", getFilename(script_filename).toChar());
-					}
+					FCGX_FPrintF(request->out, "404 Not Found %s", getFilename(script_filename).toChar());
 				}
 			}
 		}while(false);
 
 		triggerShutdownFunctions();
+		finishOutput();
 		
 		FCGX_Finish_r(request);
 
 		triggerCleanupFunctions();
 	}
 
+	String getServerVar(const OS_CHAR * name)
+	{
+		getGlobal("_SERVER");
+		getProperty(-1, name);
+		String value = popString("");
+		pop();
+		return value;
+	}
+
+	static void formatHttpDate(char * buf, int size, time_t t)
+	{
+		struct tm tm;
+#ifdef _MSC_VER
+		gmtime_s(&tm, &t);
+#else
+		gmtime_r(&t, &tm);
+#endif
+		strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	}
+
+	// returns 1 if single range is parsed, 0 if header should be ignored, -1 if range is not satisfiable
+	static int parseRange(const char * range, int size, int& start, int& end)
+	{
+		if(strncmp(range, "bytes=", 6) != 0 || strchr(range, ',')){
+			return 0;
+		}
+		const char * cur = range + 6;
+		char * next;
+		if(*cur == '-'){
+			long suffix = strtol(cur + 1, &next, 10);
+			if(next == cur + 1 || *next){
+				return 0;
+			}
+			if(suffix <= 0 || size == 0){
+				return -1;
+			}
+			start = suffix < size ? size - (int)suffix : 0;
+			end = size - 1;
+			return 1;
+		}
+		long first = strtol(cur, &next, 10);
+		if(next == cur || *next != '-'){
+			return 0;
+		}
+		long last = size - 1;
+		cur = next + 1;
+		if(*cur){
+			last = strtol(cur, &next, 10);
+			if(next == cur || *next || last < first){
+				return 0;
+			}
+			if(last >= size){
+				last = size - 1;
+			}
+		}
+		if(first >= size){
+			return -1;
+		}
+		start = (int)first;
+		end = (int)last;
+		return 1;
+	}
+
+	// returns false if file is not found, conditional requests are answered by cached stat without touching the file
+	bool sendStaticFile(const String& filename, const String& ext)
+	{
+		FileCacheStat st;
+		if(!getCachedFileStat(filename, &st)){
+			return false;
+		}
+		char etag[64], last_modified[64];
+		sprintf(etag, "\"%x-%x\"", (unsigned)st.mtime, (unsigned)st.size);
+		formatHttpDate(last_modified, sizeof(last_modified), st.mtime);
+
+		String if_none_match = getServerVar("HTTP_IF_NONE_MATCH");
+		bool not_modified = !if_none_match.isEmpty()
+			? if_none_match == "*" || strstr(if_none_match.toChar(), etag) != NULL
+			: getServerVar("HTTP_IF_MODIFIED_SINCE") == last_modified;
+		if(not_modified){
+			headers_sent = true;
+			FCGX_FPrintF(request->out, "Status: 304 Not Modified\r\nETag: %s\r\nLast-Modified: %s\r\n\r\n", etag, last_modified);
+			return true;
+		}
+
+		// file is sent from shared memory copy, it's read by chunks if it's too big to be cached
+		StaticFile * file = acquireStaticFile(this, filename, st);
+		FileHandle * f = NULL;
+		int size;
+		if(file){
+			size = file->size;
+		}else{
+			f = openFile(filename, "rb");
+			if(!f){
+				return false;
+			}
+			size = getFileSize(f);
+		}
+		if(size != st.size){
+			// file is changed after its stat is cached, validators are not known
+			invalidateFileCache(filename);
+			etag[0] = last_modified[0] = '\0';
+		}
+
+		int start = 0, end = size - 1;
+		bool partial = false;
+		String range = getServerVar("HTTP_RANGE");
+		if(!range.isEmpty() && etag[0]){
+			String if_range = getServerVar("HTTP_IF_RANGE");
+			if(if_range.isEmpty() || if_range == etag || if_range == last_modified){
+				int r = parseRange(range.toChar(), size, start, end);
+				if(r < 0){
+					headers_sent = true;
+					FCGX_FPrintF(request->out, "Status: 416 Range Not Satisfiable\r\nContent-Range: bytes */%d\r\nContent-Length: 0\r\n\r\n", size);
+					if(file){
+						releaseStaticFile(this, file);
+					}else{
+						closeFile(f);
+					}
+					return true;
+				}
+				partial = r > 0;
+			}
+		}
+
+		headers_sent = true;
+		FCGX_FPrintF(request->out, "Content-type: %s\r\n", getContentType(ext));
+		if(partial){
+			FCGX_FPrintF(request->out, "Status: 206 Partial Content\r\nContent-Range: bytes %d-%d/%d\r\n", start, end, size);
+		}
+		FCGX_FPrintF(request->out, "Content-Length: %d\r\nAccept-Ranges: bytes\r\n", end - start + 1);
+		if(etag[0]){
+			FCGX_FPrintF(request->out, "ETag: %s\r\nLast-Modified: %s\r\n", etag, last_modified);
+		}
+		FCGX_PutS("\r\n", request->out);
+
+		bool send_body = getServerVar("REQUEST_METHOD") != "HEAD";
+		if(file){
+			if(send_body){
+				FCGX_PutStr((const char*)file->data + start, end - start + 1, request->out);
+			}
+			releaseStaticFile(this, file);
+			return true;
+		}
+		if(send_body && end >= start){
+			const int BUF_SIZE = 1024*256;
+			int len = end - start + 1;
+			void * buf = malloc(BUF_SIZE < len ? BUF_SIZE : len OS_DBG_FILEPOS);
+			seekFile(f, start, SEEK_SET);
+			for(int i = 0; i < len; i += BUF_SIZE){
+				int cur_len = BUF_SIZE < len - i ? BUF_SIZE : len - i;
+				readFile(buf, cur_len, f);
+				FCGX_PutStr((const char*)buf, cur_len, request->out);
+			}
+			free(buf);
+		}
+		closeFile(f);
+		return true;
+	}
+
 	const OS_CHAR * getContentType(const OS_CHAR * ext)
 	{
 		if(ext[0] == OS_TEXT('.')){
@@ -813,6 +1612,7 @@ int main(int argc, char * argv[])
 {
 #endif
 	initStartTime();
+	removeOldCompiledFiles();
 
 	printf("ObjectScript FastCGI Process Manager %s\n", OS_FCGI_VERSION);
 	printf("%s\n", OS_COPYRIGHT);
@@ -870,6 +1670,39 @@ int main(int argc, char * argv[])
 		threads			  =	(os->getProperty(-1, "threads"),		os->popInt(DEF_NUM_THREADS));
 		OS::String listen = (os->getProperty(-1, "listen"),			os->popString(":9000"));
 		post_max_size	  =	(os->getProperty(-1, "post_max_size"),	os->popInt(1024*1024*8));
+		upload_memory_size = (os->getProperty(-1, "upload_memory_size"), os->popInt(0));
+		OS::String upload_path = (os->getProperty(-1, "upload_temp_path"), os->popString(upload_temp_path));
+		if(upload_path.getDataSize() >= (int)sizeof(upload_temp_path)){
+			printf("Error: upload_temp_path is longer than %d chars: %s\n", (int)sizeof(upload_temp_path)-1, upload_path.toChar());
+			usage();
+		}
+		strcpy(upload_temp_path, upload_path.toChar());
+		setCacheExtensionMaxSize((os->getProperty(-1, "cache_size"), os->popInt(1024*1024*64)));
+		bool watch = false;
+		os->getProperty(-1, "watch");
+		if(os->isArray()){
+#ifdef OS_FCGI_WATCH_SUPPORTED
+			watch = initWatcher(os);
+#else
+			printf("watch is not supported, file_cache_interval is used\n");
+#endif
+		}
+		os->pop();
+		// changed files are reported by watcher so cached stats don't need to be checked again
+		setFileCacheInterval((os->getProperty(-1, "file_cache_interval"), os->popInt(watch ? 0 : 1)));
+		static_cache_size = (os->getProperty(-1, "static_cache_size"), os->popInt(1024*1024*64));
+		gzip_level = (os->getProperty(-1, "gzip_level"), os->popInt(0));
+		gzip_min_size = (os->getProperty(-1, "gzip_min_size"), os->popInt(1024));
+		OS::String bundle_filename = (os->getProperty(-1, "bundle"),	os->popString(""));
+		OS::String bundle_root = (os->getProperty(-1, "bundle_root"),	os->popString(""));
+		if(!bundle_filename.isEmpty()){
+			bundle = OS::Bundle::load(os, bundle_filename, bundle_root.isEmpty() ? NULL : bundle_root.toChar());
+			if(!bundle){
+				printf("Error: bundle %s could not be loaded\n", bundle_filename.toChar());
+				usage();
+			}
+			printf("bundle: %s, root: %s, files: %d\n", bundle_filename.toChar(), bundle->getRootPath(), bundle->getCount());
+		}
 		os->release();
 
 		int listen_queue_backlog = 400;
@@ -896,6 +1729,9 @@ int main(int argc, char * argv[])
 	}
 	printf("post_max_size: %.1f Mb\n", (float)post_max_size / (1024.0f * 1024.0f));
 	demonize();
+#ifdef OS_FCGI_WATCH_SUPPORTED
+	startWatcher();
+#endif
 	
 	pthread_t id[MAX_THREAD_COUNT];
 	for(int i = 1; i < threads; i++){
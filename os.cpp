@@ -34,6 +34,7 @@
 #include "ext-base64/os-base64.h"
 #include "ext-datetime/os-datetime.h"
 #include "ext-json/os-json.h"
+#include "ext-worker/os-worker.h"
 
 #ifndef OS_CURL_DISABLED
 #include "ext-curl/os-curl.h"
@@ -69,6 +70,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <dirent.h>
 #endif // _MSC_VER
 
 #include <cstdio>
@@ -85,8 +87,10 @@ using namespace ObjectScript;
 #define has_E		3	/* -E */
 #define has_cache	4	/* -cache */
 #define has_debug	5	/* -debug */
+#define has_bundle	6	/* -bundle, index of its argument */
+#define has_make_bundle	7	/* -make-bundle, index of its first argument */
 
-#define NUM_HAS		6	/* number of 'has_*' */
+#define NUM_HAS		8	/* number of 'has_*' */
 
 #ifndef OS_PROMPT
 #define OS_PROMPT	"> "
@@ -111,6 +115,9 @@ char init_cache_path[128] =
 bool use_cache = false;
 time_t start_time = 0;
 
+// bundle is shared by main OS & workers
+OS::Bundle * bundle = NULL;
+
 void createCacheDir()
 {
 #ifdef _MSC_VER
@@ -175,6 +182,9 @@ protected:
 			initBase64Extension(this);
 			initDateTimeExtension(this);
 			initJsonExtension(this);
+			initWorkerExtension(this, createWorkerOS);
+
+			setBundle(bundle);
 
 #ifndef OS_CURL_DISABLED
 			initCurlExtension(this);
@@ -219,6 +229,11 @@ public:
 		header_sent = false;
 	}
 
+	static OS * createWorkerOS()
+	{
+		return OS::create(new ConsoleOS());
+	}
+
 	void initSettings()
 	{
 		OS::initSettings();
@@ -410,6 +425,8 @@ public:
 			"  -E       ignore environment variables\n"
 			"  -cache   use cache of compiled files\n"
 			"  -debug   create debug human readable text files\n"
+			"  -bundle file  require scripts from bundle file\n"
+			"  -make-bundle file dir  compile scripts of dir to bundle file\n"
 			"  --       stop handling options\n"
 			"  -        stop handling options and execute stdin\n"
 			"examples:\n"
@@ -479,6 +496,21 @@ public:
 				args[has_debug] = 1;
 				continue;
 			}
+			if(strcmp(argv[i]+1, "bundle") == 0){
+				if(i+1 >= argc){
+					return -i;
+				}
+				args[has_bundle] = ++i;
+				continue;
+			}
+			if(strcmp(argv[i]+1, "make-bundle") == 0){
+				if(i+2 >= argc){
+					return -i;
+				}
+				args[has_make_bundle] = i+1;
+				i += 2;
+				continue;
+			}
 			switch (argv[i][1]) {  /* option */
 			case '-':
 				noextrachars(argv[i]);
@@ -544,6 +576,14 @@ public:
 	{
 		for(int i = 1; i < n; i++){
 			OS_ASSERT(argv[i][0] == '-');
+			if(strcmp(argv[i]+1, "bundle") == 0){
+				i++;
+				continue;
+			}
+			if(strcmp(argv[i]+1, "make-bundle") == 0){
+				i += 2;
+				continue;
+			}
 			switch(argv[i][1]){  /* option */
 			case 'e': 
 				{
@@ -568,6 +608,64 @@ public:
 		return 1;
 	}
 
+	// stack: array of filenames relative to root_path
+	void collectBundleFiles(const String& root_path, const String& dir)
+	{
+		String path = dir.isEmpty() ? root_path : root_path + OS_PATH_SEPARATOR + dir;
+#ifdef _MSC_VER
+		WIN32_FIND_DATAA find_data;
+		HANDLE h = FindFirstFileA(path + OS_TEXT("\\*"), &find_data);
+		if(h == INVALID_HANDLE_VALUE){
+			return;
+		}
+		do{
+			const char * name = find_data.cFileName;
+			bool is_dir = (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+		DIR * d = opendir(path);
+		if(!d){
+			return;
+		}
+		for(struct dirent * e; (e = readdir(d)) != NULL;){
+			const char * name = e->d_name;
+			struct stat st;
+			bool is_dir = stat(path + OS_PATH_SEPARATOR + name, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+			if(name[0] != '.'){
+				String filename = dir.isEmpty() ? String(this, name) : dir + OS_PATH_SEPARATOR + name;
+				if(is_dir){
+					collectBundleFiles(root_path, filename);
+				}else{
+					String ext = getFilenameExt(filename);
+					if(ext == OS_EXT_SOURCECODE || ext == OS_EXT_TEMPLATE){
+						pushStackValue();
+						pushString(filename);
+						addProperty();
+					}
+				}
+			}
+#ifdef _MSC_VER
+		}while(FindNextFileA(h, &find_data));
+		FindClose(h);
+#else
+		}
+		closedir(d);
+#endif
+	}
+
+	bool makeBundle(const String& bundle_filename, const String& root_path)
+	{
+		newArray();
+		collectBundleFiles(root_path, String(this));
+		int count = getLen();
+		if(!buildBundle(bundle_filename, root_path)){
+			handleException();
+			return false;
+		}
+		printf("%s: %d files\n", bundle_filename.toChar(), count);
+		return true;
+	}
+
 	bool inComplete()
 	{
 		OS::String str = toString(-1);
@@ -728,6 +826,19 @@ public:
 			createCacheDir();
 			setSetting(OS_SETTING_CREATE_TEXT_OPCODES, true);
 		}
+		if(args[has_make_bundle]){
+			int i = args[has_make_bundle];
+			makeBundle(String(this, argv[i]), String(this, argv[i+1]));
+			return;
+		}
+		if(args[has_bundle]){
+			bundle = Bundle::load(this, argv[args[has_bundle]]);
+			if(!bundle){
+				printf("error load bundle %s\n", argv[args[has_bundle]]);
+				return;
+			}
+			setBundle(bundle);
+		}
 		
 		getGlobal("process");
 		pushString("argv");
@@ -904,6 +1015,7 @@ int main(int argc, char * argv[])
 	// os->eval("print json.decode(json.encode({a=2, 10=\"qwerty\"}))");
 	os->processRequest(argc, argv);
     os->release();
+	delete bundle;
 
 	return 0;
 }
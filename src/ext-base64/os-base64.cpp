@@ -6,8 +6,25 @@
 #include "../objectscript.h"
 #include "../os-binder.h"
 
-#include "cencode.h"
-#include "cdecode.h"
+#if !defined(OS_BASE64_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define OS_BASE64_SIMD
+#define OS_BASE64_SSSE3 __attribute__((target("ssse3")))
+#define OS_BASE64_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif !defined(OS_BASE64_NO_SIMD) && defined(_MSC_VER) && _MSC_VER >= 1700 && (defined(_M_X64) || defined(_M_IX86))
+#define OS_BASE64_SIMD
+#define OS_BASE64_SSSE3
+#define OS_BASE64_AVX2
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+// output lines have the same length as libb64 used to produce
+#define BASE64_CHARS_PER_LINE 72
+#define BASE64_BYTES_PER_LINE (BASE64_CHARS_PER_LINE/4*3)
+// SIMD stores could write a bit past the end of result
+#define BASE64_OUT_SLACK 32
 
 namespace ObjectScript {
 
@@ -15,6 +32,308 @@ class Base64OS: public OS
 {
 public:
 
+	enum {
+		SIMD_NONE,
+		SIMD_SSSE3,
+		SIMD_AVX2
+	};
+
+	static int getSimdLevel()
+	{
+#ifdef OS_BASE64_SIMD
+		// the same value is stored by every thread
+		static volatile int level = -1;
+		if(level < 0){
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			int max_leaf = info[0];
+			__cpuid(info, 1);
+			bool ssse3 = (info[2] & (1 << 9)) != 0;
+			bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+			bool avx2 = false;
+			if(max_leaf >= 7){
+				__cpuidex(info, 7, 0);
+				avx2 = os_avx && (info[1] & (1 << 5)) != 0;
+			}
+#else
+			__builtin_cpu_init();
+			bool ssse3 = __builtin_cpu_supports("ssse3") != 0;
+			bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+			level = avx2 ? SIMD_AVX2 : (ssse3 ? SIMD_SSSE3 : SIMD_NONE);
+		}
+		return level;
+#else
+		return SIMD_NONE;
+#endif
+	}
+
+	static const char * getEncodeTable()
+	{
+		return "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	}
+
+	// -1 - char is skipped by decoder, padding and line breaks are skipped too
+	static const signed char * getDecodeTable()
+	{
+		static const signed char table[256] = {
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63,
+		52,53,54,55,56,57,58,59,60,61,-1,-1,-1,-1,-1,-1,
+		-1,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,
+		15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1,
+		-1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,
+		41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+		};
+		return table;
+	}
+
+#ifdef OS_BASE64_SIMD
+	// see "Base64 encoding with SIMD instructions" by Wojciech Mula
+	static OS_BASE64_SSSE3 __m128i encodeIndicesToChars(__m128i indices)
+	{
+		__m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+		__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+		result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+		const __m128i shift_lut = _mm_setr_epi8(
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+			'/' - 63, 'A', 0, 0);
+		result = _mm_shuffle_epi8(shift_lut, result);
+		return _mm_add_epi8(result, indices);
+	}
+
+	// encodes 12 bytes blocks, reads 16 bytes, returns number of encoded bytes
+	static OS_BASE64_SSSE3 int encodeSsse3(const OS_BYTE * in, int len, int avail, char * out)
+	{
+		const __m128i shuf = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+		int i = 0;
+		for(; i + 12 <= len && i + 16 <= avail; i += 12, out += 16){
+			__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + i)), shuf);
+			__m128i t0 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+			__m128i t1 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+			_mm_storeu_si128((__m128i*)out, encodeIndicesToChars(_mm_or_si128(t0, t1)));
+		}
+		return i;
+	}
+
+	// decodes 16 chars blocks to 12 bytes, writes 16 bytes,
+	// stops at block with char to be skipped, returns number of decoded chars
+	static OS_BASE64_SSSE3 int decodeSsse3(const OS_BYTE * in, int len, OS_BYTE * out)
+	{
+		int i = 0;
+		for(; i + 16 <= len; i += 16, out += 12){
+			__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+			__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+			__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+			__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+			__m128i plus = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));
+			__m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+			__m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+			if(_mm_movemask_epi8(valid) != 0xffff){
+				break;
+			}
+			__m128i shift = _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')), _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+				_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+					_mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(62 - '+')), _mm_and_si128(slash, _mm_set1_epi8(63 - '/')))));
+			v = _mm_add_epi8(v, shift);
+			v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+			v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+			v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+			_mm_storeu_si128((__m128i*)out, v);
+		}
+		return i;
+	}
+
+	static OS_BASE64_AVX2 __m256i encodeIndicesToCharsAvx2(__m256i indices)
+	{
+		__m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+		__m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+		result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+		const __m256i shift_lut = _mm256_setr_epi8(
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+			'/' - 63, 'A', 0, 0,
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+			'/' - 63, 'A', 0, 0);
+		result = _mm256_shuffle_epi8(shift_lut, result);
+		return _mm256_add_epi8(result, indices);
+	}
+
+	// encodes 24 bytes blocks, reads 28 bytes, returns number of encoded bytes
+	static OS_BASE64_AVX2 int encodeAvx2(const OS_BYTE * in, int len, int avail, char * out)
+	{
+		const __m256i shuf = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+			1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+		int i = 0;
+		for(; i + 24 <= len && i + 28 <= avail; i += 24, out += 32){
+			__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + i))),
+				_mm_loadu_si128((const __m128i*)(in + i + 12)), 1);
+			v = _mm256_shuffle_epi8(v, shuf);
+			__m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+			__m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+			_mm256_storeu_si256((__m256i*)out, encodeIndicesToCharsAvx2(_mm256_or_si256(t0, t1)));
+		}
+		return i;
+	}
+
+	// decodes 32 chars blocks to 24 bytes, writes 32 bytes,
+	// stops at block with char to be skipped, returns number of decoded chars
+	static OS_BASE64_AVX2 int decodeAvx2(const OS_BYTE * in, int len, OS_BYTE * out)
+	{
+		int i = 0;
+		for(; i + 32 <= len; i += 32, out += 24){
+			__m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+			__m256i upper = _mm256_andnot_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('Z')), _mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)));
+			__m256i lower = _mm256_andnot_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('z')), _mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)));
+			__m256i digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('9')), _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)));
+			__m256i plus = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('+'));
+			__m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+			__m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(_mm256_or_si256(digit, plus), slash));
+			if(_mm256_movemask_epi8(valid) != -1){
+				break;
+			}
+			__m256i shift = _mm256_or_si256(
+				_mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-'A')), _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a'))),
+				_mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')),
+					_mm256_or_si256(_mm256_and_si256(plus, _mm256_set1_epi8(62 - '+')), _mm256_and_si256(slash, _mm256_set1_epi8(63 - '/')))));
+			v = _mm256_add_epi8(v, shift);
+			v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+			v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+			v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+				2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+			v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+			_mm256_storeu_si256((__m256i*)out, v);
+		}
+		return i;
+	}
+#endif // OS_BASE64_SIMD
+
+	// encodes len bytes (multiple of 3), avail bytes could be read from in
+	static int encodeGroups(const OS_BYTE * in, int len, int avail, char * out, int simd)
+	{
+		const char * table = getEncodeTable();
+		char * start = out;
+		int i = 0;
+#ifdef OS_BASE64_SIMD
+		if(simd == SIMD_AVX2){
+			i = encodeAvx2(in, len, avail, out);
+			out += i / 3 * 4;
+		}
+		if(simd != SIMD_NONE){
+			int n = encodeSsse3(in + i, len - i, avail - i, out);
+			i += n;
+			out += n / 3 * 4;
+		}
+#endif
+		for(; i < len; i += 3, out += 4){
+			int v = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+			out[0] = table[(v >> 18) & 0x3f];
+			out[1] = table[(v >> 12) & 0x3f];
+			out[2] = table[(v >> 6) & 0x3f];
+			out[3] = table[v & 0x3f];
+		}
+		return (int)(out - start);
+	}
+
+	// result is compatible with libb64 used before: lines of 72 chars and line break at the end
+	static int encodeBuffer(const OS_BYTE * in, int len, char * out, int simd)
+	{
+		char * start = out;
+		int i = 0;
+		for(; i + BASE64_BYTES_PER_LINE <= len; i += BASE64_BYTES_PER_LINE){
+			out += encodeGroups(in + i, BASE64_BYTES_PER_LINE, len - i, out, simd);
+			*out++ = '\n';
+		}
+		int tail = (len - i) % 3;
+		out += encodeGroups(in + i, len - i - tail, len - i, out, simd);
+		i = len - tail;
+		const char * table = getEncodeTable();
+		if(tail == 1){
+			out[0] = table[in[i] >> 2];
+			out[1] = table[(in[i] & 0x3) << 4];
+			out[2] = out[3] = '=';
+			out += 4;
+		}else if(tail == 2){
+			out[0] = table[in[i] >> 2];
+			out[1] = table[((in[i] & 0x3) << 4) | (in[i+1] >> 4)];
+			out[2] = table[(in[i+1] & 0xf) << 2];
+			out[3] = '=';
+			out += 4;
+		}
+		*out++ = '\n';
+		return (int)(out - start);
+	}
+
+	// chars out of alphabet are skipped, incomplete group is decoded as far as possible
+	static int decodeBuffer(const OS_BYTE * in, int len, OS_BYTE * out, int simd)
+	{
+		const signed char * table = getDecodeTable();
+		OS_BYTE * start = out;
+		const OS_BYTE * end = in + len;
+		int acc = 0, count = 0;
+		while(in < end){
+			if(count == 0){
+#ifdef OS_BASE64_SIMD
+				if(simd == SIMD_AVX2){
+					int n = decodeAvx2(in, (int)(end - in), out);
+					in += n;
+					out += n / 4 * 3;
+				}
+				if(simd != SIMD_NONE){
+					int n = decodeSsse3(in, (int)(end - in), out);
+					in += n;
+					out += n / 4 * 3;
+				}
+#endif
+				for(; end - in >= 4; in += 4, out += 3){
+					int a = table[in[0]], b = table[in[1]], c = table[in[2]], d = table[in[3]];
+					if((a | b | c | d) < 0){
+						break;
+					}
+					int v = (a << 18) | (b << 12) | (c << 6) | d;
+					out[0] = (OS_BYTE)(v >> 16);
+					out[1] = (OS_BYTE)(v >> 8);
+					out[2] = (OS_BYTE)v;
+				}
+				if(in >= end){
+					break;
+				}
+			}
+			int v = table[*in++];
+			if(v < 0){
+				continue;
+			}
+			acc = (acc << 6) | v;
+			if(++count == 4){
+				out[0] = (OS_BYTE)(acc >> 16);
+				out[1] = (OS_BYTE)(acc >> 8);
+				out[2] = (OS_BYTE)acc;
+				out += 3;
+				acc = count = 0;
+			}
+		}
+		if(count == 2){
+			*out++ = (OS_BYTE)(acc >> 4);
+		}else if(count == 3){
+			*out++ = (OS_BYTE)(acc >> 10);
+			*out++ = (OS_BYTE)(acc >> 2);
+		}
+		return (int)(out - start);
+	}
+
 	static int encode(OS * os, int params, int, int, void * user_param)
 	{
 		if(params > 0){
@@ -22,16 +341,10 @@ public:
 			int size = str.getDataSize();
 			
 			Core::Buffer buf(os);
-			buf.reserveCapacity(size*2 + 7);
-			
-			base64_encodestate state;
-			base64_init_encodestate(&state);
-			int r1 = base64_encode_block(str.toChar(), size, (char*)buf.buffer.buf, &state);
-			int r2 = base64_encode_blockend((char*)buf.buffer.buf + r1, &state);
-			base64_init_encodestate(&state);
-			buf.buffer.count = r1 + r2;    
-
-			os->pushString(buf.toString());
+			buf.reserveCapacity((size + 2) / 3 * 4 + size / BASE64_BYTES_PER_LINE + 1 + BASE64_OUT_SLACK);
+			buf.buffer.count = encodeBuffer((const OS_BYTE*)str.toChar(), size, (char*)buf.buffer.buf, getSimdLevel());
+
+			os->pushString(buf);
 			return 1;
 		}
 		return 0;
@@ -44,14 +357,10 @@ public:
 			int size = str.getDataSize();
 			
 			Core::Buffer buf(os);
-			buf.reserveCapacity(size + 7);
-			
-			base64_decodestate state;
-			base64_init_decodestate(&state);
-			int r1 = base64_decode_block(str.toChar(), size, (char*)buf.buffer.buf, &state);
-			buf.buffer.count = r1;    
+			buf.reserveCapacity(size / 4 * 3 + 3 + BASE64_OUT_SLACK);
+			buf.buffer.count = decodeBuffer((const OS_BYTE*)str.toChar(), size, buf.buffer.buf, getSimdLevel());
 
-			os->pushString(buf.toString());
+			os->pushString(buf);
 			return 1;
 		}
 		return 0;
@@ -0,0 +1,1131 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "os-cache.h"
+#include "../objectscript.h"
+#include "../os-binder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace ObjectScript {
+
+#define OS_CACHE_STRIPES 16
+#define OS_CACHE_DEF_MAX_SIZE (1024*1024*64)
+
+/*
+	Frozen value graph is copied once into single malloc'ed region which is
+	never modified after that, so OS instances of any thread read it without
+	locks and without restoring. Containers and strings are referenced by
+	offset from the region start, so the region keeps shared values & cycles.
+	The region is released by atomic reference counter when cache and all
+	native views of OS instances drop it.
+*/
+struct SharedSlot
+{
+	int type; // OS_VALUE_TYPE_NULL, BOOL, NUMBER, STRING, ARRAY or OBJECT
+	int size; // bytes of string, items of array or properties of object
+	union
+	{
+		OS_NUMBER number;
+		int offs; // string bytes, array slots or object properties
+		bool boolean;
+	};
+};
+
+struct SharedProp
+{
+	SharedSlot key;
+	SharedSlot value;
+	OS_U32 hash;
+	int next; // next property of the same hash head, -1 - end
+};
+
+struct SharedRegion
+{
+#ifdef _MSC_VER
+	volatile LONG ref_count;
+
+	void retain(){ InterlockedIncrement(&ref_count); }
+	void release(){ if(InterlockedDecrement(&ref_count) == 0) ::free(this); }
+#else
+	volatile int ref_count;
+
+	void retain(){ __sync_add_and_fetch(&ref_count, 1); }
+	void release(){ if(__sync_sub_and_fetch(&ref_count, 1) == 0) ::free(this); }
+#endif
+	int size;
+	SharedSlot root;
+
+	const char * getBytes(const SharedSlot& slot){ return (const char*)this + slot.offs; }
+	const SharedSlot * getItems(const SharedSlot& slot){ return (const SharedSlot*)((const char*)this + slot.offs); }
+	const SharedProp * getProps(const SharedSlot& slot){ return (const SharedProp*)((const char*)this + slot.offs); }
+	// hash heads are placed after properties of object
+	const int * getHeads(const SharedSlot& slot){ return (const int*)(getProps(slot) + slot.size); }
+
+	static int getHeadMask(int count)
+	{
+		int size = 4;
+		while(size < count){
+			size *= 2;
+		}
+		return size - 1;
+	}
+};
+
+/*
+	Items are spread by key hash between stripes, every stripe has own lock,
+	hash table and LRU list, so workers don't wait for each other while they
+	use different keys. Values are kept serialized and restored into OS
+	instance of the caller so they don't depend on any OS instance, frozen
+	values are kept as shared region instead.
+*/
+struct CacheItem
+{
+	CacheItem * hash_next;
+	CacheItem * lru_prev; // more recently used
+	CacheItem * lru_next;
+	OS_U32 hash;
+	time_t expire; // 0 - never
+	int key_size;
+	int data_size;
+	int alloc_size;
+	bool is_number;
+	OS_NUMBER number;
+	SharedRegion * region; // retained by item, NULL - data is serialized value
+
+	char * getKey(){ return (char*)(this + 1); }
+	char * getData(){ return getKey() + key_size; }
+
+	static void destroy(CacheItem * item)
+	{
+		if(item->region){
+			item->region->release();
+		}
+		::free(item);
+	}
+};
+
+class CacheMutex
+{
+#ifdef _MSC_VER
+	CRITICAL_SECTION cs;
+
+public:
+
+	CacheMutex(){ InitializeCriticalSection(&cs); }
+	~CacheMutex(){ DeleteCriticalSection(&cs); }
+
+	void lock(){ EnterCriticalSection(&cs); }
+	void unlock(){ LeaveCriticalSection(&cs); }
+#else
+	pthread_mutex_t mutex;
+
+public:
+
+	CacheMutex(){ pthread_mutex_init(&mutex, NULL); }
+	~CacheMutex(){ pthread_mutex_destroy(&mutex); }
+
+	void lock(){ pthread_mutex_lock(&mutex); }
+	void unlock(){ pthread_mutex_unlock(&mutex); }
+#endif
+};
+
+struct CacheStripe
+{
+	CacheMutex mutex;
+	CacheItem ** heads;
+	int head_mask;
+	int count;
+	int used_bytes;
+	CacheItem * lru_first, * lru_last;
+
+	CacheStripe()
+	{
+		heads = NULL;
+		head_mask = 0;
+		count = used_bytes = 0;
+		lru_first = lru_last = NULL;
+	}
+
+	~CacheStripe()
+	{
+		clear();
+		::free(heads);
+	}
+
+	CacheItem * find(const char * key, int key_size, OS_U32 hash)
+	{
+		if(!heads){
+			return NULL;
+		}
+		CacheItem * item = heads[hash & head_mask];
+		for(; item; item = item->hash_next){
+			if(item->hash == hash && item->key_size == key_size && memcmp(item->getKey(), key, key_size) == 0){
+				return item;
+			}
+		}
+		return NULL;
+	}
+
+	void unlinkLRU(CacheItem * item)
+	{
+		if(item->lru_prev) item->lru_prev->lru_next = item->lru_next; else lru_first = item->lru_next;
+		if(item->lru_next) item->lru_next->lru_prev = item->lru_prev; else lru_last = item->lru_prev;
+		item->lru_prev = item->lru_next = NULL;
+	}
+
+	void touch(CacheItem * item)
+	{
+		if(lru_first != item){
+			unlinkLRU(item);
+			item->lru_next = lru_first;
+			if(lru_first) lru_first->lru_prev = item; else lru_last = item;
+			lru_first = item;
+		}
+	}
+
+	void remove(CacheItem * item)
+	{
+		CacheItem ** link = &heads[item->hash & head_mask];
+		for(; *link != item; link = &(*link)->hash_next){
+			OS_ASSERT(*link);
+		}
+		*link = item->hash_next;
+		unlinkLRU(item);
+		count--;
+		used_bytes -= item->alloc_size;
+		CacheItem::destroy(item);
+	}
+
+	void insert(CacheItem * item)
+	{
+		if(count >= head_mask){
+			int new_size = heads ? (head_mask+1) * 2 : 64;
+			CacheItem ** new_heads = (CacheItem**)::calloc(new_size, sizeof(CacheItem*));
+			for(int i = 0; heads && i <= head_mask; i++){
+				for(CacheItem * cur = heads[i], * next; cur; cur = next){
+					next = cur->hash_next;
+					cur->hash_next = new_heads[cur->hash & (new_size-1)];
+					new_heads[cur->hash & (new_size-1)] = cur;
+				}
+			}
+			::free(heads);
+			heads = new_heads;
+			head_mask = new_size-1;
+		}
+		item->hash_next = heads[item->hash & head_mask];
+		heads[item->hash & head_mask] = item;
+		item->lru_prev = NULL;
+		item->lru_next = lru_first;
+		if(lru_first) lru_first->lru_prev = item; else lru_last = item;
+		lru_first = item;
+		count++;
+		used_bytes += item->alloc_size;
+	}
+
+	void clear()
+	{
+		while(lru_first){
+			remove(lru_first);
+		}
+	}
+};
+
+struct Cache
+{
+	CacheStripe stripes[OS_CACHE_STRIPES];
+	int max_size;
+
+	Cache(){ max_size = OS_CACHE_DEF_MAX_SIZE; }
+};
+
+static Cache cache;
+
+// stats are keyed by filename and resolved paths by requesting path and filename,
+// any file change could affect resolved paths so they are stored separately to be dropped at once
+static Cache stat_cache;
+static Cache resolve_cache;
+static int file_cache_interval = 1;
+
+void setCacheExtensionMaxSize(int bytes)
+{
+	cache.max_size = bytes > 0 ? bytes : OS_CACHE_DEF_MAX_SIZE;
+}
+
+// native view of container of shared region, it's frozen in OS instance
+struct SharedValue
+{
+	SharedRegion * region;
+	SharedSlot slot;
+	int pos; // next item of iterator
+
+	SharedValue(SharedRegion * p_region, const SharedSlot& p_slot)
+	{
+		region = p_region;
+		region->retain();
+		slot = p_slot;
+		pos = 0;
+	}
+
+	~SharedValue()
+	{
+		region->release();
+	}
+};
+
+template <> struct CtypeName<SharedValue>{ static const OS_CHAR * getName(){ return OS_TEXT("SharedValue"); } };
+template <> struct CtypeValue<SharedValue*>: public CtypeUserClass<SharedValue*>{};
+template <> struct UserDataDestructor<SharedValue>
+{
+	static void dtor(ObjectScript::OS * os, void * data, void * user_param)
+	{
+		SharedValue * value = (SharedValue*)data;
+		value->~SharedValue();
+		os->free(value);
+	}
+};
+
+static time_t getFileCacheExpire();
+static CacheItem * findFileCacheItem(Cache& cache, const char * key, int key_size, OS_U32 hash);
+
+class CacheOS: public OS
+{
+public:
+
+	struct Locker
+	{
+		CacheStripe * stripe;
+
+		Locker(CacheStripe * p_stripe){ stripe = p_stripe; stripe->mutex.lock(); }
+		~Locker(){ stripe->mutex.unlock(); }
+	};
+
+	static OS_U32 getHash(const char * key, int size)
+	{
+		OS_U32 hash = 2166136261u;
+		for(int i = 0; i < size; i++){
+			hash = (hash ^ (OS_BYTE)key[i]) * 16777619u;
+		}
+		return hash;
+	}
+
+	static CacheStripe * getStripe(Cache& cache, OS_U32 hash)
+	{
+		return cache.stripes + (hash >> 28) % OS_CACHE_STRIPES;
+	}
+
+	static bool isExpired(CacheItem * item, time_t now)
+	{
+		return item->expire && item->expire <= now;
+	}
+
+	static time_t getExpire(OS * os, int offs, int params)
+	{
+		int ttl = params > offs ? os->toInt(-params+offs) : 0;
+		return ttl > 0 ? time(NULL) + ttl : 0;
+	}
+
+	static CacheItem * newItem(const char * key, int key_size, const void * data, int data_size, time_t expire)
+	{
+		int alloc_size = (int)sizeof(CacheItem) + key_size + data_size;
+		CacheItem * item = (CacheItem*)::malloc(alloc_size);
+		if(!item){
+			return NULL;
+		}
+		item->hash = getHash(key, key_size);
+		item->expire = expire;
+		item->key_size = key_size;
+		item->data_size = data_size;
+		item->alloc_size = alloc_size;
+		item->is_number = false;
+		item->number = 0;
+		item->region = NULL;
+		memcpy(item->getKey(), key, key_size);
+		if(data_size > 0){
+			memcpy(item->getData(), data, data_size);
+		}
+		return item;
+	}
+
+	// replaces item with the same key, the least recently used items are removed if stripe is full
+	static bool storeItem(Cache& cache, CacheItem * item)
+	{
+		CacheStripe * stripe = getStripe(cache, item->hash);
+		Locker locker(stripe);
+		return insertItem(cache, stripe, item);
+	}
+
+	// the function should be called with locked stripe of the item
+	static bool insertItem(Cache& cache, CacheStripe * stripe, CacheItem * item)
+	{
+		int max_size = cache.max_size / OS_CACHE_STRIPES;
+		if(item->alloc_size > max_size){
+			CacheItem::destroy(item);
+			return false;
+		}
+		CacheItem * old = stripe->find(item->getKey(), item->key_size, item->hash);
+		if(old){
+			stripe->remove(old);
+		}
+		while(stripe->lru_last && stripe->used_bytes + item->alloc_size > max_size){
+			stripe->remove(stripe->lru_last);
+		}
+		stripe->insert(item);
+		return true;
+	}
+
+	// copies value graph into new shared region, values are not changed while building because they are frozen
+	struct SharedRegionBuilder
+	{
+		struct Ref
+		{
+			Core::GCValue * value;
+			SharedSlot slot;
+		};
+
+		Core * core;
+		char * buf;
+		int size;
+		int capacity;
+		Ref * refs; // open addressing hash by value pointer
+		int refs_mask;
+		int num_refs;
+		Ref * pending; // containers allocated but not filled yet
+		int num_pending;
+		int pending_capacity;
+
+		SharedRegionBuilder(Core * p_core)
+		{
+			core = p_core;
+			buf = NULL;
+			size = capacity = 0;
+			refs = NULL;
+			refs_mask = -1;
+			num_refs = 0;
+			pending = NULL;
+			num_pending = pending_capacity = 0;
+		}
+
+		~SharedRegionBuilder()
+		{
+			::free(buf);
+			::free(refs);
+			::free(pending);
+		}
+
+		// returns offset of new block, blocks are 8 bytes aligned
+		int alloc(int bytes)
+		{
+			int offs = (size + 7) & ~7;
+			if(bytes < 0 || offs > 0x7fff0000 - bytes){
+				return -1;
+			}
+			if(offs + bytes > capacity){
+				int new_capacity = capacity ? capacity : 4096;
+				while(new_capacity < offs + bytes){
+					new_capacity = new_capacity < 0x40000000 ? new_capacity * 2 : 0x7fff0000;
+				}
+				char * new_buf = (char*)::realloc(buf, new_capacity);
+				if(!new_buf){
+					return -1;
+				}
+				buf = new_buf;
+				capacity = new_capacity;
+			}
+			size = offs + bytes;
+			return offs;
+		}
+
+		bool findRef(Core::GCValue * value, SharedSlot& slot)
+		{
+			if(!refs){
+				return false;
+			}
+			for(int i = OS_PTR_SLOT(value, refs_mask); refs[i].value; i = (i + 1) & refs_mask){
+				if(refs[i].value == value){
+					slot = refs[i].slot;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool addRef(Core::GCValue * value, const SharedSlot& slot)
+		{
+			if(num_refs*2 >= refs_mask){
+				int new_size = refs ? (refs_mask+1) * 2 : 256;
+				Ref * new_refs = (Ref*)::calloc(new_size, sizeof(Ref));
+				if(!new_refs){
+					return false;
+				}
+				for(int i = 0; refs && i <= refs_mask; i++){
+					if(refs[i].value){
+						int j = OS_PTR_SLOT(refs[i].value, new_size-1);
+						while(new_refs[j].value){
+							j = (j + 1) & (new_size-1);
+						}
+						new_refs[j] = refs[i];
+					}
+				}
+				::free(refs);
+				refs = new_refs;
+				refs_mask = new_size-1;
+			}
+			int i = OS_PTR_SLOT(value, refs_mask);
+			while(refs[i].value){
+				i = (i + 1) & refs_mask;
+			}
+			refs[i].value = value;
+			refs[i].slot = slot;
+			num_refs++;
+			return true;
+		}
+
+		bool addPending(Core::GCValue * value, const SharedSlot& slot)
+		{
+			if(num_pending == pending_capacity){
+				int new_capacity = pending_capacity ? pending_capacity * 2 : 64;
+				Ref * new_pending = (Ref*)::realloc(pending, new_capacity * sizeof(Ref));
+				if(!new_pending){
+					return false;
+				}
+				pending = new_pending;
+				pending_capacity = new_capacity;
+			}
+			pending[num_pending].value = value;
+			pending[num_pending].slot = slot;
+			num_pending++;
+			return true;
+		}
+
+		// functions, userdata and containers could not be found by key of other OS instance so they are skipped
+		static bool isSharedKey(const Core::Value& index)
+		{
+			switch(OS_VALUE_TYPE(index)){
+			case OS_VALUE_TYPE_BOOL:
+			case OS_VALUE_TYPE_NUMBER:
+			case OS_VALUE_TYPE_STRING:
+				return true;
+			}
+			return false;
+		}
+
+		bool makeSlot(const Core::Value& val, SharedSlot& slot)
+		{
+			memset(&slot, 0, sizeof(slot));
+			switch(OS_VALUE_TYPE(val)){
+			default:
+				// functions and userdata belong to OS instance
+				slot.type = OS_VALUE_TYPE_NULL;
+				return true;
+
+			case OS_VALUE_TYPE_BOOL:
+				slot.type = OS_VALUE_TYPE_BOOL;
+				slot.boolean = OS_VALUE_VARIANT(val).boolean ? true : false;
+				return true;
+
+			case OS_VALUE_TYPE_NUMBER:
+				slot.type = OS_VALUE_TYPE_NUMBER;
+				slot.number = OS_VALUE_NUMBER(val);
+				return true;
+
+			case OS_VALUE_TYPE_STRING:
+			case OS_VALUE_TYPE_ARRAY:
+			case OS_VALUE_TYPE_OBJECT:
+				break;
+			}
+			Core::GCValue * value = OS_VALUE_VARIANT(val).value;
+			if(findRef(value, slot)){
+				return true;
+			}
+			slot.type = OS_VALUE_TYPE(val);
+			if(slot.type == OS_VALUE_TYPE_STRING){
+				Core::GCStringValue * string = OS_VALUE_VARIANT(val).string;
+				slot.size = string->getDataSize();
+				if((slot.offs = alloc(slot.size + 1)) < 0){
+					return false;
+				}
+				memcpy(buf + slot.offs, string->toBytes(), slot.size);
+				buf[slot.offs + slot.size] = '\0';
+				return addRef(value, slot);
+			}
+			if(slot.type == OS_VALUE_TYPE_ARRAY){
+				slot.size = OS_VALUE_VARIANT(val).arr->values.count;
+				if(slot.size > 0x7fff0000 / (int)sizeof(SharedSlot) || (slot.offs = alloc(slot.size * sizeof(SharedSlot))) < 0){
+					return false;
+				}
+			}else{
+				for(Core::Property * prop = value->table ? value->table->first : NULL; prop; prop = prop->next){
+					slot.size += isSharedKey(prop->index);
+				}
+				int heads_size = SharedRegion::getHeadMask(slot.size) + 1;
+				if(slot.size > 0x7fff0000 / (int)(sizeof(SharedProp) + sizeof(int)*2)
+					|| (slot.offs = alloc(slot.size * sizeof(SharedProp) + heads_size * sizeof(int))) < 0)
+				{
+					return false;
+				}
+				memset(buf + slot.offs + slot.size * sizeof(SharedProp), 0xff, heads_size * sizeof(int));
+			}
+			return addRef(value, slot) && addPending(value, slot);
+		}
+
+		bool fill(Core::GCValue * value, const SharedSlot& slot)
+		{
+			if(slot.type == OS_VALUE_TYPE_ARRAY){
+				Core::GCArrayValue * arr = (Core::GCArrayValue*)value;
+				for(int i = 0; i < slot.size; i++){
+					SharedSlot item;
+					if(!makeSlot(arr->values[i], item)){
+						return false;
+					}
+					// buffer could be moved by makeSlot
+					((SharedSlot*)(buf + slot.offs))[i] = item;
+				}
+				return true;
+			}
+			int i = 0, head_mask = SharedRegion::getHeadMask(slot.size);
+			for(Core::Property * prop = value->table ? value->table->first : NULL; prop; prop = prop->next){
+				if(!isSharedKey(prop->index)){
+					continue;
+				}
+				SharedProp item;
+				if(!makeSlot(prop->index, item.key) || !makeSlot(prop->value, item.value)){
+					return false;
+				}
+				item.hash = getKeyHash(prop->index);
+				int * heads = (int*)(buf + slot.offs + slot.size * sizeof(SharedProp));
+				item.next = heads[item.hash & head_mask];
+				heads[item.hash & head_mask] = i;
+				((SharedProp*)(buf + slot.offs))[i++] = item;
+			}
+			OS_ASSERT(i == slot.size);
+			return true;
+		}
+
+		// returns retained region or NULL and sets exception
+		SharedRegion * build(const Core::Value& val)
+		{
+			SharedSlot root;
+			bool ok = alloc(sizeof(SharedRegion)) == 0 && makeSlot(val, root);
+			while(ok && num_pending > 0){
+				Ref cur = pending[--num_pending];
+				ok = fill(cur.value, cur.slot);
+			}
+			if(!ok){
+				core->allocator->setException(OS_TEXT("value is too big to share"));
+				return NULL;
+			}
+			SharedRegion * region = (SharedRegion*)buf;
+			buf = NULL;
+			region->ref_count = 1;
+			region->size = size;
+			region->root = root;
+			return region;
+		}
+	};
+
+	static OS_U32 getKeyHash(const Core::Value& index)
+	{
+		switch(OS_VALUE_TYPE(index)){
+		case OS_VALUE_TYPE_BOOL:
+			return OS_VALUE_VARIANT(index).boolean ? 1 : 0;
+
+		case OS_VALUE_TYPE_NUMBER:
+			{
+				OS_NUMBER number = OS_VALUE_NUMBER(index);
+				if(number == 0){
+					number = 0; // -0 is the same key
+				}
+				return getHash((const char*)&number, sizeof(number));
+			}
+
+		case OS_VALUE_TYPE_STRING:
+			return getHash((const char*)OS_VALUE_VARIANT(index).string->toBytes(), OS_VALUE_VARIANT(index).string->getDataSize());
+		}
+		return 0;
+	}
+
+	static bool isSameKey(SharedRegion * region, const SharedSlot& key, const Core::Value& index)
+	{
+		if(key.type != OS_VALUE_TYPE(index)){
+			return false;
+		}
+		switch(key.type){
+		case OS_VALUE_TYPE_BOOL:
+			return key.boolean == (OS_VALUE_VARIANT(index).boolean ? true : false);
+
+		case OS_VALUE_TYPE_NUMBER:
+			return key.number == OS_VALUE_NUMBER(index);
+
+		case OS_VALUE_TYPE_STRING:
+			return key.size == OS_VALUE_VARIANT(index).string->getDataSize()
+				&& memcmp(region->getBytes(key), OS_VALUE_VARIANT(index).string->toBytes(), key.size) == 0;
+		}
+		return false;
+	}
+
+	static bool findSharedItem(SharedValue * self, const Core::Value& index, SharedSlot& found)
+	{
+		const SharedSlot& slot = self->slot;
+		if(slot.type == OS_VALUE_TYPE_ARRAY){
+			if(OS_VALUE_TYPE(index) != OS_VALUE_TYPE_NUMBER){
+				return false;
+			}
+			int i = (int)OS_VALUE_NUMBER(index);
+			if(i < 0){
+				i += slot.size;
+			}
+			if(i < 0 || i >= slot.size){
+				return false;
+			}
+			found = self->region->getItems(slot)[i];
+			return true;
+		}
+		if(!SharedRegionBuilder::isSharedKey(index)){
+			return false;
+		}
+		OS_U32 hash = getKeyHash(index);
+		const SharedProp * props = self->region->getProps(slot);
+		int i = self->region->getHeads(slot)[hash & SharedRegion::getHeadMask(slot.size)];
+		for(; i >= 0; i = props[i].next){
+			if(props[i].hash == hash && isSameKey(self->region, props[i].key, index)){
+				found = props[i].value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// strings are pushed as values of OS instance, containers are pushed as frozen native views
+	static void pushSharedSlot(OS * os, SharedRegion * region, const SharedSlot& slot)
+	{
+		switch(slot.type){
+		case OS_VALUE_TYPE_BOOL:
+			os->pushBool(slot.boolean);
+			return;
+
+		case OS_VALUE_TYPE_NUMBER:
+			os->pushNumber(slot.number);
+			return;
+
+		case OS_VALUE_TYPE_STRING:
+			os->pushString((const void*)region->getBytes(slot), slot.size);
+			return;
+
+		case OS_VALUE_TYPE_ARRAY:
+		case OS_VALUE_TYPE_OBJECT:
+			pushCtypeValue(os, new (os->malloc(sizeof(SharedValue) OS_DBG_FILEPOS)) SharedValue(region, slot));
+			os->freeze();
+			return;
+		}
+		os->pushNull();
+	}
+
+	static int getShared(OS * p_os, int params, int, int, void*)
+	{
+		CacheOS * os = (CacheOS*)p_os;
+		OS_GET_SELF(SharedValue*);
+		if(params < 1) return 0;
+		SharedSlot found;
+		if(!findSharedItem(self, os->core->getStackValue(-params+0), found)){
+			return 0;
+		}
+		pushSharedSlot(os, self->region, found);
+		return 1;
+	}
+
+	static int getSharedLen(OS * os, int params, int, int, void*)
+	{
+		OS_GET_SELF(SharedValue*);
+		os->pushNumber(self->slot.size);
+		return 1;
+	}
+
+	// methods of Object are not inherited so appends are rejected here
+	static int setSharedEmpty(OS * p_os, int params, int, int, void*)
+	{
+		CacheOS * os = (CacheOS*)p_os;
+		os->core->checkValueWritable(os->core->getStackValue(-params-1));
+		return 0;
+	}
+
+	static int iterShared(OS * os, int params, int, int, void*)
+	{
+		struct Lib
+		{
+			static int iterStep(OS * os, int params, int closure_values, int, void*)
+			{
+				OS_ASSERT(params == 0 && closure_values == 1);
+				SharedValue * self = CtypeValue<SharedValue*>::getArg(os, -1);
+				OS_ASSERT(self);
+				if(self->pos >= self->slot.size){
+					return 0;
+				}
+				int i = self->pos++;
+				os->pushBool(true);
+				if(self->slot.type == OS_VALUE_TYPE_ARRAY){
+					os->pushNumber(i);
+					pushSharedSlot(os, self->region, self->region->getItems(self->slot)[i]);
+				}else{
+					const SharedProp * prop = self->region->getProps(self->slot) + i;
+					pushSharedSlot(os, self->region, prop->key);
+					pushSharedSlot(os, self->region, prop->value);
+				}
+				return 3;
+			}
+		};
+
+		OS_GET_SELF(SharedValue*);
+		// iterator is separated view so the same value could be iterated by nested loops
+		pushCtypeValue(os, new (os->malloc(sizeof(SharedValue) OS_DBG_FILEPOS)) SharedValue(self->region, self->slot));
+		os->pushCFunction(Lib::iterStep, 1);
+		return 1;
+	}
+
+	static int freeze(OS * p_os, int params, int, int, void*)
+	{
+		if(params < 2) return 0;
+		CacheOS * os = (CacheOS*)p_os;
+		OS::String key = os->toString(-params+0);
+		os->OS::freeze(-params+1);
+		SharedRegion * region = SharedRegionBuilder(os->core).build(os->core->getStackValue(-params+1));
+		if(!region){
+			return 0;
+		}
+		CacheItem * item = newItem(key.toChar(), key.getDataSize(), NULL, 0, getExpire(os, 2, params));
+		if(!item){
+			region->release();
+			return 0;
+		}
+		region->retain();
+		item->region = region;
+		item->alloc_size += region->size;
+		bool stored = storeItem(cache, item);
+		if(stored){
+			pushSharedSlot(os, region, region->root);
+		}
+		region->release();
+		return stored ? 1 : 0;
+	}
+
+	// the same filename is resolved by other way if requiring script or require.paths are different
+	static OS::String resolveRequirePath(OS * p_os, const OS::String& filename)
+	{
+		CacheOS * os = (CacheOS*)p_os;
+		Core::StackFunction * stack_func = NULL;
+		for(int i = os->core->call_stack_funcs.count-1; i >= 0 && !stack_func; i--){
+			if(!os->core->call_stack_funcs.buf[i].func->prog->filename.isEmpty()){
+				stack_func = os->core->call_stack_funcs.buf + i;
+			}
+		}
+		OS::String cur_path = stack_func ? os->getFilenamePath(OS::String(stack_func->func->prog->filename)) : OS::String(os);
+		OS_U32 paths_hash = 2166136261u;
+		os->getGlobal(OS_TEXT("require"));
+		os->getProperty(OS_TEXT("paths"));
+		while(os->nextIteratorStep()){
+			OS::String path = os->toString();
+			paths_hash = (getHash(path.toChar(), path.getDataSize()) ^ paths_hash) * 16777619u;
+			os->pop(2);
+		}
+		os->pop();
+
+		int cur_path_size = cur_path.getDataSize();
+		int filename_size = filename.getDataSize();
+		int key_size = cur_path_size + 1 + filename_size + (int)sizeof(paths_hash);
+		char * key = (char*)::malloc(key_size);
+		if(!key){
+			return os->OS::resolvePath(filename);
+		}
+		memcpy(key, cur_path.toChar(), cur_path_size);
+		key[cur_path_size] = '\0';
+		memcpy(key + cur_path_size + 1, filename.toChar(), filename_size);
+		memcpy(key + cur_path_size + 1 + filename_size, &paths_hash, sizeof(paths_hash));
+		OS_U32 hash = getHash(key, key_size);
+		{
+			Locker locker(getStripe(resolve_cache, hash));
+			CacheItem * item = findFileCacheItem(resolve_cache, key, key_size, hash);
+			if(item){
+				OS::String resolved_path(os, item->getData(), item->data_size);
+				::free(key);
+				return resolved_path;
+			}
+		}
+		// not resolved path is not cached, the file could be deployed at any moment
+		OS::String resolved_path = os->OS::resolvePath(filename);
+		if(!resolved_path.isEmpty()){
+			CacheItem * item = newItem(key, key_size, resolved_path.toChar(), resolved_path.getDataSize(), getFileCacheExpire());
+			if(item){
+				storeItem(resolve_cache, item);
+			}
+		}
+		::free(key);
+		return resolved_path;
+	}
+
+	static int get(OS * p_os, int params, int, int, void*)
+	{
+		if(params < 1) return 0;
+		CacheOS * os = (CacheOS*)p_os;
+		OS::String key = os->toString(-params+0);
+		OS_U32 hash = getHash(key.toChar(), key.getDataSize());
+		CacheStripe * stripe = getStripe(cache, hash);
+		SharedRegion * region = NULL;
+		char * data = NULL;
+		int data_size = 0;
+		{
+			Locker locker(stripe);
+			CacheItem * item = stripe->find(key.toChar(), key.getDataSize(), hash);
+			if(item && isExpired(item, time(NULL))){
+				stripe->remove(item);
+				item = NULL;
+			}
+			if(!item){
+				if(params < 2) return 0;
+				os->pushStackValue(-params+1);
+				return 1;
+			}
+			stripe->touch(item);
+			if(item->is_number){
+				os->pushNumber(item->number);
+				return 1;
+			}
+			if(item->region){
+				// shared region is read outside of the lock, item could be replaced meanwhile
+				region = item->region;
+				region->retain();
+			}else{
+				// data is restored outside of the lock, unserializer requires null terminated buffer
+				data_size = item->data_size;
+				data = (char*)os->malloc(data_size + 1 OS_DBG_FILEPOS);
+				memcpy(data, item->getData(), data_size);
+				data[data_size] = '\0';
+			}
+		}
+		if(region){
+			pushSharedSlot(os, region, region->root);
+			region->release();
+			return 1;
+		}
+		Core::ValueUnserializer unserializer(os->core, data, data_size);
+		if(!unserializer.unserialize()){
+			os->pushNull();
+		}
+		os->free(data);
+		return 1;
+	}
+
+	static int set(OS * p_os, int params, int, int, void*)
+	{
+		if(params < 2) return 0;
+		CacheOS * os = (CacheOS*)p_os;
+		OS::String key = os->toString(-params+0);
+		Core::Value value = os->core->getStackValue(-params+1);
+		time_t expire = getExpire(os, 2, params);
+		CacheItem * item;
+		if(OS_VALUE_TYPE(value) == OS_VALUE_TYPE_NUMBER){
+			item = newItem(key.toChar(), key.getDataSize(), NULL, 0, expire);
+			if(item){
+				item->is_number = true;
+				item->number = OS_VALUE_NUMBER(value);
+			}
+		}else{
+			Core::ValueSerializer serializer(os->core);
+			if(!serializer.serialize(value)){
+				return 0;
+			}
+			item = newItem(key.toChar(), key.getDataSize(), serializer.writer.buffer.buf, serializer.writer.buffer.count, expire);
+		}
+		os->pushBool(item && storeItem(cache, item));
+		return 1;
+	}
+
+	static int del(OS * p_os, int params, int, int, void*)
+	{
+		if(params < 1) return 0;
+		OS::String key = p_os->toString(-params+0);
+		OS_U32 hash = getHash(key.toChar(), key.getDataSize());
+		CacheStripe * stripe = getStripe(cache, hash);
+		Locker locker(stripe);
+		CacheItem * item = stripe->find(key.toChar(), key.getDataSize(), hash);
+		if(item){
+			stripe->remove(item);
+		}
+		p_os->pushBool(item != NULL);
+		return 1;
+	}
+
+	static int incr(OS * p_os, int params, int, int, void*)
+	{
+		if(params < 1) return 0;
+		OS::String key = p_os->toString(-params+0);
+		OS_NUMBER step = params >= 2 ? p_os->toNumber(-params+1) : 1;
+		OS_U32 hash = getHash(key.toChar(), key.getDataSize());
+		time_t expire = getExpire(p_os, 2, params);
+		CacheStripe * stripe = getStripe(cache, hash);
+		Locker locker(stripe);
+		CacheItem * item = stripe->find(key.toChar(), key.getDataSize(), hash);
+		if(item && isExpired(item, time(NULL))){
+			stripe->remove(item);
+			item = NULL;
+		}
+		if(!item){
+			// new item is started from zero and inserted under the same lock so concurrent incr or set are not lost
+			item = newItem(key.toChar(), key.getDataSize(), NULL, 0, expire);
+			if(!item) return 0;
+			item->is_number = true;
+			if(!insertItem(cache, stripe, item)) return 0;
+		}else if(!item->is_number){
+			// only numbers could be incremented
+			return 0;
+		}else{
+			stripe->touch(item);
+		}
+		p_os->pushNumber(item->number += step);
+		return 1;
+	}
+
+	static int clear(OS * os, int params, int, int, void*)
+	{
+		for(int i = 0; i < OS_CACHE_STRIPES; i++){
+			Locker locker(cache.stripes + i);
+			cache.stripes[i].clear();
+		}
+		return 0;
+	}
+
+	static int getSize(OS * os, int params, int, int, void*)
+	{
+		int size = 0;
+		for(int i = 0; i < OS_CACHE_STRIPES; i++){
+			Locker locker(cache.stripes + i);
+			size += cache.stripes[i].used_bytes;
+		}
+		os->pushNumber(size);
+		return 1;
+	}
+
+	static int getMaxSize(OS * os, int params, int, int, void*)
+	{
+		os->pushNumber(cache.max_size);
+		return 1;
+	}
+};
+
+void initCacheExtension(OS * os)
+{
+	OS::FuncDef funcs[] = {
+		{OS_TEXT("get"), &CacheOS::get, NULL},
+		{OS_TEXT("set"), &CacheOS::set, NULL},
+		{OS_TEXT("delete"), &CacheOS::del, NULL},
+		{OS_TEXT("incr"), &CacheOS::incr, NULL},
+		{OS_TEXT("clear"), &CacheOS::clear, NULL},
+		{OS_TEXT("__get@size"), &CacheOS::getSize, NULL},
+		{OS_TEXT("__get@maxSize"), &CacheOS::getMaxSize, NULL},
+		{OS_TEXT("freeze"), &CacheOS::freeze, NULL},
+		{}
+	};
+	os->getModule("cache");
+	os->setFuncs(funcs);
+	os->pop();
+
+	OS::FuncDef shared_funcs[] = {
+		{OS_TEXT("__get"), &CacheOS::getShared, NULL},
+		{OS_TEXT("__len"), &CacheOS::getSharedLen, NULL},
+		{OS_TEXT("__iter"), &CacheOS::iterShared, NULL},
+		{OS_TEXT("__setempty"), &CacheOS::setSharedEmpty, NULL},
+		{OS_TEXT("__setdim"), &CacheOS::setSharedEmpty, NULL},
+		{}
+	};
+	registerUserClass<SharedValue>(os, shared_funcs, NULL, false);
+	// all names are keys of shared value so methods of Object are not inherited
+	os->getGlobal(CtypeName<SharedValue>::getName());
+	os->pushNull();
+	os->setPrototype(CtypeId<SharedValue>::getId());
+}
+
+void setFileCacheInterval(int seconds)
+{
+	file_cache_interval = seconds > 0 ? seconds : 0;
+}
+
+static time_t getFileCacheExpire()
+{
+	return file_cache_interval > 0 ? time(NULL) + file_cache_interval : 0;
+}
+
+static CacheItem * findFileCacheItem(Cache& cache, const char * key, int key_size, OS_U32 hash)
+{
+	CacheStripe * stripe = CacheOS::getStripe(cache, hash);
+	CacheItem * item = stripe->find(key, key_size, hash);
+	if(item && CacheOS::isExpired(item, time(NULL))){
+		stripe->remove(item);
+		return NULL;
+	}
+	if(item){
+		stripe->touch(item);
+	}
+	return item;
+}
+
+bool getCachedFileStat(const OS_CHAR * filename, FileCacheStat * st)
+{
+	int key_size = (int)OS_STRLEN(filename);
+	OS_U32 hash = CacheOS::getHash(filename, key_size);
+	{
+		CacheOS::Locker locker(CacheOS::getStripe(stat_cache, hash));
+		CacheItem * item = findFileCacheItem(stat_cache, filename, key_size, hash);
+		if(item){
+			memcpy(st, item->getData(), sizeof(FileCacheStat));
+			return true;
+		}
+	}
+	struct stat filename_st;
+	if(stat(filename, &filename_st) != 0){
+		// missing file is not cached, it's going to be created by compiler or deployment soon
+		return false;
+	}
+	st->mtime = filename_st.st_mtime;
+	st->size = filename_st.st_size;
+	CacheItem * item = CacheOS::newItem(filename, key_size, st, sizeof(FileCacheStat), getFileCacheExpire());
+	if(item){
+		CacheOS::storeItem(stat_cache, item);
+	}
+	return true;
+}
+
+OS::String resolveCachedPath(OS * os, const OS::String& filename)
+{
+	return CacheOS::resolveRequirePath(os, filename);
+}
+
+void invalidateFileCache(const OS_CHAR * filename)
+{
+	if(filename){
+		int key_size = (int)OS_STRLEN(filename);
+		OS_U32 hash = CacheOS::getHash(filename, key_size);
+		CacheStripe * stripe = CacheOS::getStripe(stat_cache, hash);
+		CacheOS::Locker locker(stripe);
+		CacheItem * item = stripe->find(filename, key_size, hash);
+		if(item){
+			stripe->remove(item);
+		}
+	}else{
+		for(int i = 0; i < OS_CACHE_STRIPES; i++){
+			CacheOS::Locker locker(stat_cache.stripes + i);
+			stat_cache.stripes[i].clear();
+		}
+	}
+	for(int i = 0; i < OS_CACHE_STRIPES; i++){
+		CacheOS::Locker locker(resolve_cache.stripes + i);
+		resolve_cache.stripes[i].clear();
+	}
+}
+
+} // namespace ObjectScript
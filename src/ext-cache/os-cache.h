@@ -0,0 +1,68 @@
+#ifndef __OS_EXT_CACHE_H__
+#define __OS_EXT_CACHE_H__
+
+/******************************************************************************
+* Copyright (C) 2012-2014 Evgeniy Golovin (evgeniy.golovin@unitpoint.ru)
+*
+* Please feel free to contact me at anytime, 
+* my email is evgeniy.golovin@unitpoint.ru, skype: egolovin
+*
+* Latest source code: https://github.com/unitpoint/objectscript
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include "../objectscript.h"
+#include <time.h>
+
+namespace ObjectScript {
+
+	/*
+		ObjectScript process wide cache extension,
+		values are shared between all OS instances of the process,
+		cache.freeze(key, value) keeps frozen value in shared region
+		which is read by all OS instances without copying
+	*/
+	void initCacheExtension(OS* os);
+	void setCacheExtensionMaxSize(int bytes);
+
+	/*
+		process wide cache of file stats and resolved require paths,
+		entries are checked again after interval seconds, 0 - never,
+		invalidateFileCache should be called by file watcher then
+	*/
+	struct FileCacheStat
+	{
+		time_t mtime;
+		OS_INT64 size;
+	};
+
+	// returns false if file doesn't exist, missing files are not cached
+	bool getCachedFileStat(const OS_CHAR * filename, FileCacheStat * st);
+	// resolves path by os->OS::resolvePath at cache miss, result is shared between all OS instances,
+	// it's keyed by path of requiring script, filename and require.paths, missing files are not cached
+	OS::String resolveCachedPath(OS * os, const OS::String& filename);
+	// removes stat of filename (all stats if NULL) and all resolved paths
+	void invalidateFileCache(const OS_CHAR * filename = NULL);
+	void setFileCacheInterval(int seconds);
+
+};
+
+#endif // __OS_EXT_CACHE_H__
@@ -42,6 +42,30 @@
 #  endif
 #endif
 
+#include <stddef.h>
+#include <limits.h>
+
+#if !defined(Z_U4) && UINT_MAX == 0xffffffffUL
+#  define Z_U4 unsigned int
+#endif
+
+#define ZSWAP32(q) ((((q) >> 24) & 0xff) + (((q) >> 8) & 0xff00) + \
+                    (((q) & 0xff00) << 8) + (((q) & 0xff) << 24))
+
+/* Carry-less multiplication folding, used if cpu supports PCLMULQDQ */
+#if !defined(NOPCLMUL) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#  define CRC32_PCLMUL
+#  define CRC32_PCLMUL_TARGET __attribute__((target("pclmul,sse2")))
+#  include <cpuid.h>
+#  include <immintrin.h>
+#elif !defined(NOPCLMUL) && defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define CRC32_PCLMUL
+#  define CRC32_PCLMUL_TARGET
+#  include <intrin.h>
+#  include <wmmintrin.h>
+#endif
+
 #ifdef Z_U4
    typedef Z_U4 z_crc_t;
 #else
@@ -84,6 +108,9 @@ local uLong crc32_combine_ OF((uLong crc1, uLong crc2, z_off64_t len2));
 
 local volatile int crc_table_empty = 1;
 local z_crc_t FAR crc_table[TBLS][256];
+#ifdef BYFOUR
+local z_crc_t FAR crc_table_hi[4][256];
+#endif
 local void make_crc_table OF((void));
 #ifdef MAKECRCH
    local void write_table OF((FILE *, const z_crc_t FAR *));
@@ -153,6 +180,10 @@ local void make_crc_table()
                 crc_table[k][n] = c;
                 crc_table[k + 4][n] = ZSWAP32(c);
             }
+            for (k = 0; k < 4; k++) {
+                c = crc_table[0][c & 0xff] ^ (c >> 8);
+                crc_table_hi[k][n] = c;
+            }
         }
 #endif /* BYFOUR */
 
@@ -223,6 +254,130 @@ const z_crc_t FAR * ZEXPORT __get_crc_table()
     return (const z_crc_t FAR *)crc_table;
 }
 
+#ifdef CRC32_PCLMUL
+/* =========================================================================
+ * Folds 64 bytes at a time by carry-less multiplication, see "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction" by Intel.
+ * Constants are bit-reflected x^(4*128+32), x^(4*128-32), x^(128+32),
+ * x^(128-32), x^64 mod P(x) and Barrett constants for P(x). len must be at
+ * least 64 and a multiple of 16.
+ */
+local CRC32_PCLMUL_TARGET unsigned long crc32_pclmul(unsigned long crc,
+                                                     const unsigned char FAR *buf, uInt len)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)~(unsigned int)crc));
+
+    x0 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    buf += 64;
+    len -= 64;
+
+    /* fold four blocks of 16 in parallel */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        buf += 64;
+        len -= 64;
+    }
+
+    /* fold into 128 bits */
+    x0 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* fold the rest blocks of 16 */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        buf += 16;
+        len -= 16;
+    }
+
+    /* fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (unsigned long)~(unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+/* ========================================================================= */
+local int crc32_pclmul_supported(void)
+{
+    /* -1 - not checked yet, the same value is stored by every thread */
+    static volatile int supported = -1;
+    if (supported < 0) {
+        unsigned int ecx = 0;
+#  ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        ecx = (unsigned int)info[2];
+#  else
+        unsigned int eax, ebx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            ecx = 0;
+#  endif
+        /* PCLMULQDQ and SSE2 (always present with PCLMULQDQ) */
+        supported = (ecx >> 1) & 1;
+    }
+    return supported;
+}
+#endif /* CRC32_PCLMUL */
+
 /* ========================================================================= */
 #define DO1 crc = crc_table[0][((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8)
 #define DO8 DO1; DO1; DO1; DO1; DO1; DO1; DO1; DO1
@@ -240,6 +395,15 @@ unsigned long ZEXPORT __crc32(crc, buf, len)
         make_crc_table();
 #endif /* DYNAMIC_CRC_TABLE */
 
+#ifdef CRC32_PCLMUL
+    if (len >= 64 && crc32_pclmul_supported()) {
+        uInt chunk = len & ~15;
+        crc = crc32_pclmul(crc, buf, chunk);
+        buf += chunk;
+        len -= chunk;
+    }
+#endif /* CRC32_PCLMUL */
+
 #ifdef BYFOUR
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
         z_crc_t endian;
@@ -268,7 +432,13 @@ unsigned long ZEXPORT __crc32(crc, buf, len)
 #define DOLIT4 c ^= *buf4++; \
         c = crc_table[3][c & 0xff] ^ crc_table[2][(c >> 8) & 0xff] ^ \
             crc_table[1][(c >> 16) & 0xff] ^ crc_table[0][c >> 24]
-#define DOLIT32 DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4
+/* slicing by eight, two words are looked up by eight independent tables */
+#define DOLIT8 c ^= *buf4++; \
+        c = crc_table_hi[3][c & 0xff] ^ crc_table_hi[2][(c >> 8) & 0xff] ^ \
+            crc_table_hi[1][(c >> 16) & 0xff] ^ crc_table_hi[0][c >> 24] ^ \
+            crc_table[3][*buf4 & 0xff] ^ crc_table[2][(*buf4 >> 8) & 0xff] ^ \
+            crc_table[1][(*buf4 >> 16) & 0xff] ^ crc_table[0][*buf4 >> 24]; \
+        buf4++
 
 /* ========================================================================= */
 local unsigned long crc32_little(crc, buf, len)
@@ -281,16 +451,20 @@ local unsigned long crc32_little(crc, buf, len)
 
     c = (z_crc_t)crc;
     c = ~c;
-    while (len && ((ptrdiff_t)buf & 3)) {
+    while (len && ((ptrdiff_t)buf & 7)) {
         c = crc_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
         len--;
     }
 
     buf4 = (const z_crc_t FAR *)(const void FAR *)buf;
     while (len >= 32) {
-        DOLIT32;
+        DOLIT8; DOLIT8; DOLIT8; DOLIT8;
         len -= 32;
     }
+    while (len >= 8) {
+        DOLIT8;
+        len -= 8;
+    }
     while (len >= 4) {
         DOLIT4;
         len -= 4;
@@ -17,6 +17,11 @@ extern "C" unsigned long __crc32(unsigned long crc, const unsigned char * buf, u
 
 namespace ObjectScript {
 
+enum {
+	HASH_MD5 = 100,
+	HASH_CRC32
+};
+
 class HashlibOS: public OS
 {
 public:
@@ -219,10 +224,215 @@ public:
 		}
 		return 0;
 	}
+
+	// incremental hash, data could be hashed by chunks
+	struct Hasher
+	{
+		int type;
+		union {
+			MD5Context md5;
+			USHAContext sha;
+			unsigned long crc;
+		} ctx;
+
+		Hasher(int p_type)
+		{
+			type = p_type;
+			reset();
+		}
+
+		static bool isValidType(int type)
+		{
+			switch(type){
+			case SHA1:
+			case SHA224:
+			case SHA256:
+			case SHA384:
+			case SHA512:
+			case HASH_MD5:
+			case HASH_CRC32:
+				return true;
+			}
+			return false;
+		}
+
+		void reset()
+		{
+			switch(type){
+			case HASH_MD5:
+				MD5Init(&ctx.md5);
+				break;
+
+			case HASH_CRC32:
+				ctx.crc = 0;
+				break;
+
+			default:
+				USHAReset(&ctx.sha, (SHAversion)type);
+			}
+		}
+
+		void update(const void * buf, int size)
+		{
+			switch(type){
+			case HASH_MD5:
+				MD5Update(&ctx.md5, (const md5byte*)buf, size);
+				break;
+
+			case HASH_CRC32:
+				ctx.crc = __crc32(ctx.crc, (const unsigned char*)buf, size);
+				break;
+
+			default:
+				USHAInput(&ctx.sha, (const uint8_t*)buf, size);
+			}
+		}
+
+		// returns digest size, hasher is not finalized so update could be continued
+		int digest(unsigned char * r) const
+		{
+			Hasher copy = *this;
+			switch(type){
+			case HASH_MD5:
+				MD5Final(&copy.ctx.md5, r);
+				return 16;
+
+			case HASH_CRC32:
+				r[0] = (unsigned char)(ctx.crc >> 24);
+				r[1] = (unsigned char)(ctx.crc >> 16);
+				r[2] = (unsigned char)(ctx.crc >> 8);
+				r[3] = (unsigned char)ctx.crc;
+				return 4;
+			}
+			USHAResult(&copy.ctx.sha, r);
+			return USHAHashSize((SHAversion)type);
+		}
+
+		static void initExtension(OS * os);
+	};
+};
+
+template <> struct CtypeName<HashlibOS::Hasher>{ static const OS_CHAR * getName(){ return OS_TEXT("Hasher"); } };
+template <> struct CtypeValue<HashlibOS::Hasher*>: public CtypeUserClass<HashlibOS::Hasher*>{};
+template <> struct UserDataDestructor<HashlibOS::Hasher>
+{
+	static void dtor(ObjectScript::OS * os, void * data, void * user_param)
+	{
+		HashlibOS::Hasher * hasher = (HashlibOS::Hasher*)data;
+		hasher->~Hasher();
+		os->free(hasher);
+	}
 };
 
+void HashlibOS::Hasher::initExtension(OS * os)
+{
+	struct Lib
+	{
+		/* proto Hasher(int type = hashlib.MD5) */
+		static int __newinstance(OS * os, int params, int, int, void * user_param)
+		{
+			int type = params >= 1 ? os->toInt(-params+0) : HASH_MD5;
+			if(!isValidType(type)){
+				os->setException("error hash type");
+				return 0;
+			}
+			pushCtypeValue(os, new (os->malloc(sizeof(Hasher) OS_DBG_FILEPOS)) Hasher(type));
+			return 1;
+		}
+
+		// returns this, so calls could be chained
+		static int update(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Hasher*);
+			if(params >= 1){
+				OS::String str = os->toString(-params+0);
+				self->update(str.toChar(), str.getDataSize());
+			}
+			os->pushStackValue(-params-1);
+			return 1;
+		}
+
+		static int digest(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Hasher*);
+			unsigned char r[USHAMaxHashSize];
+			int size = self->digest(r);
+			os->pushString((const void*)r, size);
+			return 1;
+		}
+
+		static int hexdigest(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Hasher*);
+			unsigned char r[USHAMaxHashSize];
+			OS_CHAR hex[USHAMaxHashSize*2];
+			int size = self->digest(r);
+			for(int i = 0; i < size; i++){
+				hex[i*2+0] = OS_TEXT("0123456789ABCDEF")[(r[i] >> 4) & 0xf];
+				hex[i*2+1] = OS_TEXT("0123456789ABCDEF")[(r[i] >> 0) & 0xf];
+			}
+			os->pushString(hex, size*2);
+			return 1;
+		}
+
+		static int copy(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Hasher*);
+			pushCtypeValue(os, new (os->malloc(sizeof(Hasher) OS_DBG_FILEPOS)) Hasher(*self));
+			return 1;
+		}
+
+		static int reset(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Hasher*);
+			self->reset();
+			return 0;
+		}
+
+		static int getType(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Hasher*);
+			os->pushNumber(self->type);
+			return 1;
+		}
+
+		static int getDigestSize(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Hasher*);
+			unsigned char r[USHAMaxHashSize];
+			os->pushNumber(self->digest(r));
+			return 1;
+		}
+	};
+
+	OS::FuncDef funcs[] = {
+		{OS_TEXT("__newinstance"), Lib::__newinstance},
+		{OS_TEXT("update"), Lib::update},
+		{OS_TEXT("digest"), Lib::digest},
+		{OS_TEXT("hexdigest"), Lib::hexdigest},
+		{OS_TEXT("copy"), Lib::copy},
+		{OS_TEXT("reset"), Lib::reset},
+		{OS_TEXT("__get@type"), Lib::getType},
+		{OS_TEXT("__get@digestSize"), Lib::getDigestSize},
+		{}
+	};
+	OS::NumberDef numbers[] = {
+		{OS_TEXT("MD5"), HASH_MD5},
+		{OS_TEXT("SHA1"), SHA1},
+		{OS_TEXT("SHA224"), SHA224},
+		{OS_TEXT("SHA256"), SHA256},
+		{OS_TEXT("SHA384"), SHA384},
+		{OS_TEXT("SHA512"), SHA512},
+		{OS_TEXT("CRC32"), HASH_CRC32},
+		{}
+	};
+	registerUserClass<Hasher>(os, funcs, numbers);
+}
+
 void initHashExtension(OS * os)
 {
+	HashlibOS::Hasher::initExtension(os);
+
 	OS::FuncDef funcs[] = {
 		{OS_TEXT("md5"), &HashlibOS::md5},
 		{OS_TEXT("des"), &HashlibOS::des},
@@ -242,6 +452,8 @@ void initHashExtension(OS * os)
 		{OS_TEXT("SHA256"), SHA256},
 		{OS_TEXT("SHA384"), SHA384},
 		{OS_TEXT("SHA512"), SHA512},
+		{OS_TEXT("MD5"), HASH_MD5},
+		{OS_TEXT("CRC32"), HASH_CRC32},
 		{}
 	};
 	os->getModule("hashlib");
@@ -1,5 +1,8 @@
 #ifdef _MSC_VER
 #define _CRT_SECURE_NO_WARNINGS
+#include <Windows.h>
+#else
+#include <pthread.h>
 #endif
 
 #include "os-iconv.h"
@@ -34,6 +37,14 @@ static char _generic_superset_name[] = ICONV_UCS4_ENCODING;
 
 #define TMP_BUF_SIZE 4096
 
+// opened descriptors kept per thread, charset names longer than
+// ICONV_CACHE_NAME_SIZE-1 are not cached
+#define ICONV_CACHE_SIZE 16
+#define ICONV_CACHE_NAME_SIZE 40
+
+// max size of incomplete char kept between IconvConverter chunks
+#define ICONV_PENDING_SIZE 16
+
 #define ICONV_MEMEQUAL(a, b, c) \
   ((c) == sizeof(OS_U64) ? *((OS_U64*)(a)) == *((OS_U64*)(b)) : ((c) == sizeof(OS_U32) ? *((OS_U32*)(a)) == *((OS_U32*)(b)) : memcmp(a, b, c) == 0)) 
 
@@ -43,6 +54,175 @@ class IconvOS: public OS
 {
 public:
 
+	/*
+		LRU cache of opened descriptors, it's owned by thread so it outlives
+		short OS instances (os-fcgi makes new one per request) and it's never
+		used by several threads at once. Descriptor is taken out of the cache
+		while it's in use and returned in initial state after that, the cache
+		is released at thread exit
+	*/
+	struct Cache
+	{
+		struct Item
+		{
+			iconv_t cd;
+			char tocode[ICONV_CACHE_NAME_SIZE];
+			char fromcode[ICONV_CACHE_NAME_SIZE];
+		};
+
+		Item items[ICONV_CACHE_SIZE]; // most recently used first
+		int count;
+
+		Cache()
+		{
+			count = 0;
+		}
+
+		~Cache()
+		{
+			clear();
+		}
+
+		void clear()
+		{
+			for(int i = 0; i < count; i++){
+				iconv_close(items[i].cd);
+			}
+			count = 0;
+		}
+
+#ifdef _MSC_VER
+		static DWORD key;
+
+		static void WINAPI destroy(void * data)
+		{
+			delete (Cache*)data;
+		}
+
+		static BOOL CALLBACK initKey(PINIT_ONCE, void*, void**)
+		{
+			key = FlsAlloc(destroy);
+			return TRUE;
+		}
+
+		static Cache * get()
+		{
+			static INIT_ONCE key_once = INIT_ONCE_STATIC_INIT;
+			InitOnceExecuteOnce(&key_once, initKey, NULL, NULL);
+			Cache * cache = (Cache*)FlsGetValue(key);
+			if(!cache){
+				cache = new Cache();
+				FlsSetValue(key, cache);
+			}
+			return cache;
+		}
+#else
+		static pthread_key_t key;
+
+		static void destroy(void * data)
+		{
+			delete (Cache*)data;
+		}
+
+		static void initKey()
+		{
+			pthread_key_create(&key, destroy);
+		}
+
+		static Cache * get()
+		{
+			static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+			pthread_once(&key_once, initKey);
+			Cache * cache = (Cache*)pthread_getspecific(key);
+			if(!cache){
+				cache = new Cache();
+				pthread_setspecific(key, cache);
+			}
+			return cache;
+		}
+#endif
+
+		static bool isCacheable(const char * tocode, const char * fromcode)
+		{
+			return ::strlen(tocode) < ICONV_CACHE_NAME_SIZE && ::strlen(fromcode) < ICONV_CACHE_NAME_SIZE;
+		}
+
+		// returns (iconv_t)-1 and sets errno if conversion is not supported
+		iconv_t open(const char * tocode, const char * fromcode)
+		{
+			for(int i = 0; i < count; i++){
+				Item& item = items[i];
+				if(!::strcmp(item.tocode, tocode) && !::strcmp(item.fromcode, fromcode)){
+					iconv_t cd = item.cd;
+					memmove(items + i, items + i + 1, sizeof(Item) * (count - i - 1));
+					count--;
+					return cd;
+				}
+			}
+			return iconv_open(tocode, fromcode);
+		}
+
+		void close(iconv_t cd, const char * tocode, const char * fromcode)
+		{
+			if(cd == (iconv_t)(-1)){
+				return;
+			}
+			int saved_errno = errno;
+			if(!isCacheable(tocode, fromcode)){
+				iconv_close(cd);
+			}else{
+				iconv(cd, NULL, NULL, NULL, NULL); /* return to the initial state */
+				if(count == ICONV_CACHE_SIZE){
+					iconv_close(items[--count].cd);
+				}
+				memmove(items + 1, items, sizeof(Item) * count);
+				items[0].cd = cd;
+				::strcpy(items[0].tocode, tocode);
+				::strcpy(items[0].fromcode, fromcode);
+				count++;
+			}
+			errno = saved_errno;
+		}
+	};
+
+	// takes descriptor from the cache and returns it back at scope exit
+	struct Descriptor
+	{
+		Cache * cache;
+		const char * tocode;
+		const char * fromcode;
+		iconv_t cd;
+
+		Descriptor(Cache * p_cache, const char * p_tocode, const char * p_fromcode)
+		{
+			cache = p_cache;
+			tocode = p_tocode;
+			fromcode = p_fromcode;
+			cd = cache->open(tocode, fromcode);
+		}
+
+		~Descriptor()
+		{
+			cache->close(cd, tocode, fromcode);
+		}
+
+		bool isValid() const { return cd != (iconv_t)(-1); }
+		operator iconv_t() const { return cd; }
+	};
+
+	static void setOpenException(OS * os)
+	{
+	#ifdef ICONV_SUPPORTS_ERRNO
+		if (errno == EINVAL) {
+			os->setException(OS_TEXT("iconv wrong charset"));
+		} else {
+			os->setException(OS_TEXT("iconv error converter"));
+		}
+	#else
+		os->setException(OS_TEXT("iconv error"));
+	#endif
+	}
+
 	friend struct Internal;
 	struct Internal
 	{
@@ -128,15 +308,13 @@ public:
 			return append(os, out, &c, 1, cd);
 		}
 
-		static bool convert(OS * os, const char* tocode, const char* fromcode,
+		static bool convert(OS * os, Cache * cache, const char* tocode, const char* fromcode,
 			const char* start, const char* end,
 			Core::Buffer& out)
 		{
 			out.clear();
-			iconv_t cd = iconv_open(tocode, fromcode);
-			size_t length;
-			char* result;
-			if (cd == (iconv_t)(-1)) {
+			Descriptor cd(cache, tocode, fromcode);
+			if (!cd.isValid()) {
 				if (errno != EINVAL)
 					return false;
 				/* Unsupported fromcode or tocode. Check whether the caller requested
@@ -145,17 +323,17 @@ public:
 					bool ret;
 					/* Try UTF-8 first. There are very few ISO-8859-1 inputs that would
 					be valid UTF-8, but many UTF-8 inputs are valid ISO-8859-1. */
-					ret = convert(os, tocode,"UTF-8",start,end,out);
+					ret = convert(os, cache, tocode,"UTF-8",start,end,out);
 					if (!(ret == false && errno == EILSEQ))
 						return ret;
-					ret = convert(os, tocode,"ISO-8859-1",start,end,out);
+					ret = convert(os, cache, tocode,"ISO-8859-1",start,end,out);
 					return ret;
 				}
 				if (!strcmp(fromcode,"autodetect_jp")) {
 					bool ret;
 					/* Try 7-bit encoding first. If the input contains bytes >= 0x80,
 					it will fail. */
-					ret = convert(os, tocode,"ISO-2022-JP-2",start,end,out);
+					ret = convert(os, cache, tocode,"ISO-2022-JP-2",start,end,out);
 					if (!(ret == false && errno == EILSEQ))
 						return ret;
 					/* Try EUC-JP next. Short SHIFT_JIS inputs may come out wrong. This
@@ -163,115 +341,57 @@ public:
 					If we tried SHIFT_JIS first, then some short EUC-JP inputs would
 					come out wrong, and people would condemn EUC-JP and Unix, which
 					would not be good. */
-					ret = convert(os, tocode,"EUC-JP",start,end,out);
+					ret = convert(os, cache, tocode,"EUC-JP",start,end,out);
 					if (!(ret == false && errno == EILSEQ))
 						return ret;
 					/* Finally try SHIFT_JIS. */
-					ret = convert(os, tocode,"SHIFT_JIS",start,end,out);
+					ret = convert(os, cache, tocode,"SHIFT_JIS",start,end,out);
 					return ret;
 				}
 				if (!strcmp(fromcode,"autodetect_kr")) {
 					bool ret;
 					/* Try 7-bit encoding first. If the input contains bytes >= 0x80,
 					it will fail. */
-					ret = convert(os, tocode,"ISO-2022-KR",start,end,out);
+					ret = convert(os, cache, tocode,"ISO-2022-KR",start,end,out);
 					if (!(ret == false && errno == EILSEQ))
 						return ret;
 					/* Finally try EUC-KR. */
-					ret = convert(os, tocode,"EUC-KR",start,end,out);
+					ret = convert(os, cache, tocode,"EUC-KR",start,end,out);
 					return ret;
 				}
 				errno = EINVAL;
 				return false;
 			}
-			/* Determine the length we need. */
-			Core::Buffer temp(os);
-			temp.reserveCapacity(TMP_BUF_SIZE);
-			char * tmpbuf = (char*)temp.buffer.buf;
-			{
-				size_t count = 0;
-				// char tmpbuf[TMP_BUF_SIZE];
-				const char* inptr = start;
-				size_t insize = end-start;
-				while (insize > 0) {
-					char* outptr = tmpbuf;
-					size_t outsize = TMP_BUF_SIZE;
-					size_t res = iconv(cd,&inptr,&insize,&outptr,&outsize);
-					if (res == (size_t)(-1) && errno != E2BIG) {
-						int saved_errno = (errno == EINVAL ? EILSEQ : errno);
-						iconv_close(cd);
-						errno = saved_errno;
-						return false;
-					}
-					count += outptr-tmpbuf;
-				}
-				{
-					char* outptr = tmpbuf;
-					size_t outsize = TMP_BUF_SIZE;
-					size_t res = iconv(cd,NULL,NULL,&outptr,&outsize);
-					if (res == (size_t)(-1)) {
-						int saved_errno = errno;
-						iconv_close(cd);
-						errno = saved_errno;
-						return false;
-					}
-					count += outptr-tmpbuf;
-				}
-				length = count;
-			}
-			out.reserveCapacity(length);
-			if (length == 0) {
-				iconv_close(cd);
-				return true;
-			}
-			result = (char*)out.buffer.buf;
-			if (result == NULL) {
-				iconv_close(cd);
-				errno = ENOMEM;
-				return false;
-			}
-			iconv(cd,NULL,NULL,NULL,NULL); /* return to the initial state */
-			/* Do the conversion for real. */
-			{
-				const char* inptr = start;
-				size_t insize = end-start;
-				char* outptr = result;
-				size_t outsize = length;
-				while (insize > 0) {
-					size_t res = iconv(cd,&inptr,&insize,&outptr,&outsize);
-					if (res == (size_t)(-1)) {
-						if (errno == EINVAL)
-							break;
-						else {
-							int saved_errno = errno;
-							iconv_close(cd);
-							errno = saved_errno;
-							return false;
-						}
-					}
+			/* Convert in one pass, the buffer grows while iconv reports E2BIG. */
+			const char* inptr = start;
+			size_t insize = end-start;
+			bool flushed = false;
+			while (!flushed) {
+				out.reserveCapacity(out.buffer.count + (int)insize + 16);
+				char* outptr = (char*)out.buffer.buf + out.buffer.count;
+				size_t outsize = out.buffer.capacity - out.buffer.count;
+				size_t res;
+				if (insize > 0) {
+					res = iconv(cd,&inptr,&insize,&outptr,&outsize);
+				} else {
+					/* return to the initial state at the end of input */
+					res = iconv(cd,NULL,NULL,&outptr,&outsize);
+					flushed = res != (size_t)(-1);
 				}
-				{
-					size_t res = iconv(cd,NULL,NULL,&outptr,&outsize);
-					if (res == (size_t)(-1)) {
-						int saved_errno = errno;
-						iconv_close(cd);
-						errno = saved_errno;
-						return false;
-					}
+				out.buffer.count = (int)(outptr - (char*)out.buffer.buf);
+				if (res == (size_t)(-1) && errno != E2BIG) {
+					/* incomplete input is invalid as well */
+					if (errno == EINVAL)
+						errno = EILSEQ;
+					return false;
 				}
-				// if (outsize != 0) abort();
-				OS_ASSERT(outsize == 0);
 			}
-			iconv_close(cd);
-			out.buffer.count = length;
 			return true;
 		}
 
-		static bool strlen(OS * os, int *pretval, const char *str, size_t nbytes, const char *enc)
+		static bool strlen(OS * os, Cache * cache, int *pretval, const char *str, size_t nbytes, const char *enc)
 		{
-			char buf[GENERIC_SUPERSET_NBYTES*2];
-
-			iconv_t cd;
+			char buf[TMP_BUF_SIZE];
 
 			const char *in_p;
 			size_t in_left;
@@ -283,56 +403,40 @@ public:
 
 			*pretval = 0;
 
-			cd = iconv_open(GENERIC_SUPERSET_NAME, enc);
+			Descriptor cd(cache, GENERIC_SUPERSET_NAME, enc);
 
-			if (cd == (iconv_t)(-1)) {
-	#ifdef ICONV_SUPPORTS_ERRNO
-				if (errno == EINVAL) {
-					os->setException(OS_TEXT("iconv wrong charset"));
-					iconv_close(cd);
-					return false;
-				} else {
-					os->setException(OS_TEXT("iconv error converter"));
-					iconv_close(cd);
-					return false;
-				}
-	#else
-				os->setException(OS_TEXT("iconv error"));
-				iconv_close(cd);
+			if (!cd.isValid()) {
+				setOpenException(os);
 				return false;
-	#endif
 			}
 
-			errno = out_left = 0;
+			errno = 0;
 
-			for (in_p = str, in_left = nbytes, cnt = 0; in_left > 0; cnt+=2) {
+			for (in_p = str, in_left = nbytes, cnt = 0; in_left > 0;) {
 				size_t prev_in_left;
+				size_t res;
 				out_p = buf;
 				out_left = sizeof(buf);
 
 				prev_in_left = in_left;
 
-				if (iconv(cd, (const char **)&in_p, &in_left, (char **) &out_p, &out_left) == (size_t)-1) {
+				res = iconv(cd, (const char **)&in_p, &in_left, (char **) &out_p, &out_left);
+				cnt += (unsigned int)((sizeof(buf) - out_left) / GENERIC_SUPERSET_NBYTES);
+				if (res == (size_t)-1) {
 					if (prev_in_left == in_left) {
 						break;
 					}
 				}
 			}
 
-			if (out_left > 0) {
-				cnt -= out_left / GENERIC_SUPERSET_NBYTES;
-			}
-
 	#ifdef ICONV_SUPPORTS_ERRNO
 			switch (errno) {
 			case EINVAL:
 				os->setException(OS_TEXT("iconv error: illegal char"));
-				iconv_close(cd);
 				return false;
 
 			case EILSEQ:
 				os->setException(OS_TEXT("iconv error: illegal seq"));
-				iconv_close(cd);
 				return false;
 
 			case E2BIG:
@@ -342,23 +446,19 @@ public:
 
 			default:
 				os->setException(OS_TEXT("iconv error"));
-				iconv_close(cd);
 				return false;
 			}
 	#else
 			*pretval = cnt;
 	#endif
 
-			iconv_close(cd);
 			return true;
 		}
 
-		static bool substr(OS * os, Core::Buffer& out, const OS::String& str, int start, int len, const char *enc)
+		static bool substr(OS * os, Cache * cache, Core::Buffer& out, const OS::String& str, int start, int len, const char *enc)
 		{
 			char buf[GENERIC_SUPERSET_NBYTES];
 
-			iconv_t cd1, cd2;
-
 			const char *in_p;
 			size_t in_left;
 
@@ -368,54 +468,44 @@ public:
 			int cnt;
 			int total_len;
 
+			out.clear();
+
 			int str_len = str.getLen();
-			if (!strlen(os, &total_len, str, str_len, enc)) {
+			if (!strlen(os, cache, &total_len, str, str_len, enc)) {
 				return false;
 			}
 
 			if(start >= total_len){
-				os->pushString(OS_TEXT(""));
 				return true;
 			}
 			if(len < 0){
 				len = total_len - start + len;
 			}
 			if(len <= 0){
-				os->pushString(OS_TEXT(""));
 				return true;
 			}
 			if(start + len > total_len){
 				len = total_len - start;
 			}
 			if(!start && len == total_len){
-				os->pushString(str);
+				out.append(str.toChar(), str_len);
 				return true;
 			}
 
-			cd1 = iconv_open(GENERIC_SUPERSET_NAME, enc);
+			Descriptor cd1(cache, GENERIC_SUPERSET_NAME, enc);
+			if (!cd1.isValid()) {
+				setOpenException(os);
+				return false;
+			}
 
-			if (cd1 == (iconv_t)(-1)) {
-	#ifdef ICONV_SUPPORTS_ERRNO
-				if (errno == EINVAL) {
-					os->setException(OS_TEXT("iconv wrong charset"));
-					iconv_close(cd1);
-					return false;
-				} else {
-					os->setException(OS_TEXT("iconv error converter"));
-					iconv_close(cd1);
-					return false;
-				}
-	#else
-				os->setException(OS_TEXT("iconv error"));
-				iconv_close(cd1);
+			Descriptor cd2(cache, enc, GENERIC_SUPERSET_NAME);
+			if (!cd2.isValid()) {
+				setOpenException(os);
 				return false;
-	#endif
 			}
 
-			cd2 = (iconv_t)NULL;
 			errno = 0;
 
-			out.clear();
 			for (in_p = str, in_left = str_len, cnt = 0; in_left > 0 && len > 0; ++cnt) {
 				size_t prev_in_left;
 				out_p = buf;
@@ -430,33 +520,6 @@ public:
 				}
 
 				if (cnt >= start) {
-					if (cd2 == (iconv_t)NULL) {
-						cd2 = iconv_open(enc, GENERIC_SUPERSET_NAME);
-
-						if (cd2 == (iconv_t)(-1)) {
-							cd2 = (iconv_t)NULL;
-	#ifdef ICONV_SUPPORTS_ERRNO
-							if (errno == EINVAL) {
-								os->setException(OS_TEXT("iconv wrong charset"));
-								iconv_close(cd2);
-								iconv_close(cd1);
-								return false;
-							} else {
-								os->setException(OS_TEXT("iconv error converter"));
-								iconv_close(cd2);
-								iconv_close(cd1);
-								return false;
-							}
-	#else
-							os->setException(OS_TEXT("iconv error"));
-							iconv_close(cd2);
-							iconv_close(cd1);
-							return false;
-	#endif
-							break;
-						}
-					}
-
 					if (!append(os, out, buf, sizeof(buf), cd2)) {
 						break;
 					}
@@ -469,36 +532,29 @@ public:
 			switch (errno) {
 			case EINVAL:
 				os->setException(OS_TEXT("iconv error: illegal char"));
-				if(cd2) append(os, out, NULL, 0, cd2);
-				if(cd2) iconv_close(cd2);
-				if(cd1) iconv_close(cd1);
+				append(os, out, NULL, 0, cd2);
 				return false;
 
 			case EILSEQ:
 				os->setException(OS_TEXT("iconv error: illegal seq"));
-				if(cd2) append(os, out, NULL, 0, cd2);
-				if(cd2) iconv_close(cd2);
-				if(cd1) iconv_close(cd1);
+				append(os, out, NULL, 0, cd2);
 				return false;
 
 			case E2BIG:
 				break;
 			}
 	#endif
-			if(cd2) iconv_close(cd2);
-			if(cd1) iconv_close(cd1);
-			return true;
+			// return to the initial state for stateful charsets
+			return append(os, out, NULL, 0, cd2);
 		}
 
-		static bool find(OS * os, int *pretval,
+		static bool find(OS * os, Cache * cache, int *pretval,
 			const char *haystk, size_t haystk_nbytes,
 			const char *ndl, size_t ndl_nbytes,
 			int offset, const char *enc)
 		{
 			char buf[GENERIC_SUPERSET_NBYTES];
 
-			iconv_t cd;
-
 			const char *in_p;
 			size_t in_left;
 
@@ -516,25 +572,15 @@ public:
 			*pretval = (unsigned int)-1;
 
 			Core::Buffer temp(os);
-			bool err = convert(os, GENERIC_SUPERSET_NAME, enc, ndl, ndl + ndl_nbytes, temp);
+			bool err = convert(os, cache, GENERIC_SUPERSET_NAME, enc, ndl, ndl + ndl_nbytes, temp);
 			if (!err) {
 				return err;
 			}
 
-			cd = iconv_open(GENERIC_SUPERSET_NAME, enc);
-			if (cd == (iconv_t)(-1)) {
-		#ifdef ICONV_SUPPORTS_ERRNO
-				if (errno == EINVAL) {
-					os->setException(OS_TEXT("iconv wrong charset"));
-					return false;
-				} else {
-					os->setException(OS_TEXT("iconv error converter"));
-					return false;
-				}
-		#else
-				os->setException(OS_TEXT("iconv error"));
+			Descriptor cd(cache, GENERIC_SUPERSET_NAME, enc);
+			if (!cd.isValid()) {
+				setOpenException(os);
 				return false;
-		#endif
 			}
 
 			ndl_buf = (char*)temp.buffer.buf;
@@ -557,12 +603,10 @@ public:
 						switch (errno) {
 							case EINVAL:
 								os->setException(OS_TEXT("iconv error: illegal char"));
-								iconv_close(cd);
 								return false;
 
 							case EILSEQ:
 								os->setException(OS_TEXT("iconv error: illegal seq"));
-								iconv_close(cd);
 								return false;
 
 							case E2BIG:
@@ -570,7 +614,6 @@ public:
 
 							default:
 								os->setException(OS_TEXT("iconv error"));
-								iconv_close(cd);
 								return false;
 						}
 		#endif
@@ -664,12 +707,126 @@ public:
 				}
 			}
 
-			iconv_close(cd);
-
 			return err;
 		} 
 	};
 
+	/*
+		converts chunks of data, incomplete char at the end of chunk is kept
+		till the next chunk, descriptor is owned by converter
+	*/
+	struct Converter
+	{
+		iconv_t cd;
+		char pending[ICONV_PENDING_SIZE];
+		int pending_size;
+		OS_INT64 total_in;
+		OS_INT64 total_out;
+
+		Converter(const char * tocode, const char * fromcode)
+		{
+			cd = iconv_open(tocode, fromcode);
+			pending_size = 0;
+			total_in = total_out = 0;
+		}
+
+		~Converter()
+		{
+			if(cd != (iconv_t)(-1)){
+				iconv_close(cd);
+			}
+		}
+
+		bool isValid() const { return cd != (iconv_t)(-1); }
+
+		void reset()
+		{
+			iconv(cd, NULL, NULL, NULL, NULL);
+			pending_size = 0;
+			total_in = total_out = 0;
+		}
+
+		// converts whole input or returns false with errno set,
+		// in_p is NULL to write shift sequence to the initial state
+		bool process(Core::Buffer& out, const char ** in_p, size_t * in_left)
+		{
+			size_t start_left = in_p ? *in_left : 0;
+			bool ok = true;
+			for(;;){
+				out.reserveCapacity(out.buffer.count + (int)(in_p ? *in_left : 0) + 16);
+				char * out_p = (char*)out.buffer.buf + out.buffer.count;
+				size_t out_left = out.buffer.capacity - out.buffer.count;
+				size_t res = in_p ? iconv(cd, (const char **)in_p, in_left, &out_p, &out_left)
+					: iconv(cd, NULL, NULL, &out_p, &out_left);
+				int count = (int)(out_p - (char*)out.buffer.buf);
+				total_out += count - out.buffer.count;
+				out.buffer.count = count;
+				if(res != (size_t)(-1)){
+					break;
+				}
+				if(errno != E2BIG){
+					ok = false;
+					break;
+				}
+			}
+			if(in_p){
+				total_in += start_left - *in_left;
+			}
+			return ok;
+		}
+
+		bool write(Core::Buffer& out, const char * buf, size_t size)
+		{
+			// complete char of the previous chunk byte by byte, it's only a few bytes long
+			while(pending_size > 0 && size > 0){
+				pending[pending_size++] = *buf++;
+				size--;
+				const char * in_p = pending;
+				size_t in_left = pending_size;
+				if(process(out, &in_p, &in_left)){
+					pending_size = 0;
+					break;
+				}
+				if(errno != EINVAL){
+					return false;
+				}
+				if(in_p != pending){
+					// shouldn't happen, there is only one char in the buffer
+					pending_size = (int)in_left;
+					memmove(pending, in_p, in_left);
+				}
+				if(pending_size == ICONV_PENDING_SIZE){
+					errno = EILSEQ;
+					return false;
+				}
+			}
+			if(size > 0){
+				if(!process(out, &buf, &size)){
+					if(errno != EINVAL || size >= ICONV_PENDING_SIZE){
+						if(errno == EINVAL){
+							errno = EILSEQ;
+						}
+						return false;
+					}
+					memcpy(pending, buf, size);
+					pending_size = (int)size;
+				}
+			}
+			return true;
+		}
+
+		bool finish(Core::Buffer& out)
+		{
+			if(pending_size > 0){
+				errno = EINVAL;
+				return false;
+			}
+			return process(out, NULL, NULL);
+		}
+
+		static void initExtension(OS * os);
+	};
+
 	static int convert(OS * os, int params, int, int, void * user_param)
 	{
 		if(params < 3){
@@ -683,7 +840,7 @@ public:
 		const char* start = str.toChar();
 		const char* end = start + str.getLen();
 		Core::Buffer buf(os);
-		bool ok = Internal::convert(os, tocode, fromcode, start, end, buf);
+		bool ok = Internal::convert(os, Cache::get(), tocode, fromcode, start, end, buf);
 		if(ok){
 			os->pushString(buf);
 			return 1;
@@ -704,7 +861,7 @@ public:
 		OS::String charset = params >= 1 ? os->toString(-params+0) : getDefaultCharset(os);
 
 		int len = 0;
-		if(Internal::strlen(os, &len, str.toChar(), str.getLen(), charset.toChar())){
+		if(Internal::strlen(os, Cache::get(), &len, str.toChar(), str.getLen(), charset.toChar())){
 			os->pushNumber(len);
 			return 1;
 		}
@@ -720,7 +877,7 @@ public:
 			OS::String charset = params >= 3 ? os->toString(-params+2) : getDefaultCharset(os);
 
 			int pos = 0;
-			if(Internal::find(os, &pos, str.toChar(), str.getLen(), what.toChar(), what.getLen(), offset, charset.toChar())){
+			if(Internal::find(os, Cache::get(), &pos, str.toChar(), str.getLen(), what.toChar(), what.getLen(), offset, charset.toChar())){
 				os->pushNumber(pos);
 				return 1;
 			}
@@ -749,7 +906,7 @@ public:
 		OS::String charset = params >= 3 ? os->toString(-params+2) : getDefaultCharset(os);
 
 		Core::Buffer out(os);
-		if(Internal::substr(os, out, str, start, len, charset)){
+		if(Internal::substr(os, Cache::get(), out, str, start, len, charset)){
 			os->pushString(out);
 			return 1;
 		}
@@ -758,11 +915,138 @@ public:
 
 };
 
+#ifdef _MSC_VER
+DWORD IconvOS::Cache::key;
+#else
+pthread_key_t IconvOS::Cache::key;
+#endif
+
+template <> struct CtypeName<IconvOS::Converter>{ static const OS_CHAR * getName(){ return OS_TEXT("IconvConverter"); } };
+template <> struct CtypeValue<IconvOS::Converter*>: public CtypeUserClass<IconvOS::Converter*>{};
+template <> struct UserDataDestructor<IconvOS::Converter>
+{
+	static void dtor(ObjectScript::OS * os, void * data, void * user_param)
+	{
+		IconvOS::Converter * conv = (IconvOS::Converter*)data;
+		conv->~Converter();
+		os->free(conv);
+	}
+};
+
+void IconvOS::Converter::initExtension(OS * os)
+{
+	struct Lib
+	{
+		static void triggerConvertError(OS * os, Converter * self)
+		{
+			switch(errno){
+			case EINVAL:
+				os->setException(OS_TEXT("iconv error: incomplete char at the end of data"));
+				break;
+
+			case EILSEQ:
+				os->setException(OS_TEXT("iconv error: illegal seq"));
+				break;
+
+			default:
+				os->setException(OS_TEXT("iconv error"));
+			}
+			self->reset();
+		}
+
+		/* proto IconvConverter(string in_charset, string out_charset) */
+		static int __newinstance(OS * os, int params, int, int, void * user_param)
+		{
+			if(params < 2){
+				os->setException(OS_TEXT("in_charset and out_charset are required"));
+				return 0;
+			}
+			OS::String in_charset = os->toString(-params+0);
+			OS::String out_charset = os->toString(-params+1);
+			Converter * conv = new (os->malloc(sizeof(Converter) OS_DBG_FILEPOS)) Converter(out_charset.toChar(), in_charset.toChar());
+			if(!conv->isValid()){
+				int saved_errno = errno;
+				conv->~Converter();
+				os->free(conv);
+				os->setException(saved_errno == EINVAL ? OS_TEXT("iconv wrong charset") : OS_TEXT("iconv error converter"));
+				return 0;
+			}
+			pushCtypeValue(os, conv);
+			return 1;
+		}
+
+		/* proto string write(string chunk)
+		   Converts chunk, returns converted data available so far */
+		static int write(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Converter*);
+			OS::String chunk = params >= 1 ? os->toString(-params+0) : OS::String(os);
+			Core::Buffer out(os);
+			if(!self->write(out, chunk.toChar(), chunk.getLen())){
+				triggerConvertError(os, self);
+				return 0;
+			}
+			os->pushString(out);
+			return 1;
+		}
+
+		/* proto string finish([string chunk])
+		   Returns the rest of converted data, triggers error if the last char is not complete,
+		   converter is ready for the next data then */
+		static int finish(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Converter*);
+			OS::String chunk = params >= 1 ? os->toString(-params+0) : OS::String(os);
+			Core::Buffer out(os);
+			if(!self->write(out, chunk.toChar(), chunk.getLen()) || !self->finish(out)){
+				triggerConvertError(os, self);
+				return 0;
+			}
+			self->reset();
+			os->pushString(out);
+			return 1;
+		}
+
+		static int reset(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Converter*);
+			self->reset();
+			return 0;
+		}
+
+		static int getTotalIn(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Converter*);
+			os->pushNumber((OS_NUMBER)self->total_in);
+			return 1;
+		}
+
+		static int getTotalOut(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Converter*);
+			os->pushNumber((OS_NUMBER)self->total_out);
+			return 1;
+		}
+	};
+
+	OS::FuncDef funcs[] = {
+		{OS_TEXT("__newinstance"), Lib::__newinstance, NULL},
+		{OS_TEXT("write"), Lib::write, NULL},
+		{OS_TEXT("finish"), Lib::finish, NULL},
+		{OS_TEXT("reset"), Lib::reset, NULL},
+		{OS_TEXT("__get@totalIn"), Lib::getTotalIn, NULL},
+		{OS_TEXT("__get@totalOut"), Lib::getTotalOut, NULL},
+		{}
+	};
+
+	registerUserClass<Converter>(os, funcs);
+}
+
 void initIconvExtension(OS * os)
 {
 	{
 		OS::FuncDef funcs[] = {
-			{OS_TEXT("iconv"), &IconvOS::convert},
+			{OS_TEXT("iconv"), &IconvOS::convert, NULL},
 			{}
 		};
 		os->pushGlobals();
@@ -772,9 +1056,9 @@ void initIconvExtension(OS * os)
 	{
 		os->getGlobal(OS_TEXT("String"));
 		OS::FuncDef funcs[] = {
-			{OS_TEXT("lenIconv"), &IconvOS::len},
-			{OS_TEXT("subIconv"), &IconvOS::sub},
-			{OS_TEXT("findIconv"), &IconvOS::find},
+			{OS_TEXT("lenIconv"), &IconvOS::len, NULL},
+			{OS_TEXT("subIconv"), &IconvOS::sub, NULL},
+			{OS_TEXT("findIconv"), &IconvOS::find, NULL},
 			{}
 		};
 		os->setFuncs(funcs);
@@ -784,6 +1068,7 @@ void initIconvExtension(OS * os)
 		os->pushString(OS_TEXT("utf-8"));
 		os->setProperty(OS_TEXT("defaultCharset"));
 	}
+	IconvOS::Converter::initExtension(os);
 }
 
 } // namespace ObjectScript
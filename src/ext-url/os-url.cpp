@@ -12,48 +12,174 @@ class UrlOS: public OS
 {
 public:
 
-	static int decodeHexChar(OS_CHAR c)
+	enum {
+		URL_CHAR_ESCAPE,
+		URL_CHAR_SAFE,
+		URL_CHAR_SPACE
+	};
+
+	static const OS_BYTE * getEncodeTable()
 	{
-		if(c >= '0' && c <= '9') return      c - '0';
-		if(c >= 'A' && c <= 'F') return 10 + c - 'A';
-		if(c >= 'a' && c <= 'f') return 10 + c - 'a';
-		return 0;
+		// 0-9, A-Z, a-z, '-', '_', '.', '~' are safe, space is encoded as '+'
+		static const OS_BYTE table[256] = {
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			2,0,0,0,0,0,0,0,0,0,0,0,0,1,1,0,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,
+			0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,1,
+			0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,0,0,1,0,
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+		};
+		return table;
+	}
+
+	static const OS_BYTE * getHexTable()
+	{
+		// not hex chars are decoded as 0
+		static const OS_BYTE table[256] = {
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,2,3,4,5,6,7,8,9,0,0,0,0,0,0,
+			0,10,11,12,13,14,15,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			0,10,11,12,13,14,15,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+			0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+		};
+		return table;
+	}
+
+	static int getEncodedLen(const OS_BYTE * s, int len)
+	{
+		const OS_BYTE * table = getEncodeTable();
+		int out_len = len;
+		for(int i = 0; i < len; i++){
+			if(table[s[i]] == URL_CHAR_ESCAPE){
+				out_len += 2;
+			}
+		}
+		return out_len;
+	}
+
+	// out should have getEncodedLen bytes
+	static int encodeBuffer(const OS_BYTE * s, int len, OS_BYTE * out)
+	{
+		const OS_BYTE * table = getEncodeTable();
+		const OS_BYTE * end = s + len;
+		OS_BYTE * start = out;
+		for(;;){
+			const OS_BYTE * run = s;
+			while(s < end && table[*s] == URL_CHAR_SAFE){
+				s++;
+			}
+			if(s > run){
+				OS_MEMCPY(out, run, s - run);
+				out += s - run;
+			}
+			if(s >= end){
+				break;
+			}
+			if(table[*s] == URL_CHAR_SPACE){
+				*out++ = '+';
+			}else{
+				out[0] = '%';
+				out[1] = "0123456789ABCDEF"[*s >> 4];
+				out[2] = "0123456789ABCDEF"[*s & 0xf];
+				out += 3;
+			}
+			s++;
+		}
+		return (int)(out - start);
 	}
 
-	static OS_CHAR decodeHexCode(const OS_CHAR * s)
+	// out should have len bytes, result is never longer than source
+	static int decodeBuffer(const OS_BYTE * s, int len, OS_BYTE * out)
 	{
-		// OS_ASSERT(s[0] && s[1]);
-		int c = decodeHexChar(s[0]) * 16 + decodeHexChar(s[1]);
-		return (OS_CHAR)c;
+		const OS_BYTE * hex = getHexTable();
+		const OS_BYTE * end = s + len;
+		OS_BYTE * start = out;
+		for(;;){
+			const OS_BYTE * run = s;
+			while(s < end && *s != '%' && *s != '+'){
+				s++;
+			}
+			if(s > run){
+				OS_MEMCPY(out, run, s - run);
+				out += s - run;
+			}
+			if(s >= end){
+				break;
+			}
+			if(*s == '+'){
+				*out++ = ' ';
+				s++;
+			}else{
+				if(s+3 <= end){
+					*out++ = (OS_BYTE)(hex[s[1]] * 16 + hex[s[2]]);
+				}
+				s += 3;
+			}
+		}
+		return (int)(out - start);
+	}
+
+	static String decodeString(OS * os, Core::Buffer& buf, const OS_BYTE * s, int len)
+	{
+		buf.reserveCapacity(len);
+		return String(os, (const OS_CHAR*)buf.buffer.buf, decodeBuffer(s, len, buf.buffer.buf));
+	}
+
+	// name=value pairs are decoded and set to object at the top of stack,
+	// names like a[b][] or a.b make nested objects
+	static void parseQueryBuffer(OS * os, const OS_BYTE * s, int len, const OS_CHAR * separators)
+	{
+		bool is_separator[256] = {};
+		for(; *separators; separators++){
+			is_separator[(OS_BYTE)*separators] = true;
+		}
+		Core::Buffer buf(os);
+		const OS_BYTE * end = s + len;
+		while(s < end){
+			const OS_BYTE * pair = s;
+			while(s < end && !is_separator[*s]){
+				s++;
+			}
+			const OS_BYTE * pair_end = s;
+			if(s < end){
+				s++;
+			}
+			while(pair < pair_end && *pair == ' '){
+				pair++;
+			}
+			const OS_BYTE * assign = (const OS_BYTE*)memchr(pair, '=', pair_end - pair);
+			const OS_BYTE * name_end = assign ? assign : pair_end;
+			if(name_end == pair){
+				continue;
+			}
+			String name = decodeString(os, buf, pair, (int)(name_end - pair));
+			os->pushStackValue();
+			if(assign){
+				os->pushString(decodeString(os, buf, assign + 1, (int)(pair_end - assign - 1)));
+			}else{
+				os->pushString(OS_TEXT(""));
+			}
+			if(!os->setSmartProperty(name)){
+				os->pop();
+			}
+		}
 	}
 
 	static int encode(OS * os, int params, int, int, void*)
 	{
 		if(params >= 1){
 			String str = os->toString(-params+0);
-			const OS_CHAR * s = str;
-			const OS_CHAR * end = s + str.getLen();
-			
+			const OS_BYTE * s = (const OS_BYTE*)str.toChar();
+			int len = str.getDataSize();
+
 			Core::Buffer buf(os);
-			for(; s < end; s++){
-				if( (*s >= OS_TEXT('0') && *s <= OS_TEXT('9'))
-					|| (*s >= OS_TEXT('A') && *s <= OS_TEXT('Z'))
-					|| (*s >= OS_TEXT('a') && *s <= OS_TEXT('z')) 
-					|| *s == OS_TEXT('-') || *s == OS_TEXT('_')
-					|| *s == OS_TEXT('.') || *s == OS_TEXT('~')
-					// || *s == OS_TEXT('!') || *s == OS_TEXT('*')
-					// || *s == OS_TEXT('\'')|| *s == OS_TEXT('(') || *s == OS_TEXT(')')
-					)
-				{
-					buf.append(*s);
-				}else if(*s == OS_TEXT(' ')){
-					buf.append(OS_TEXT('+'));
-				}else{
-					buf.append(OS_TEXT('%'));
-					buf.append(OS_TEXT("0123456789ABCDEF")[((OS_BYTE)(*s) >> 4) & 0xf]);
-					buf.append(OS_TEXT("0123456789ABCDEF")[((OS_BYTE)(*s) >> 0) & 0xf]);
-				}
-			}
+			buf.reserveCapacity(getEncodedLen(s, len));
+			buf.buffer.count = encodeBuffer(s, len, buf.buffer.buf);
 			os->pushString(buf);
 			return 1;
 		}
@@ -64,35 +190,41 @@ public:
 	{
 		if(params >= 1){
 			String str = os->toString(-params+0);
-			const OS_CHAR * s = str;
-			const OS_CHAR * end = s + str.getLen();
-			
+			const OS_BYTE * s = (const OS_BYTE*)str.toChar();
+			int len = str.getDataSize();
+
 			Core::Buffer buf(os);
-			for(; s < end;){
-				if(*s == OS_TEXT('%')){
-					if(s+3 <= end){
-						buf.append(decodeHexCode(s+1));
-					}
-					s += 3;
-				}else if(*s == OS_TEXT('+')){
-					buf.append(OS_TEXT(' '));
-					s++;
-				}else{
-					buf.append(*s++);
-				}
-			}
+			buf.reserveCapacity(len);
+			buf.buffer.count = decodeBuffer(s, len, buf.buffer.buf);
 			os->pushString(buf);
 			return 1;
 		}
 		return 0;
 	}
+
+	/* proto object parseQuery(string query[, string separators = "&"])
+	   returns object of decoded name=value pairs */
+	static int parseQuery(OS * os, int params, int, int, void*)
+	{
+		String str = params >= 1 ? os->toString(-params+0) : String(os);
+		String separators = params >= 2 ? os->toString(-params+1) : String(os, OS_TEXT("&"));
+		os->newObject();
+		parseQueryBuffer(os, (const OS_BYTE*)str.toChar(), str.getDataSize(), separators);
+		return 1;
+	}
 };
 
+void parseUrlQuery(OS * os, const void * str, int size, const OS_CHAR * separators)
+{
+	UrlOS::parseQueryBuffer(os, (const OS_BYTE*)str, size, separators);
+}
+
 void initUrlExtension(OS * os)
 {
 	OS::FuncDef funcs[] = {
 		{OS_TEXT("encode"), &UrlOS::encode},
 		{OS_TEXT("decode"), &UrlOS::decode},
+		{OS_TEXT("parseQuery"), &UrlOS::parseQuery},
 		{}
 	};
 	os->getModule("url");
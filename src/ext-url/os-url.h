@@ -38,6 +38,10 @@ namespace ObjectScript {
 	*/
 	void initUrlExtension(OS* os);
 
+	// decodes name=value pairs and sets them to object at the top of stack,
+	// separators are "&" for query string or ";" for cookies
+	void parseUrlQuery(OS * os, const void * str, int size, const OS_CHAR * separators = OS_TEXT("&"));
+
 };
 
 #endif // __OS_EXT_URL_H__
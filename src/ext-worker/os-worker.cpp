@@ -0,0 +1,475 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#include <Windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#include <errno.h>
+#endif
+
+#include "os-worker.h"
+#include "../objectscript.h"
+#include "../os-binder.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace ObjectScript {
+
+/*
+	Every worker runs own OS instance in separated thread, so instances
+	never share GC values. Message is serialized by sender into single
+	malloc'ed block and the block itself is passed to receiver through
+	channel, receiver restores values directly from the block.
+*/
+struct WorkerMessage
+{
+	WorkerMessage * next;
+	int size;
+
+	char * getData(){ return (char*)(this + 1); }
+};
+
+class WorkerChannel
+{
+#ifdef _MSC_VER
+	CRITICAL_SECTION cs;
+	CONDITION_VARIABLE cond;
+
+	void lock(){ EnterCriticalSection(&cs); }
+	void unlock(){ LeaveCriticalSection(&cs); }
+	void signal(){ WakeAllConditionVariable(&cond); }
+	bool wait(int timeout_ms)
+	{
+		return SleepConditionVariableCS(&cond, &cs, timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms) != 0;
+	}
+#else
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	void lock(){ pthread_mutex_lock(&mutex); }
+	void unlock(){ pthread_mutex_unlock(&mutex); }
+	void signal(){ pthread_cond_broadcast(&cond); }
+	bool wait(int timeout_ms)
+	{
+		if(timeout_ms < 0){
+			return pthread_cond_wait(&cond, &mutex) == 0;
+		}
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		struct timespec until;
+		long long usec = (long long)now.tv_usec + (long long)timeout_ms * 1000;
+		until.tv_sec = now.tv_sec + (time_t)(usec / 1000000);
+		until.tv_nsec = (long)(usec % 1000000) * 1000;
+		return pthread_cond_timedwait(&cond, &mutex, &until) != ETIMEDOUT;
+	}
+#endif
+
+	WorkerMessage * first, * last;
+	int count;
+	bool closed;
+
+public:
+
+	WorkerChannel()
+	{
+#ifdef _MSC_VER
+		InitializeCriticalSection(&cs);
+		InitializeConditionVariable(&cond);
+#else
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&cond, NULL);
+#endif
+		first = last = NULL;
+		count = 0;
+		closed = false;
+	}
+
+	~WorkerChannel()
+	{
+		while(first){
+			WorkerMessage * next = first->next;
+			::free(first);
+			first = next;
+		}
+#ifdef _MSC_VER
+		DeleteCriticalSection(&cs);
+#else
+		pthread_cond_destroy(&cond);
+		pthread_mutex_destroy(&mutex);
+#endif
+	}
+
+	// returns false if channel is closed, message is not owned by channel in this case
+	bool push(WorkerMessage * msg)
+	{
+		lock();
+		if(closed){
+			unlock();
+			return false;
+		}
+		msg->next = NULL;
+		if(last) last->next = msg; else first = msg;
+		last = msg;
+		count++;
+		signal();
+		unlock();
+		return true;
+	}
+
+	// timeout_ms < 0 - wait until message is received or channel is closed, 0 - don't wait
+	WorkerMessage * pop(int timeout_ms)
+	{
+		lock();
+		while(!first && !closed && timeout_ms != 0){
+			if(!wait(timeout_ms) && timeout_ms > 0){
+				break;
+			}
+		}
+		WorkerMessage * msg = first;
+		if(msg){
+			first = msg->next;
+			if(!first) last = NULL;
+			count--;
+		}
+		unlock();
+		return msg;
+	}
+
+	void close()
+	{
+		lock();
+		closed = true;
+		signal();
+		unlock();
+	}
+
+	bool isClosed()
+	{
+		lock();
+		bool r = closed && !first;
+		unlock();
+		return r;
+	}
+
+	int getCount()
+	{
+		lock();
+		int r = count;
+		unlock();
+		return r;
+	}
+};
+
+struct WorkerShared
+{
+	WorkerChannel to_worker;
+	WorkerChannel to_parent;
+	char * filename;
+	OS * (*create_os)();
+#ifdef _MSC_VER
+	HANDLE thread;
+	volatile LONG ref_count;
+	volatile LONG running;
+
+	void retain(){ InterlockedIncrement(&ref_count); }
+	void release(){ if(InterlockedDecrement(&ref_count) == 0) destroy(); }
+	void setRunning(bool value){ InterlockedExchange(&running, value); }
+	bool isRunning(){ return InterlockedCompareExchange(&running, 0, 0) != 0; }
+#else
+	pthread_t thread;
+	volatile int ref_count;
+	volatile int running;
+
+	void retain(){ __sync_add_and_fetch(&ref_count, 1); }
+	void release(){ if(__sync_sub_and_fetch(&ref_count, 1) == 0) destroy(); }
+	void setRunning(bool value){ __sync_lock_test_and_set(&running, value); }
+	bool isRunning(){ return __sync_add_and_fetch(&running, 0) != 0; }
+#endif
+	bool started;
+	bool joined;
+
+	static WorkerShared * create(const char * filename, OS * (*create_os)())
+	{
+		WorkerShared * shared = new (::malloc(sizeof(WorkerShared))) WorkerShared();
+		int len = (int)strlen(filename);
+		shared->filename = (char*)::malloc(len + 1);
+		memcpy(shared->filename, filename, len + 1);
+		shared->create_os = create_os;
+		shared->ref_count = 1;
+		shared->running = 0;
+		shared->started = shared->joined = false;
+		return shared;
+	}
+
+	void destroy()
+	{
+		::free(filename);
+		this->~WorkerShared();
+		::free(this);
+	}
+};
+
+class WorkerOS: public OS
+{
+public:
+
+	static OS * (*create_os)();
+
+	/*
+		Worker is script side handle of shared data, parent OS has handle
+		created by Worker(filename), worker OS has the same one as global
+		'worker' but channels are swapped
+	*/
+	struct Worker
+	{
+		WorkerShared * shared;
+		bool is_parent;
+
+		Worker(WorkerShared * p_shared, bool p_is_parent)
+		{
+			shared = p_shared;
+			is_parent = p_is_parent;
+			shared->retain();
+		}
+
+		~Worker()
+		{
+			getOutput()->close();
+			if(is_parent){
+				detach();
+			}
+			shared->release();
+		}
+
+		WorkerChannel * getInput(){ return is_parent ? &shared->to_parent : &shared->to_worker; }
+		WorkerChannel * getOutput(){ return is_parent ? &shared->to_worker : &shared->to_parent; }
+
+		bool start()
+		{
+			shared->retain();
+			shared->setRunning(true);
+#ifdef _MSC_VER
+			shared->thread = (HANDLE)_beginthreadex(NULL, 0, threadFunc, shared, 0, NULL);
+			shared->started = shared->thread != NULL;
+#else
+			shared->started = pthread_create(&shared->thread, NULL, threadFunc, shared) == 0;
+#endif
+			if(!shared->started){
+				shared->setRunning(false);
+				shared->release();
+			}
+			return shared->started;
+		}
+
+		void join()
+		{
+			if(shared->started && !shared->joined){
+#ifdef _MSC_VER
+				WaitForSingleObject(shared->thread, INFINITE);
+				CloseHandle(shared->thread);
+#else
+				pthread_join(shared->thread, NULL);
+#endif
+				shared->joined = true;
+			}
+		}
+
+		// unreachable worker must not block GC of parent so thread is finished independently
+		void detach()
+		{
+			if(shared->started && !shared->joined){
+#ifdef _MSC_VER
+				CloseHandle(shared->thread);
+#else
+				pthread_detach(shared->thread);
+#endif
+				shared->joined = true;
+			}
+		}
+
+		static void run(WorkerShared * shared)
+		{
+			OS * os = shared->create_os ? shared->create_os() : OS::create();
+			if(!shared->create_os){
+				initWorkerExtension(os, NULL);
+			}
+			os->pushGlobals();
+			os->pushString(OS_TEXT("worker"));
+			pushCtypeValue(os, new (os->malloc(sizeof(Worker) OS_DBG_FILEPOS)) Worker(shared, false));
+			os->setProperty();
+
+			os->require(shared->filename, true);
+			os->release();
+		}
+
+#ifdef _MSC_VER
+		static unsigned __stdcall threadFunc(void * p)
+#else
+		static void * threadFunc(void * p)
+#endif
+		{
+			WorkerShared * shared = (WorkerShared*)p;
+			run(shared);
+			// parent should not wait for messages of finished worker
+			shared->to_parent.close();
+			shared->setRunning(false);
+			shared->release();
+			return 0;
+		}
+	};
+
+	static WorkerMessage * newMessage(OS * p_os, int offs)
+	{
+		WorkerOS * os = (WorkerOS*)p_os;
+		Core::ValueSerializer serializer(os->core);
+		if(!serializer.serialize(os->core->getStackValue(offs))){
+			return NULL;
+		}
+		int size = serializer.writer.buffer.count;
+		WorkerMessage * msg = (WorkerMessage*)::malloc(sizeof(WorkerMessage) + size + 1);
+		if(msg){
+			msg->next = NULL;
+			msg->size = size;
+			memcpy(msg->getData(), serializer.writer.buffer.buf, size);
+			msg->getData()[size] = '\0';
+		}
+		return msg;
+	}
+
+	static void pushMessage(OS * p_os, WorkerMessage * msg)
+	{
+		WorkerOS * os = (WorkerOS*)p_os;
+		Core::ValueUnserializer unserializer(os->core, msg->getData(), msg->size);
+		if(!unserializer.unserialize()){
+			os->pushNull();
+		}
+		::free(msg);
+	}
+
+	static void initExtension(OS * os);
+};
+
+OS * (*WorkerOS::create_os)() = NULL;
+
+template <> struct CtypeName<WorkerOS::Worker>{ static const OS_CHAR * getName(){ return OS_TEXT("Worker"); } };
+template <> struct CtypeValue<WorkerOS::Worker*>: public CtypeUserClass<WorkerOS::Worker*>{};
+template <> struct UserDataDestructor<WorkerOS::Worker>
+{
+	static void dtor(ObjectScript::OS * os, void * data, void * user_param)
+	{
+		WorkerOS::Worker * worker = (WorkerOS::Worker*)data;
+		worker->~Worker();
+		os->free(worker);
+	}
+};
+
+void WorkerOS::initExtension(OS * os)
+{
+	struct Lib
+	{
+		static Worker * __newinstance(OS * os, const OS::String& filename)
+		{
+			OS::String resolved_filename = os->resolvePath(filename);
+			if(resolved_filename.isEmpty()){
+				os->setException(OS::String(os, OS_TEXT("worker file is not found: ")) + filename);
+				return NULL;
+			}
+			WorkerShared * shared = WorkerShared::create(resolved_filename.toChar(), WorkerOS::create_os);
+			Worker * worker = new (os->malloc(sizeof(Worker) OS_DBG_FILEPOS)) Worker(shared, true);
+			shared->release();
+			if(!worker->start()){
+				worker->~Worker();
+				os->free(worker);
+				os->setException(OS_TEXT("error create worker thread"));
+				return NULL;
+			}
+			return worker;
+		}
+
+		static int postMessage(OS * os, int params, int, int, void*)
+		{
+			OS_GET_SELF(Worker*);
+			if(params < 1) return 0;
+			WorkerMessage * msg = newMessage(os, -params+0);
+			bool sent = msg && self->getOutput()->push(msg);
+			if(msg && !sent){
+				::free(msg);
+			}
+			os->pushBool(sent);
+			return 1;
+		}
+
+		static int getMessage(OS * os, int params, int, int, void*)
+		{
+			OS_GET_SELF(Worker*);
+			int timeout_ms = params > 0 && !os->isNull(-params+0) ? (int)(os->toNumber(-params+0) * 1000) : -1;
+			WorkerMessage * msg = self->getInput()->pop(timeout_ms);
+			if(!msg){
+				return 0;
+			}
+			pushMessage(os, msg);
+			return 1;
+		}
+
+		static int close(OS * os, int params, int, int, void*)
+		{
+			OS_GET_SELF(Worker*);
+			self->getOutput()->close();
+			return 0;
+		}
+
+		static int join(OS * os, int params, int, int, void*)
+		{
+			OS_GET_SELF(Worker*);
+			if(self->is_parent){
+				self->join();
+			}
+			return 0;
+		}
+
+		static int getRunning(OS * os, int params, int, int, void*)
+		{
+			OS_GET_SELF(Worker*);
+			os->pushBool(self->shared->isRunning());
+			return 1;
+		}
+
+		static int getClosed(OS * os, int params, int, int, void*)
+		{
+			OS_GET_SELF(Worker*);
+			os->pushBool(self->getInput()->isClosed());
+			return 1;
+		}
+
+		static int getPending(OS * os, int params, int, int, void*)
+		{
+			OS_GET_SELF(Worker*);
+			os->pushNumber(self->getInput()->getCount());
+			return 1;
+		}
+	};
+
+	OS::FuncDef funcs[] = {
+		def(OS_TEXT("__newinstance"), Lib::__newinstance),
+		{OS_TEXT("postMessage"), Lib::postMessage, NULL},
+		{OS_TEXT("getMessage"), Lib::getMessage, NULL},
+		{OS_TEXT("close"), Lib::close, NULL},
+		{OS_TEXT("join"), Lib::join, NULL},
+		{OS_TEXT("__get@running"), Lib::getRunning, NULL},
+		{OS_TEXT("__get@closed"), Lib::getClosed, NULL},
+		{OS_TEXT("__get@pending"), Lib::getPending, NULL},
+		{}
+	};
+	registerUserClass<Worker>(os, funcs);
+}
+
+void initWorkerExtension(OS * os, OS * (*create_os)())
+{
+	if(create_os){
+		WorkerOS::create_os = create_os;
+	}
+	WorkerOS::initExtension(os);
+}
+
+} // namespace ObjectScript
@@ -13,6 +13,8 @@
 #define ZLIB_ENCODING_DEFLATE	0x0f
 #define ZLIB_ENCODING_ANY		0x2f
 
+#define ZLIB_STREAM_CHUNK_SIZE	(1024*16)
+
 #define ZLIB_BUFFER_SIZE_GUESS(in_len) (((size_t) ((double) in_len * (double) 1.015)) + 10 + 8 + 4 + 1)
 
 namespace ObjectScript {
@@ -236,8 +238,394 @@ retry_raw_inflate:
 	{
 		return decodeInternal(os, params, ZLIB_ENCODING_DEFLATE);
 	}
+
+	/*
+		stream classes keep z_stream alive between calls, so data is processed
+		by chunks and every call returns output produced for its chunk only
+	*/
+	struct Stream
+	{
+		z_stream Z;
+		int encoding;
+		int status;
+
+		Stream(int p_encoding)
+		{
+			memset(&Z, 0, sizeof(z_stream));
+			encoding = p_encoding;
+			status = Z_OK;
+		}
+
+		// runs func till output buffer is not filled up, output is appended to out
+		template <class F> void process(OS::Core::Buffer& out, const void * buf, int size, int flush, F func)
+		{
+			Z.next_in = (Bytef*)buf;
+			Z.avail_in = size;
+			do{
+				int buf_free = out.buffer.capacity - out.buffer.count;
+				if(buf_free < ZLIB_STREAM_CHUNK_SIZE){
+					out.reserveCapacity(out.buffer.count + ZLIB_STREAM_CHUNK_SIZE);
+					buf_free = out.buffer.capacity - out.buffer.count;
+				}
+				Z.next_out = (Bytef*)out.buffer.buf + out.buffer.count;
+				Z.avail_out = buf_free;
+				status = func(&Z, flush);
+				out.buffer.count += buf_free - Z.avail_out;
+			}while(Z.avail_out == 0 && status == Z_OK);
+		}
+	};
+
+	struct Deflate: public Stream
+	{
+		int level;
+
+		Deflate(int p_level, int p_encoding): Stream(p_encoding)
+		{
+			level = p_level;
+			status = deflateInit2(&Z, level, Z_DEFLATED, encoding, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+		}
+
+		~Deflate()
+		{
+			deflateEnd(&Z);
+		}
+
+		bool write(OS::Core::Buffer& out, const void * buf, int size, int flush)
+		{
+			if(status == Z_STREAM_END){
+				// previous data is finished, totals are kept till the next data
+				status = deflateReset(&Z);
+			}
+			if(status != Z_OK){
+				return false;
+			}
+			process(out, buf, size, flush, deflate);
+			if(status == Z_BUF_ERROR){
+				// there is nothing to flush
+				status = Z_OK;
+			}
+			return status == Z_OK || status == Z_STREAM_END;
+		}
+
+		static void initExtension(OS * os);
+	};
+
+	struct Inflate: public Stream
+	{
+		bool retry_raw;
+		// input consumed while header is not checked yet, it's replayed if raw data is detected
+		Bytef head[2];
+		int head_len;
+
+		Inflate(int p_encoding): Stream(p_encoding)
+		{
+			retry_raw = encoding == ZLIB_ENCODING_ANY;
+			head_len = 0;
+			status = inflateInit2(&Z, encoding);
+		}
+
+		~Inflate()
+		{
+			inflateEnd(&Z);
+		}
+
+		bool write(OS::Core::Buffer& out, const void * buf, int size)
+		{
+			if(status == Z_STREAM_END){
+				// data after end of stream is ignored
+				return true;
+			}
+			if(status != Z_OK){
+				return false;
+			}
+			if(size <= 0){
+				return true;
+			}
+			process(out, buf, size, Z_NO_FLUSH, inflate);
+			if(status == Z_DATA_ERROR && retry_raw && Z.total_out == 0){
+				// raw deflated data? restart with input consumed so far
+				retry_raw = false;
+				inflateEnd(&Z);
+				memset(&Z, 0, sizeof(z_stream));
+				if((status = inflateInit2(&Z, ZLIB_ENCODING_RAW)) != Z_OK){
+					return false;
+				}
+				if(head_len > 0){
+					process(out, head, head_len, Z_NO_FLUSH, inflate);
+				}
+				if(status == Z_OK){
+					process(out, buf, size, Z_NO_FLUSH, inflate);
+				}
+			}
+			if(status == Z_BUF_ERROR){
+				// all of input is consumed
+				status = Z_OK;
+			}
+			if(retry_raw){
+				// zlib and gzip headers are recognized by the first two bytes
+				if(Z.total_in >= 2 || Z.total_out > 0){
+					retry_raw = false;
+				}else{
+					memcpy(head + head_len, buf, Z.total_in - head_len);
+					head_len = (int)Z.total_in;
+				}
+			}
+			return status == Z_OK || status == Z_STREAM_END;
+		}
+
+		void reset()
+		{
+			retry_raw = encoding == ZLIB_ENCODING_ANY;
+			head_len = 0;
+			inflateEnd(&Z);
+			memset(&Z, 0, sizeof(z_stream));
+			status = inflateInit2(&Z, encoding);
+		}
+
+		static void initExtension(OS * os);
+	};
+};
+
+template <> struct CtypeName<ZlibOS::Deflate>{ static const OS_CHAR * getName(){ return OS_TEXT("ZlibDeflate"); } };
+template <> struct CtypeValue<ZlibOS::Deflate*>: public CtypeUserClass<ZlibOS::Deflate*>{};
+template <> struct UserDataDestructor<ZlibOS::Deflate>
+{
+	static void dtor(ObjectScript::OS * os, void * data, void * user_param)
+	{
+		ZlibOS::Deflate * stream = (ZlibOS::Deflate*)data;
+		stream->~Deflate();
+		os->free(stream);
+	}
+};
+
+template <> struct CtypeName<ZlibOS::Inflate>{ static const OS_CHAR * getName(){ return OS_TEXT("ZlibInflate"); } };
+template <> struct CtypeValue<ZlibOS::Inflate*>: public CtypeUserClass<ZlibOS::Inflate*>{};
+template <> struct UserDataDestructor<ZlibOS::Inflate>
+{
+	static void dtor(ObjectScript::OS * os, void * data, void * user_param)
+	{
+		ZlibOS::Inflate * stream = (ZlibOS::Inflate*)data;
+		stream->~Inflate();
+		os->free(stream);
+	}
 };
 
+void ZlibOS::Deflate::initExtension(OS * os)
+{
+	struct Lib
+	{
+		/* proto ZlibDeflate([int level = -1[, int encoding = ZlibDeflate.GZIP]]) */
+		static int __newinstance(OS * os, int params, int, int, void * user_param)
+		{
+			int level = params >= 1 ? os->toInt(-params+0, -1) : -1;
+			int encoding = params >= 2 ? os->toInt(-params+1) : ZLIB_ENCODING_GZIP;
+			if(level < -1 || level > 9){
+				triggerError(os, OS::String::format(os, "compression level (%d) must be within -1..9", level));
+				return 0;
+			}
+			if(encoding != ZLIB_ENCODING_RAW && encoding != ZLIB_ENCODING_GZIP && encoding != ZLIB_ENCODING_DEFLATE){
+				triggerError(os, "encoding mode must be either RAW, GZIP or DEFLATE");
+				return 0;
+			}
+			Deflate * stream = new (os->malloc(sizeof(Deflate) OS_DBG_FILEPOS)) Deflate(level, encoding);
+			if(stream->status != Z_OK){
+				stream->~Deflate();
+				os->free(stream);
+				triggerError(os, zError(Z_MEM_ERROR));
+				return 0;
+			}
+			pushCtypeValue(os, stream);
+			return 1;
+		}
+
+		static int writeInternal(OS * os, int params, int flush)
+		{
+			OS_GET_SELF(Deflate*);
+			OS::String chunk = params >= 1 ? os->toString(-params+0) : OS::String(os);
+			OS::Core::Buffer out(os);
+			if(!self->write(out, chunk.toChar(), chunk.getLen(), flush)){
+				triggerError(os, zError(self->status));
+				return 0;
+			}
+			os->pushString(out);
+			return 1;
+		}
+
+		/* proto binary write(binary chunk)
+		   Compress chunk, returns compressed data available so far */
+		static int write(OS * os, int params, int, int, void * user_param)
+		{
+			return writeInternal(os, params, Z_NO_FLUSH);
+		}
+
+		/* proto binary flush([binary chunk])
+		   Returns all pending compressed data, so it could be decompressed at once */
+		static int flush(OS * os, int params, int, int, void * user_param)
+		{
+			return writeInternal(os, params, Z_SYNC_FLUSH);
+		}
+
+		/* proto binary finish([binary chunk])
+		   Returns end of compressed data, stream is ready for the next data then */
+		static int finish(OS * os, int params, int, int, void * user_param)
+		{
+			return writeInternal(os, params, Z_FINISH);
+		}
+
+		static int reset(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Deflate*);
+			self->status = deflateReset(&self->Z);
+			return 0;
+		}
+
+		static int getTotalIn(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Deflate*);
+			os->pushNumber((OS_NUMBER)self->Z.total_in);
+			return 1;
+		}
+
+		static int getTotalOut(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Deflate*);
+			os->pushNumber((OS_NUMBER)self->Z.total_out);
+			return 1;
+		}
+	};
+
+	OS::FuncDef funcs[] = {
+		{OS_TEXT("__newinstance"), Lib::__newinstance, NULL},
+		{OS_TEXT("write"), Lib::write, NULL},
+		{OS_TEXT("flush"), Lib::flush, NULL},
+		{OS_TEXT("finish"), Lib::finish, NULL},
+		{OS_TEXT("reset"), Lib::reset, NULL},
+		{OS_TEXT("__get@totalIn"), Lib::getTotalIn, NULL},
+		{OS_TEXT("__get@totalOut"), Lib::getTotalOut, NULL},
+		{}
+	};
+
+	OS::NumberDef numbers[] = {
+		{OS_TEXT("RAW"), ZLIB_ENCODING_RAW},
+		{OS_TEXT("GZIP"), ZLIB_ENCODING_GZIP},
+		{OS_TEXT("DEFLATE"), ZLIB_ENCODING_DEFLATE},
+		{}
+	};
+
+	registerUserClass<Deflate>(os, funcs, numbers);
+}
+
+void ZlibOS::Inflate::initExtension(OS * os)
+{
+	struct Lib
+	{
+		/* proto ZlibInflate([int encoding = ZlibInflate.ANY]) */
+		static int __newinstance(OS * os, int params, int, int, void * user_param)
+		{
+			int encoding = params >= 1 ? os->toInt(-params+0) : ZLIB_ENCODING_ANY;
+			if(encoding != ZLIB_ENCODING_RAW && encoding != ZLIB_ENCODING_GZIP && encoding != ZLIB_ENCODING_DEFLATE && encoding != ZLIB_ENCODING_ANY){
+				triggerError(os, "encoding mode must be either RAW, GZIP, DEFLATE or ANY");
+				return 0;
+			}
+			Inflate * stream = new (os->malloc(sizeof(Inflate) OS_DBG_FILEPOS)) Inflate(encoding);
+			if(stream->status != Z_OK){
+				stream->~Inflate();
+				os->free(stream);
+				triggerError(os, zError(Z_MEM_ERROR));
+				return 0;
+			}
+			pushCtypeValue(os, stream);
+			return 1;
+		}
+
+		/* proto binary write(binary chunk)
+		   Decompress chunk, returns decompressed data available so far */
+		static int write(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Inflate*);
+			OS::String chunk = params >= 1 ? os->toString(-params+0) : OS::String(os);
+			OS::Core::Buffer out(os);
+			if(!self->write(out, chunk.toChar(), chunk.getLen())){
+				triggerError(os, zError(self->status));
+				return 0;
+			}
+			os->pushString(out);
+			return 1;
+		}
+
+		/* proto binary finish([binary chunk])
+		   Returns the rest of decompressed data, triggers error if compressed data is not complete,
+		   stream is ready for the next data then */
+		static int finish(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Inflate*);
+			OS::String chunk = params >= 1 ? os->toString(-params+0) : OS::String(os);
+			OS::Core::Buffer out(os);
+			if(!self->write(out, chunk.toChar(), chunk.getLen())){
+				triggerError(os, zError(self->status));
+				return 0;
+			}
+			if(self->status != Z_STREAM_END){
+				self->reset();
+				triggerError(os, "unexpected end of compressed data");
+				return 0;
+			}
+			self->reset();
+			os->pushString(out);
+			return 1;
+		}
+
+		static int reset(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Inflate*);
+			self->reset();
+			return 0;
+		}
+
+		static int getEnded(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Inflate*);
+			os->pushBool(self->status == Z_STREAM_END);
+			return 1;
+		}
+
+		static int getTotalIn(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Inflate*);
+			os->pushNumber((OS_NUMBER)self->Z.total_in);
+			return 1;
+		}
+
+		static int getTotalOut(OS * os, int params, int, int, void * user_param)
+		{
+			OS_GET_SELF(Inflate*);
+			os->pushNumber((OS_NUMBER)self->Z.total_out);
+			return 1;
+		}
+	};
+
+	OS::FuncDef funcs[] = {
+		{OS_TEXT("__newinstance"), Lib::__newinstance, NULL},
+		{OS_TEXT("write"), Lib::write, NULL},
+		{OS_TEXT("finish"), Lib::finish, NULL},
+		{OS_TEXT("reset"), Lib::reset, NULL},
+		{OS_TEXT("__get@ended"), Lib::getEnded, NULL},
+		{OS_TEXT("__get@totalIn"), Lib::getTotalIn, NULL},
+		{OS_TEXT("__get@totalOut"), Lib::getTotalOut, NULL},
+		{}
+	};
+
+	OS::NumberDef numbers[] = {
+		{OS_TEXT("RAW"), ZLIB_ENCODING_RAW},
+		{OS_TEXT("GZIP"), ZLIB_ENCODING_GZIP},
+		{OS_TEXT("DEFLATE"), ZLIB_ENCODING_DEFLATE},
+		{OS_TEXT("ANY"), ZLIB_ENCODING_ANY},
+		{}
+	};
+
+	registerUserClass<Inflate>(os, funcs, numbers);
+}
+
 void ZlibOS::initExtension(OS * os)
 {
 	OS::FuncDef funcs[] = {
@@ -258,6 +646,8 @@ void ZlibOS::initExtension(OS * os)
 
 void initZlibExtension(OS* os)
 {
+	ZlibOS::Deflate::initExtension(os);
+	ZlibOS::Inflate::initExtension(os);
 	ZlibOS::initExtension(os);
 }
 
@@ -11,10 +11,18 @@
 #ifndef IW_SDK
 #include <direct.h>
 #endif // IW_SDK
+#include <process.h>
+#define OS_GETPID _getpid
 #else // _MSC_VER
 #include <unistd.h>
+#define OS_GETPID getpid
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#if !defined OS_EMSCRIPTEN && !defined IW_SDK
+#include <sys/mman.h>
+#define OS_MMAP_SUPPORTED
+#endif
 #endif // _MSC_VER
 
 #ifdef OS_DEBUG
@@ -837,6 +845,72 @@ int OS::Utils::cmp(const void * buf1, int len1, const void * buf2, int len2)
 	return cmp ? cmp : len1 - len2;
 }
 
+static int findByFirstByte(const OS_BYTE * buf, int len, const OS_BYTE * search, int search_len, int start)
+{
+	const OS_BYTE * cur = buf + start;
+	const OS_BYTE * end = buf + len - search_len; // last possible match position
+	for(OS_BYTE first = search[0];;){
+		cur = (const OS_BYTE*)OS_MEMCHR(cur, first, end - cur + 1);
+		if(!cur){
+			return -1;
+		}
+		if(OS_MEMCMP(cur + 1, search + 1, search_len - 1) == 0){
+			return (int)(cur - buf);
+		}
+		if(++cur > end){
+			return -1;
+		}
+	}
+}
+
+OS::Utils::StringSearch::StringSearch(const void * p_search, int p_search_len)
+{
+	search = (const OS_BYTE*)p_search;
+	search_len = p_search_len > 0 ? p_search_len : 0;
+	if(search_len >= SKIP_TABLE_MIN_LEN){
+		int i, last = search_len - 1;
+		for(i = 0; i < 256; i++){
+			skip[i] = search_len;
+		}
+		for(i = 0; i < last; i++){
+			skip[search[i]] = last - i;
+		}
+	}
+}
+
+int OS::Utils::StringSearch::find(const void * p_buf, int len, int start) const
+{
+	if(start < 0 || search_len == 0 || len - start < search_len){
+		return -1;
+	}
+	const OS_BYTE * buf = (const OS_BYTE*)p_buf;
+	if(search_len < SKIP_TABLE_MIN_LEN){
+		return findByFirstByte(buf, len, search, search_len, start);
+	}
+	const OS_BYTE * cur = buf + start;
+	const OS_BYTE * end = buf + len - search_len;
+	int last = search_len - 1;
+	OS_BYTE last_char = search[last];
+	for(; cur <= end; cur += skip[cur[last]]){
+		if(cur[last] == last_char && OS_MEMCMP(cur, search, last) == 0){
+			return (int)(cur - buf);
+		}
+	}
+	return -1;
+}
+
+int OS::Utils::find(const void * buf, int len, const void * search, int search_len, int start)
+{
+	if(start < 0 || search_len <= 0 || len - start < search_len){
+		return -1;
+	}
+	if(search_len < StringSearch::SKIP_TABLE_MIN_LEN || len - start < 1024){
+		// don't waste time to build skip table for short one-shot search
+		return findByFirstByte((const OS_BYTE*)buf, len, (const OS_BYTE*)search, search_len, start);
+	}
+	return StringSearch(search, search_len).find(buf, len, start);
+}
+
 // =====================================================================
 // =====================================================================
 // =====================================================================
@@ -4090,6 +4164,8 @@ OS::Core::Compiler::Compiler(Tokenizer * p_tokenizer)
 	prog_filename_string_index = 0;
 	prog_max_up_count = 0;
 	prog_optimize_offs = 0;
+
+	compiled_stream = NULL;
 }
 
 OS::Core::Compiler::~Compiler()
@@ -4153,10 +4229,22 @@ bool OS::Core::Compiler::compile()
 			if(writeOpcodes(scope, exp)){
 				MemStreamWriter mem_writer(allocator);
 				saveToStream(&mem_writer);
+				if(compiled_stream){
+					compiled_stream->writeBytes(mem_writer.buffer.buf, mem_writer.buffer.count);
+				}
 
 				if(!is_eval && allocator->core->settings.create_compiled_file){
+					// the file is replaced atomically because other OS instances could map previous one,
+					// temp name is unique per process and instance so concurrent workers don't mix their writes
 					OS::String compiled_filename = allocator->getCompiledFilename(filename);
-					FileStreamWriter(allocator, compiled_filename).writeBytes(mem_writer.buffer.buf, mem_writer.buffer.count);
+					OS::String temp_filename = String::format(allocator, OS_TEXT("%s.%d.%p.tmp"), compiled_filename.toChar(), (int)OS_GETPID(), allocator);
+					FileStreamWriter(allocator, temp_filename).writeBytes(mem_writer.buffer.buf, mem_writer.buffer.count);
+#ifdef _MSC_VER
+					::remove(compiled_filename.toChar());
+#endif
+					if(::rename(temp_filename.toChar(), compiled_filename.toChar()) != 0){
+						::remove(temp_filename.toChar());
+					}
 				}
 
 				Program * prog = new (malloc(sizeof(Program) OS_DBG_FILEPOS)) Program(allocator);
@@ -10742,6 +10830,7 @@ OS::Core::FunctionDecl::FunctionDecl()
 	num_try_blocks = 0;
 	opcodes_pos = 0;
 	opcodes_size = 0;
+	decl_data_pos = -1;
 }
 
 OS::Core::FunctionDecl::~FunctionDecl()
@@ -10759,6 +10848,12 @@ OS::Core::Program::Program(OS * allocator): filename(allocator)
 	const_values = NULL;
 	num_numbers = 0;
 	num_strings = 0;
+	mapped_data = NULL;
+	mapped_size = 0;
+	bundle = NULL;
+	decl_data = NULL;
+	decl_data_size = 0;
+	string_data_pos = NULL;
 }
 
 OS::Core::Program::~Program()
@@ -10766,6 +10861,9 @@ OS::Core::Program::~Program()
 	OS_ASSERT(ref_count == 0);
 	int i;
 	for(i = 0; i < num_strings; i++){
+		if(string_data_pos[i] >= 0){
+			continue; // the string is not created
+		}
 		int j = i + num_numbers + CONST_STD_VALUES;
 		OS_ASSERT(OS_VALUE_TYPE(const_values[j]) == OS_VALUE_TYPE_STRING);
 		OS_ASSERT(dynamic_cast<GCStringValue*>(OS_VALUE_VARIANT(const_values[j]).string));
@@ -10778,10 +10876,12 @@ OS::Core::Program::~Program()
 
 	allocator->free(const_values);
 	const_values = NULL;
+	allocator->free(string_data_pos);
+	string_data_pos = NULL;
 
 	for(i = 0; i < num_functions; i++){
 		FunctionDecl * func = functions + i;
-		for(int j = 0; j < func->num_locals; j++){
+		for(int j = 0; func->locals && j < func->num_locals; j++){
 			func->locals[j].~LocalVar();
 		}
 		allocator->free(func->locals);
@@ -10793,6 +10893,22 @@ OS::Core::Program::~Program()
 	allocator->free(functions);
 	functions = NULL;
 
+	if(!mapped_data){
+		allocator->free(decl_data);
+	}
+	decl_data = NULL;
+
+	if(mapped_data){
+		// opcodes & debug info are not owned, they point to mapped data
+		opcodes.buf = NULL;
+		opcodes.count = opcodes.capacity = 0;
+		debug_info.buf = NULL;
+		debug_info.count = debug_info.capacity = 0;
+		if(!bundle){
+			allocator->unmapFile(mapped_data, mapped_size);
+		}
+		mapped_data = NULL;
+	}
 	allocator->vectorClear(opcodes);
 	allocator->vectorClear(debug_info);
 }
@@ -10804,6 +10920,7 @@ bool OS::Core::Compiler::saveToStream(StreamWriter * writer)
 	int i, len = (int)OS_STRLEN(OS_VERSION)+1;
 	writer->writeByte(len);
 	writer->writeBytes(OS_VERSION, len);
+	writer->writeByte(OS_COMPILED_FORMAT);
 
 	MemStreamWriter int_stream(allocator);
 	MemStreamWriter float_stream(allocator);
@@ -10871,16 +10988,18 @@ bool OS::Core::Compiler::saveToStream(StreamWriter * writer)
 		writer->writeUVariable(func_scope->opcodes_pos);
 		writer->writeUVariable(func_scope->opcodes_size);
 
+		// locals & try blocks are sized so loader could skip them till the function is used
+		MemStreamWriter decl_stream(allocator);
 		OS_ASSERT(func_scope->locals_compiled.count == func_scope->num_locals);
 		int j;
 		for(j = 0; j < func_scope->locals_compiled.count; j++){
 			Compiler::Scope::LocalVarCompiled& var_scope = func_scope->locals_compiled[j];
 			OS_ASSERT(var_scope.start_code_pos >= func_scope->opcodes_pos && var_scope.start_code_pos < func_scope->opcodes_pos+func_scope->opcodes_size);
 			OS_ASSERT(var_scope.end_code_pos > func_scope->opcodes_pos && var_scope.end_code_pos <= func_scope->opcodes_pos+func_scope->opcodes_size);
-			writer->writeUVariable(var_scope.cached_name_index);
-			writer->writeUVariable(var_scope.start_code_pos - func_scope->opcodes_pos);
-			writer->writeUVariable(var_scope.end_code_pos - func_scope->opcodes_pos);
-			writer->writeByte(var_scope.upvalue);
+			decl_stream.writeUVariable(var_scope.cached_name_index);
+			decl_stream.writeUVariable(var_scope.start_code_pos - func_scope->opcodes_pos);
+			decl_stream.writeUVariable(var_scope.end_code_pos - func_scope->opcodes_pos);
+			decl_stream.writeByte(var_scope.upvalue);
 		}
 		for(j = 0; j < func_scope->try_blocks.count; j++){
 			Compiler::Scope::TryBlock& t = func_scope->try_blocks[j];
@@ -10890,139 +11009,202 @@ bool OS::Core::Compiler::saveToStream(StreamWriter * writer)
 			OS_ASSERT(t.start_code_pos <= func_scope->opcodes_pos + func_scope->opcodes_size);
 			OS_ASSERT(t.end_code_pos >= func_scope->opcodes_pos);
 			OS_ASSERT(t.end_code_pos <= func_scope->opcodes_pos + func_scope->opcodes_size);
-			writer->writeUVariable(t.start_code_pos - func_scope->opcodes_pos);
-			writer->writeUVariable(t.end_code_pos - func_scope->opcodes_pos);
-			writer->writeUVariable(t.catch_var_index);
+			decl_stream.writeUVariable(t.start_code_pos - func_scope->opcodes_pos);
+			decl_stream.writeUVariable(t.end_code_pos - func_scope->opcodes_pos);
+			decl_stream.writeUVariable(t.catch_var_index);
 		}
+		writer->writeUVariable(decl_stream.buffer.count);
+		writer->writeBytes(decl_stream.buffer.buf, decl_stream.buffer.count);
 	}
 
+	for(i = writer->getPos(); i & 3; i++){
+		writer->writeByte(0);
+	}
 	for(i = 0; i < prog_opcodes.count; i++){
 		writer->writeInt32(prog_opcodes[i]);
 	}
 
 	for(i = 0; i < prog_debug_info.count; i++){
 		DebugInfoItem& item = prog_debug_info[i];
-		writer->writeUVariable(item.line);
-		writer->writeUVariable(item.pos);
+		writer->writeInt32(item.line);
+		writer->writeInt32(item.pos);
 	}
 
 	return true;
 }
 
-bool OS::Core::Program::loadFromStream(StreamReader * reader)
+bool OS::Core::Program::loadFromStream(MemStreamReader * reader)
 {
 	OS_ASSERT(!opcodes.count && !const_values && !num_numbers && !num_strings && !debug_info.count);
 
+	struct Lib
+	{
+		// every item takes item_size bytes at least so broken count is rejected before allocation
+		static bool readCount(MemStreamReader * reader, int& count, int& remaining, int item_size)
+		{
+			if(!reader->readCheckedUVariable(count) || count > remaining / item_size){
+				return false;
+			}
+			remaining -= count * item_size;
+			return true;
+		}
+
+		static bool readNumberIndex(MemStreamReader * reader, int& num_index, int num_numbers)
+		{
+			int delta;
+			if(!reader->readCheckedUVariable(delta) || delta >= num_numbers - num_index){
+				return false;
+			}
+			num_index += delta;
+			return true;
+		}
+	};
+
 	int i, len = (int)OS_STRLEN(OS_COMPILED_HEADER);
-	if(!reader->checkBytes(OS_COMPILED_HEADER, len)){
+	if(!reader->hasBytes(len) || !reader->checkBytes(OS_COMPILED_HEADER, len)){
 		return false;
 	}
 
 	len = (int)OS_STRLEN(OS_VERSION)+1;
+	if(!reader->hasBytes(len + 2)){
+		return false;
+	}
 	reader->movePos(1);
-	if(!reader->checkBytes(OS_VERSION, len)){
+	if(!reader->checkBytes(OS_VERSION, len) || reader->readByte() != OS_COMPILED_FORMAT){
 		return false;
 	}
 
-	int int_count = reader->readUVariable();
-	int float_count = reader->readUVariable();
-	int double_count = reader->readUVariable();
-	int long_double_count = reader->readUVariable();
-	num_numbers = int_count + float_count + double_count + long_double_count;
-	num_strings = reader->readUVariable();
-	num_functions = reader->readUVariable();
-	int opcodes_size = reader->readUVariable();
-	int num_debug_infos = reader->readUVariable();
+	int remaining = reader->getSize() - reader->getPos();
+	int int_count, float_count, double_count, long_double_count;
+	int strings_count, functions_count, opcodes_size, num_debug_infos;
+	int prog_filename_string_index;
+	if(!Lib::readCount(reader, int_count, remaining, 2)
+		|| !Lib::readCount(reader, float_count, remaining, 1 + (int)sizeof(float))
+		|| !Lib::readCount(reader, double_count, remaining, 1 + (int)sizeof(double))
+		|| !Lib::readCount(reader, long_double_count, remaining, 1 + (int)sizeof(long double))
+		|| !Lib::readCount(reader, strings_count, remaining, 1)
+		|| !Lib::readCount(reader, functions_count, remaining, 12)
+		|| !Lib::readCount(reader, opcodes_size, remaining, (int)sizeof(OS_U32))
+		|| !Lib::readCount(reader, num_debug_infos, remaining, (int)sizeof(DebugInfoItem))
+		|| !reader->readCheckedUVariable(prog_filename_string_index)
+		|| prog_filename_string_index >= strings_count || !functions_count || !opcodes_size)
+	{
+		return false;
+	}
 	// OS_ASSERT(!num_debug_infos || num_debug_infos == opcodes_size || num_debug_infos + 1 == opcodes_size);
-	int prog_filename_string_index = reader->readUVariable();
-	OS_ASSERT(prog_filename_string_index >= 0 && prog_filename_string_index < num_strings);
 
-	const_values = (Value*)allocator->malloc(sizeof(Value) * (num_numbers + num_strings + CONST_STD_VALUES) OS_DBG_FILEPOS);
-
-	const_values[CONST_NULL] = Value();
+	num_numbers = int_count + float_count + double_count + long_double_count;
+	const_values = (Value*)allocator->malloc(sizeof(Value) * (num_numbers + strings_count + CONST_STD_VALUES) OS_DBG_FILEPOS);
+	for(i = 0; i < num_numbers + strings_count + CONST_STD_VALUES; i++){
+		const_values[i] = Value();
+	}
 	const_values[CONST_TRUE] = Value(true);
 	const_values[CONST_FALSE] = Value(false);
 
 	int num_index = 0;
 	for(i = 0; i < int_count; i++){
-		num_index += reader->readUVariable();
-		OS_ASSERT(num_index >= 0 && num_index < num_numbers);
-		OS_NUMBER number = (OS_NUMBER)reader->readUVariable();
-		const_values[num_index + CONST_STD_VALUES] = number;
+		int number;
+		if(!Lib::readNumberIndex(reader, num_index, num_numbers) || !reader->readCheckedUVariable(number)){
+			return false;
+		}
+		const_values[num_index + CONST_STD_VALUES] = (OS_NUMBER)number;
 	}
 	for(num_index = 0, i = 0; i < float_count; i++){
-		num_index += reader->readUVariable();
-		OS_ASSERT(num_index >= 0 && num_index < num_numbers);
-		OS_NUMBER number = (OS_NUMBER)reader->readFloat();
-		const_values[num_index + CONST_STD_VALUES] = number;
+		if(!Lib::readNumberIndex(reader, num_index, num_numbers) || !reader->hasBytes(sizeof(float))){
+			return false;
+		}
+		const_values[num_index + CONST_STD_VALUES] = (OS_NUMBER)reader->readFloat();
 	}
 	for(num_index = 0, i = 0; i < double_count; i++){
-		num_index += reader->readUVariable();
-		OS_ASSERT(num_index >= 0 && num_index < num_numbers);
-		OS_NUMBER number = (OS_NUMBER)reader->readDouble();
-		const_values[num_index + CONST_STD_VALUES] = number;
+		if(!Lib::readNumberIndex(reader, num_index, num_numbers) || !reader->hasBytes(sizeof(double))){
+			return false;
+		}
+		const_values[num_index + CONST_STD_VALUES] = (OS_NUMBER)reader->readDouble();
 	}
 	for(num_index = 0, i = 0; i < long_double_count; i++){
-		num_index += reader->readUVariable();
-		OS_ASSERT(num_index >= 0 && num_index < num_numbers);
-		OS_NUMBER number = (OS_NUMBER)reader->readLongDouble();
-		const_values[num_index + CONST_STD_VALUES] = number;
+		if(!Lib::readNumberIndex(reader, num_index, num_numbers) || !reader->hasBytes(sizeof(long double))){
+			return false;
+		}
+		const_values[num_index + CONST_STD_VALUES] = (OS_NUMBER)reader->readLongDouble();
 	}
 
-	Buffer buf(allocator);
+	// string consts & function declarations are only indexed here, they are decoded on demand
+	OS_BYTE * decl_start = reader->cur;
+	int decl_start_pos = reader->getPos();
+	string_data_pos = (int*)allocator->malloc(sizeof(int) * strings_count OS_DBG_FILEPOS);
+	num_strings = strings_count;
 	for(i = 0; i < num_strings; i++){
-		int data_size = reader->readUVariable();
-		buf.reserveCapacity(data_size);
-		reader->readBytes(buf.buffer.buf, data_size);
-		buf.buffer.count = data_size;
-
-		GCStringValue * string = buf.toGCStringValue();
-		string->external_ref_count++;
-		const_values[i + num_numbers + CONST_STD_VALUES] = string;
-		buf.freeCacheStr();
+		string_data_pos[i] = reader->getPos() - decl_start_pos;
+		int data_size;
+		if(!reader->readCheckedUVariable(data_size) || !reader->hasBytes(data_size)){
+			return false;
+		}
+		reader->movePos(data_size);
 	}
-	filename = String(allocator, OS_VALUE_VARIANT(const_values[prog_filename_string_index + num_numbers + CONST_STD_VALUES]).string);
 
-	functions = (FunctionDecl*)allocator->malloc(sizeof(FunctionDecl) * num_functions OS_DBG_FILEPOS);
-	for(i = 0; i < num_functions; i++){
+	functions = (FunctionDecl*)allocator->malloc(sizeof(FunctionDecl) * functions_count OS_DBG_FILEPOS);
+	for(i = 0; i < functions_count; i++){
 		FunctionDecl * func = functions + i;
 		new (func) FunctionDecl();
+		num_functions = i + 1; // constructed declarations are destroyed by destructor if load is failed
 #ifdef OS_DEBUG
 		func->prog_func_index = i;
 #endif
-		func->prog_parent_func_index = reader->readUVariable() - 1;
-		func->stack_size = reader->readUVariable();
-		func->num_locals = reader->readUVariable();
-		func->num_params = reader->readUVariable();
-		func->max_up_count = reader->readUVariable();
-		func->func_depth = reader->readUVariable();
-		func->func_index = reader->readUVariable();
-		func->num_local_funcs = reader->readUVariable();
-		func->num_try_blocks = reader->readUVariable();
-		func->opcodes_pos = reader->readUVariable();
-		func->opcodes_size = reader->readUVariable();
-
-		func->locals = (FunctionDecl::LocalVar*)allocator->malloc(sizeof(FunctionDecl::LocalVar) * func->num_locals OS_DBG_FILEPOS);
-		int j;
-		for(j = 0; j < func->num_locals; j++){
-			int cached_name_index = reader->readUVariable();
-			OS_ASSERT(cached_name_index >= 0 && cached_name_index < num_strings);
-			FunctionDecl::LocalVar * local_var = func->locals + j;
-			OS_ASSERT(dynamic_cast<GCStringValue*>(OS_VALUE_VARIANT(const_values[cached_name_index + num_numbers + CONST_STD_VALUES]).string));
-			String var_name(allocator, OS_VALUE_VARIANT(const_values[cached_name_index + num_numbers + CONST_STD_VALUES]).string);
-			new (local_var) FunctionDecl::LocalVar(var_name);
-			local_var->start_code_pos = reader->readUVariable() + func->opcodes_pos;
-			local_var->end_code_pos = reader->readUVariable() + func->opcodes_pos;
-			local_var->upvalue = reader->readByte() ? true : false;
+		int parent_func_index;
+		if(!reader->readCheckedUVariable(parent_func_index)
+			|| !reader->readCheckedUVariable(func->stack_size)
+			|| !reader->readCheckedUVariable(func->num_locals)
+			|| !reader->readCheckedUVariable(func->num_params)
+			|| !reader->readCheckedUVariable(func->max_up_count)
+			|| !reader->readCheckedUVariable(func->func_depth)
+			|| !reader->readCheckedUVariable(func->func_index)
+			|| !reader->readCheckedUVariable(func->num_local_funcs)
+			|| !reader->readCheckedUVariable(func->num_try_blocks)
+			|| !reader->readCheckedUVariable(func->opcodes_pos)
+			|| !reader->readCheckedUVariable(func->opcodes_size)
+			|| parent_func_index > functions_count || func->num_params > func->num_locals
+			|| func->opcodes_pos > opcodes_size || func->opcodes_size > opcodes_size - func->opcodes_pos)
+		{
+			return false;
 		}
+		func->prog_parent_func_index = parent_func_index - 1;
 
-		func->try_blocks = (FunctionDecl::TryBlock*)allocator->malloc(sizeof(FunctionDecl::TryBlock) * func->num_try_blocks OS_DBG_FILEPOS);
-		for(j = 0; j < func->num_try_blocks; j++){
-			FunctionDecl::TryBlock * try_block = func->try_blocks + j;
-			try_block->start_code_pos = reader->readUVariable() + func->opcodes_pos;
-			try_block->end_code_pos = reader->readUVariable() + func->opcodes_pos;
-			try_block->catch_var_index = reader->readUVariable();
+		int decl_size;
+		if(!reader->readCheckedUVariable(decl_size) || !reader->hasBytes(decl_size)){
+			return false;
+		}
+		func->decl_data_pos = reader->getPos() - decl_start_pos;
+		// locals & try blocks are decoded on demand, so broken ones fail the load here rather than the call
+		MemStreamReader decl_reader(NULL, reader->cur, decl_size);
+		if(!checkFunctionDecl(func, &decl_reader)){
+			return false;
 		}
+		reader->movePos(decl_size);
+	}
+	decl_data_size = reader->getPos() - decl_start_pos;
+
+	reader->movePos((4 - (reader->getPos() & 3)) & 3);
+	if(reader->getSize() - reader->getPos() < (int)sizeof(OS_U32) * opcodes_size + (int)sizeof(DebugInfoItem) * num_debug_infos){
+		return false;
+	}
+	bool in_place = mapped_data && IS_LITTLE_ENDIAN && !((intptr_t)reader->cur & 3);
+	if(in_place){
+		decl_data = decl_start;
+	}else{
+		decl_data = (OS_BYTE*)allocator->malloc(decl_data_size OS_DBG_FILEPOS);
+		OS_MEMCPY(decl_data, decl_start, decl_data_size);
+	}
+	createConstString(prog_filename_string_index);
+	filename = String(allocator, OS_VALUE_VARIANT(const_values[prog_filename_string_index + num_numbers + CONST_STD_VALUES]).string);
+
+	if(in_place){
+		OS_ASSERT(sizeof(DebugInfoItem) == sizeof(OS_U32)*2);
+		opcodes.buf = (OS_U32*)reader->cur;
+		opcodes.count = opcodes.capacity = opcodes_size;
+		reader->movePos(sizeof(OS_U32) * opcodes_size);
+		debug_info.buf = (DebugInfoItem*)reader->cur;
+		debug_info.count = debug_info.capacity = num_debug_infos;
+		return true;
 	}
 
 	allocator->vectorReserveCapacity(opcodes, opcodes_size OS_DBG_FILEPOS);
@@ -11033,14 +11215,114 @@ bool OS::Core::Program::loadFromStream(StreamReader * reader)
 
 	allocator->vectorReserveCapacity(debug_info, num_debug_infos OS_DBG_FILEPOS);
 	for(i = 0; i < num_debug_infos; i++){
-		int line = reader->readUVariable();
-		int pos = reader->readUVariable();
+		int line = reader->readInt32();
+		int pos = reader->readInt32();
 		allocator->vectorAddItem(debug_info, DebugInfoItem(line, pos) OS_DBG_FILEPOS);
 	}
 
+	// everything is copied so the mapping is not needed anymore
+	if(mapped_data){
+		if(!bundle){
+			allocator->unmapFile(mapped_data, mapped_size);
+		}
+		mapped_data = NULL;
+	}
 	return true;
 }
 
+void OS::Core::Program::createConstString(int i)
+{
+	OS_ASSERT(i >= 0 && i < num_strings);
+	if(string_data_pos[i] < 0){
+		return;
+	}
+	MemStreamReader reader(NULL, decl_data, decl_data_size);
+	reader.movePos(string_data_pos[i]);
+	int data_size = reader.readUVariable();
+	GCStringValue * string = allocator->core->pushStringValue((void*)reader.cur, data_size);
+	string->external_ref_count++;
+	allocator->pop();
+	const_values[i + num_numbers + CONST_STD_VALUES] = string;
+	string_data_pos[i] = -1;
+}
+
+bool OS::Core::Program::checkFunctionDecl(const FunctionDecl * func, MemStreamReader * reader)
+{
+	int i, start_pos, end_pos, index;
+	for(i = 0; i < func->num_locals; i++){
+		if(!reader->readCheckedUVariable(index) || index >= num_strings
+			|| !reader->readCheckedUVariable(start_pos) || start_pos > func->opcodes_size
+			|| !reader->readCheckedUVariable(end_pos) || end_pos > func->opcodes_size
+			|| !reader->hasBytes(1))
+		{
+			return false;
+		}
+		reader->movePos(1);
+	}
+	for(i = 0; i < func->num_try_blocks; i++){
+		if(!reader->readCheckedUVariable(start_pos) || start_pos > func->opcodes_size
+			|| !reader->readCheckedUVariable(end_pos) || end_pos > func->opcodes_size
+			|| !reader->readCheckedUVariable(index) || index >= func->num_locals)
+		{
+			return false;
+		}
+	}
+	return reader->getPos() == reader->getSize();
+}
+
+void OS::Core::Program::decodeFunction(FunctionDecl * func)
+{
+	OS_ASSERT(func->decl_data_pos >= 0 && !func->locals && !func->try_blocks);
+	MemStreamReader reader(NULL, decl_data, decl_data_size);
+	reader.movePos(func->decl_data_pos);
+	func->decl_data_pos = -1;
+
+	func->locals = (FunctionDecl::LocalVar*)allocator->malloc(sizeof(FunctionDecl::LocalVar) * func->num_locals OS_DBG_FILEPOS);
+	int i;
+	for(i = 0; i < func->num_locals; i++){
+		int cached_name_index = reader.readUVariable();
+		OS_ASSERT(cached_name_index >= 0 && cached_name_index < num_strings);
+		createConstString(cached_name_index);
+		FunctionDecl::LocalVar * local_var = func->locals + i;
+		OS_ASSERT(dynamic_cast<GCStringValue*>(OS_VALUE_VARIANT(const_values[cached_name_index + num_numbers + CONST_STD_VALUES]).string));
+		String var_name(allocator, OS_VALUE_VARIANT(const_values[cached_name_index + num_numbers + CONST_STD_VALUES]).string);
+		new (local_var) FunctionDecl::LocalVar(var_name);
+		local_var->start_code_pos = reader.readUVariable() + func->opcodes_pos;
+		local_var->end_code_pos = reader.readUVariable() + func->opcodes_pos;
+		local_var->upvalue = reader.readByte() ? true : false;
+	}
+
+	func->try_blocks = (FunctionDecl::TryBlock*)allocator->malloc(sizeof(FunctionDecl::TryBlock) * func->num_try_blocks OS_DBG_FILEPOS);
+	for(i = 0; i < func->num_try_blocks; i++){
+		FunctionDecl::TryBlock * try_block = func->try_blocks + i;
+		try_block->start_code_pos = reader.readUVariable() + func->opcodes_pos;
+		try_block->end_code_pos = reader.readUVariable() + func->opcodes_pos;
+		try_block->catch_var_index = reader.readUVariable();
+	}
+
+	// create string consts could be used by own opcodes, nested functions are skipped
+	// because they are decoded by the same way before their first use
+	int first_string = num_numbers + CONST_STD_VALUES;
+	OS_U32 * cur = opcodes.buf + func->opcodes_pos;
+	OS_U32 * end = cur + func->opcodes_size;
+	while(cur < end){
+		OS_U32 instruction = *cur++;
+		int b = OS_GETARG_B(instruction) - first_string;
+		int c = OS_GETARG_C(instruction) - first_string;
+		int bx = OS_GETARG_Bx(instruction) - first_string;
+		if(b >= 0 && b < num_strings) createConstString(b);
+		if(c >= 0 && c < num_strings) createConstString(c);
+		if(bx >= 0 && bx < num_strings) createConstString(bx);
+		if(OS_GET_OPCODE_TYPE(instruction) == OP_NEW_FUNCTION){
+			b = OS_GETARG_B(instruction);
+			OS_ASSERT(b > 0 && b < num_functions);
+			if(b > 0 && b < num_functions){
+				cur += functions[b].opcodes_size;
+			}
+		}
+	}
+}
+
 OS::Core::Program::DebugInfoItem * OS::Core::Program::getDebugInfo(int opcode_pos)
 {
 	// opcode_pos is next opcode of needed
@@ -11060,7 +11342,8 @@ OS::Core::Program::DebugInfoItem::DebugInfoItem(int p_line, int p_pos)
 void OS::Core::Program::pushStartFunction()
 {
 	int opcode = opcodes[0];
-	if(OS_GET_OPCODE_TYPE(opcode) != OP_NEW_FUNCTION){
+	// the first function is used directly so it's checked like function declarations
+	if(OS_GET_OPCODE_TYPE(opcode) != OP_NEW_FUNCTION || OS_GETARG_B(opcode) != 0){
 		OS_ASSERT(false);
 		allocator->pushNull();
 		return;
@@ -11069,6 +11352,9 @@ void OS::Core::Program::pushStartFunction()
 	int prog_func_index = OS_GETARG_B(opcode);
 	OS_ASSERT(prog_func_index == 0 && !OS_GETARG_A(opcode));
 	FunctionDecl * func_decl = functions + prog_func_index;
+	if(func_decl->decl_data_pos >= 0){
+		decodeFunction(func_decl);
+	}
 	OS_ASSERT(func_decl->max_up_count == 0);
 
 	GCFunctionValue * func_value = allocator->core->pushFunctionValue(NULL, this, func_decl, allocator->core->global_vars, Value());
@@ -11642,6 +11928,24 @@ int OS::Core::MemStreamReader::getSize() const
 	return size;
 }
 
+bool OS::Core::MemStreamReader::hasBytes(int len) const
+{
+	return len >= 0 && len <= size - getPos();
+}
+
+bool OS::Core::MemStreamReader::readCheckedUVariable(int& value)
+{
+	value = 0;
+	for(int i = 0; i < 32 && cur < buffer + size; i += 7){
+		int b = *cur++;
+		value |= (b & 0x7f) << i;
+		if(!(b & 0x80)){
+			return value >= 0;
+		}
+	}
+	return false;
+}
+
 void OS::Core::MemStreamReader::movePos(int len)
 {
 	OS_ASSERT(getPos()+len >= 0 && getPos()+len <= size);
@@ -12065,6 +12369,46 @@ void OS::Core::deleteTable(Table * table)
 	free(table);
 }
 
+void OS::Core::resizeTableHeads(Table * table, int new_size)
+{
+	int alloc_size = sizeof(Property*)*new_size;
+	Property ** new_heads = (Property**)malloc(alloc_size OS_DBG_FILEPOS);
+	OS_ASSERT(new_heads);
+	OS_MEMSET(new_heads, 0, alloc_size);
+
+	Property ** old_heads = table->heads;
+	table->heads = new_heads;
+	table->head_mask = new_size-1;
+
+	for(Property * cur = table->first; cur; cur = cur->next){
+		int type = OS_VALUE_TYPE(cur->index);
+#if 000
+		int hash;
+		OS_CALC_VALUE_HASH(cur->index, type);
+		int slot = hash & table->head_mask;
+#else
+		int slot = getValueHash(cur->index, type) & table->head_mask;
+#endif
+		cur->hash_next = table->heads[slot];
+		table->heads[slot] = cur;
+	}
+
+	// delete [] old_heads;
+	free(old_heads);
+}
+
+void OS::Core::reserveTable(Table * table, int count)
+{
+	OS_ASSERT(table);
+	int new_size = table->heads ? table->head_mask+1 : 4;
+	while((count>>HASH_GROW_SHIFT) >= new_size-1){
+		new_size *= 2;
+	}
+	if(new_size > table->head_mask+1){
+		resizeTableHeads(table, new_size);
+	}
+}
+
 OS::Core::Property * OS::Core::addTableProperty(Table * table, const Value& index, const Value& value)
 {
 	OS_ASSERT(!table->get(index, OS_VALUE_TYPE(index)));
@@ -12076,31 +12420,7 @@ OS::Core::Property * OS::Core::addTableProperty(Table * table, const Value& inde
 	retainValue(prop->value);
 
 	if((table->count>>HASH_GROW_SHIFT) >= table->head_mask){
-		int new_size = table->heads ? (table->head_mask+1) * 2 : 4;
-		int alloc_size = sizeof(Property*)*new_size;
-		Property ** new_heads = (Property**)malloc(alloc_size OS_DBG_FILEPOS);
-		OS_ASSERT(new_heads);
-		OS_MEMSET(new_heads, 0, alloc_size);
-
-		Property ** old_heads = table->heads;
-		table->heads = new_heads;
-		table->head_mask = new_size-1;
-
-		for(Property * cur = table->first; cur; cur = cur->next){
-			int type = OS_VALUE_TYPE(cur->index);
-#if 000
-			int hash;
-			OS_CALC_VALUE_HASH(cur->index, type);
-			int slot = hash & table->head_mask;
-#else
-			int slot = getValueHash(cur->index, type) & table->head_mask;
-#endif
-			cur->hash_next = table->heads[slot];
-			table->heads[slot] = cur;
-		}
-
-		// delete [] old_heads;
-		free(old_heads);
+		resizeTableHeads(table, table->heads ? (table->head_mask+1) * 2 : 4);
 	}
 
 	int type = OS_VALUE_TYPE(prop->index);
@@ -12266,6 +12586,10 @@ bool OS::Core::deleteTableProperty(Table * table, const Value& index)
 
 void OS::Core::deleteValueProperty(GCValue * table_value, Value index, bool del_enabled, bool prototype_enabled)
 {
+	if(table_value->is_frozen){
+		checkValueWritable(Value(table_value, Value::Valid()));
+		return;
+	}
 	int index_type = OS_VALUE_TYPE(index);
 	if(table_value->type == OS_VALUE_TYPE_ARRAY && index_type == OS_VALUE_TYPE_NUMBER){
 		OS_ASSERT(dynamic_cast<GCArrayValue*>(table_value));
@@ -12386,6 +12710,13 @@ void OS::Core::copyTableProperties(GCValue * dst_value, GCValue * src_value, boo
 	}
 }
 
+static int compareResult(OS_NUMBER num)
+{
+	if(num < 0) return -1;
+	if(num > 0) return 1;
+	return 0;
+}
+
 void OS::Core::sortTable(Table * table, int(*comp)(OS*, const void*, const void*, void*), void * user_param, bool reorder_keys)
 {
 	if(table->count > 1){
@@ -12397,95 +12728,304 @@ void OS::Core::sortTable(Table * table, int(*comp)(OS*, const void*, const void*
 			props[i] = cur;
 		}
 		OS_ASSERT(!cur && i == table->count);
-		allocator->qsort(props, table->count, sizeof(Core::Property*), comp, user_param);
-		table->first = props[0];
-		props[0]->prev = NULL;
-		for(i = 1; i < table->count; i++){
-			props[i-1]->next = props[i];
-			props[i]->prev = props[i-1];
+		if(comp == comparePropValues){
+			// values of numbers or strings could be sorted without calling of __cmp
+			Value * values = (Value*)malloc(sizeof(Value) * table->count OS_DBG_FILEPOS);
+			int * order = (int*)malloc(sizeof(int) * table->count OS_DBG_FILEPOS);
+			for(i = 0; i < table->count; i++){
+				values[i] = props[i]->value;
+			}
+			bool sorted = sortKeys(values, table->count, order, true);
+			if(sorted){
+				Property ** sorted_props = (Property**)malloc(sizeof(Property*) * table->count OS_DBG_FILEPOS);
+				for(i = 0; i < table->count; i++){
+					sorted_props[i] = props[order[i]];
+				}
+				reorderTable(table, sorted_props, reorder_keys);
+				free(sorted_props);
+			}
+			free(order);
+			free(values);
+			if(sorted){
+				free(props);
+				return;
+			}
 		}
-		props[i-1]->next = NULL;
-		table->last = props[i-1];
+		allocator->qsort(props, table->count, sizeof(Core::Property*), comp, user_param);
+		reorderTable(table, props, reorder_keys);
+		free(props);
+	}
+}
+
+void OS::Core::reorderTable(Table * table, Property ** props, bool reorder_keys)
+{
+	OS_ASSERT(table->count > 0);
+	int i;
+	table->first = props[0];
+	props[0]->prev = NULL;
+	for(i = 1; i < table->count; i++){
+		props[i-1]->next = props[i];
+		props[i]->prev = props[i-1];
+	}
+	props[i-1]->next = NULL;
+	table->last = props[i-1];
 
-		if(reorder_keys){
+	if(reorder_keys){
 #if 1 // performance optimization
-			OS_MEMSET(table->heads, 0, sizeof(Property*)*(table->head_mask+1));
-			for(i = 0; i < table->count; i++){
-				Property * cur = props[i];
-				setValue(cur->index, Value(i));
-				int type = OS_VALUE_TYPE(cur->index);
+		OS_MEMSET(table->heads, 0, sizeof(Property*)*(table->head_mask+1));
+		for(i = 0; i < table->count; i++){
+			Property * cur = props[i];
+			setValue(cur->index, Value(i));
+			int type = OS_VALUE_TYPE(cur->index);
 #if 000
-				int hash;
-				OS_CALC_VALUE_HASH(cur->index, type);
-				int slot = hash & table->head_mask;
+			int hash;
+			OS_CALC_VALUE_HASH(cur->index, type);
+			int slot = hash & table->head_mask;
 #else
-				int slot = getValueHash(cur->index, type) & table->head_mask;
+			int slot = getValueHash(cur->index, type) & table->head_mask;
 #endif
-				cur->hash_next = table->heads[slot];
-				table->heads[slot] = cur;
-			}
+			cur->hash_next = table->heads[slot];
+			table->heads[slot] = cur;
+		}
 #else
-			for(i = 0; i < table->count; i++){
-				changePropertyIndex(table, props[i], Value(i));
-			}
-#endif
-			table->next_index = table->count;
+		for(i = 0; i < table->count; i++){
+			changePropertyIndex(table, props[i], Value(i));
 		}
-
-		free(props);
+#endif
+		table->next_index = table->count;
 	}
 }
 
 void OS::Core::sortArray(GCArrayValue * arr, int(*comp)(OS*, const void*, const void*, void*), void * user_param)
 {
-	allocator->qsort(arr->values.buf, arr->values.count, sizeof(Value), comp, user_param);
+	int count = arr->values.count;
+	if(count > 1 && comp == compareArrayValues){
+		// numbers or strings could be sorted without calling of __cmp
+		int * order = (int*)malloc(sizeof(int) * count OS_DBG_FILEPOS);
+		if(sortKeys(arr->values.buf, count, order, true)){
+			Value * values = (Value*)malloc(sizeof(Value) * count OS_DBG_FILEPOS);
+			for(int i = 0; i < count; i++){
+				values[i] = arr->values[order[i]];
+			}
+			OS_MEMCPY(arr->values.buf, values, sizeof(Value) * count);
+			free(values);
+			free(order);
+			return;
+		}
+		free(order);
+	}
+	allocator->qsort(arr->values.buf, count, sizeof(Value), comp, user_param);
 }
 
-static int compareResult(OS_NUMBER num)
+struct NumberSortItem
 {
-	if(num < 0) return -1;
-	if(num > 0) return 1;
-	return 0;
-}
+	OS_U64 key;
+	int index;
+};
 
-int OS::Core::comparePropValues(OS * os, const void * a, const void * b, void*)
+static OS_U64 numberToSortKey(OS_NUMBER num)
 {
-	Property * props[] = {*(Property**)a, *(Property**)b};
-	os->core->pushOpResultValue(OP_COMPARE, props[0]->value, props[1]->value);
-	return compareResult(os->popNumber());
+	// map double to unsigned int with the same ordering
+	double val = (double)num;
+	OS_U64 bits;
+	OS_MEMCPY(&bits, &val, sizeof(bits));
+	const OS_U64 sign = (OS_U64)1 << 63;
+	return (bits & sign) ? ~bits : bits | sign;
 }
 
-int OS::Core::comparePropValuesReverse(OS * os, const void * a, const void * b, void * user_param)
+static NumberSortItem * radixSortNumbers(NumberSortItem * items, NumberSortItem * temp, int count)
 {
-	return comparePropValues(os, b, a, user_param);
+	enum { PASSES = sizeof(OS_U64) };
+	int counts[PASSES][256];
+	OS_MEMSET(counts, 0, sizeof(counts));
+	int i, pass;
+	for(i = 0; i < count; i++){
+		OS_U64 key = items[i].key;
+		for(pass = 0; pass < PASSES; pass++, key >>= 8){
+			counts[pass][key & 0xff]++;
+		}
+	}
+	for(pass = 0; pass < PASSES; pass++){
+		int * pass_counts = counts[pass];
+		int shift = pass * 8;
+		if(pass_counts[(items[0].key >> shift) & 0xff] == count){
+			continue; // all keys have the same byte
+		}
+		for(int sum = 0, j = 0; j < 256; j++){
+			int c = pass_counts[j];
+			pass_counts[j] = sum;
+			sum += c;
+		}
+		for(i = 0; i < count; i++){
+			temp[pass_counts[(items[i].key >> shift) & 0xff]++] = items[i];
+		}
+		NumberSortItem * swap = items; items = temp; temp = swap;
+	}
+	return items;
 }
 
-int OS::Core::compareObjectProperties(OS * os, const void * a, const void * b, void * user_param)
+static void mergeSortOrder(OS * os, int * order, int * temp, int count, int(*comp)(OS*, int, int, void*), void * user_param)
 {
-	Property * props[] = {*(Property**)a, *(Property**)b};
-	const String& name = *(String*)user_param;
-
-	os->core->pushValue(props[0]->value);
-	os->core->pushStringValue(name);
-	os->getProperty();
-
-	os->core->pushValue(props[1]->value);
-	os->core->pushStringValue(name);
-	os->getProperty();
+	enum { RUN_SIZE = 16 };
+	int i, j, start;
+	for(start = 0; start < count; start += RUN_SIZE){
+		int end = start + RUN_SIZE < count ? start + RUN_SIZE : count;
+		for(i = start + 1; i < end; i++){
+			int item = order[i];
+			for(j = i; j > start && comp(os, item, order[j-1], user_param) < 0; j--){
+				order[j] = order[j-1];
+			}
+			order[j] = item;
+		}
+	}
+	for(int width = RUN_SIZE; width < count; width *= 2){
+		for(start = 0; start < count - width; start += width * 2){
+			int mid = start + width;
+			int end = mid + width < count ? mid + width : count;
+			if(comp(os, order[mid-1], order[mid], user_param) <= 0){
+				continue; // already ordered, so sorted input is handled in linear time
+			}
+			int k = start;
+			for(i = start, j = mid; i < mid && j < end;){
+				temp[k++] = comp(os, order[j], order[i], user_param) < 0 ? order[j++] : order[i++];
+			}
+			while(i < mid) temp[k++] = order[i++];
+			while(j < end) temp[k++] = order[j++];
+			OS_MEMCPY(order + start, temp + start, sizeof(int) * (end - start));
+		}
+	}
+}
 
-	os->runOp(ObjectScript::OP_COMPARE);
-	return compareResult(os->popNumber());
+int OS::Core::compareStringKeys(OS * os, int a, int b, void * user_param)
+{
+	const Value * keys = (const Value*)user_param;
+	return OS_VALUE_VARIANT(keys[a]).string->cmp(OS_VALUE_VARIANT(keys[b]).string);
 }
 
-int OS::Core::compareObjectPropertiesReverse(OS * os, const void * a, const void * b, void * user_param)
+int OS::Core::compareValueKeys(OS * os, int a, int b, void * user_param)
 {
-	return compareObjectProperties(os, b, a, user_param);
+	const Value * keys = (const Value*)user_param;
+	os->core->pushOpResultValue(OP_COMPARE, keys[a], keys[b]);
+	return compareResult(os->popNumber());
 }
 
-int OS::Core::compareUserPropValues(OS * os, const void * a, const void * b, void*)
+bool OS::Core::sortKeys(const Value * keys, int count, int * order, bool natives_only)
 {
-	Property * props[] = {*(Property**)a, *(Property**)b};
-	os->pushStackValue(-1);
+	int i, numbers = 0, strings = 0;
+	for(i = 0; i < count; i++){
+		switch(OS_VALUE_TYPE(keys[i])){
+		case OS_VALUE_TYPE_NUMBER: numbers++; break;
+		case OS_VALUE_TYPE_STRING: strings++; break;
+		}
+	}
+	if(numbers == count && count >= 64){
+		NumberSortItem * items = (NumberSortItem*)malloc(sizeof(NumberSortItem) * count * 2 OS_DBG_FILEPOS);
+		for(i = 0; i < count; i++){
+			items[i].key = numberToSortKey(OS_VALUE_NUMBER(keys[i]));
+			items[i].index = i;
+		}
+		NumberSortItem * sorted = radixSortNumbers(items, items + count, count);
+		for(i = 0; i < count; i++){
+			order[i] = sorted[i].index;
+		}
+		free(items);
+		return true;
+	}
+	if(natives_only && numbers != count && strings != count){
+		return false;
+	}
+	for(i = 0; i < count; i++){
+		order[i] = i;
+	}
+	int * temp = (int*)malloc(sizeof(int) * count OS_DBG_FILEPOS);
+	mergeSortOrder(allocator, order, temp, count, strings == count ? compareStringKeys : compareValueKeys, (void*)keys);
+	free(temp);
+	return true;
+}
+
+void OS::Core::sortArrayByKeys(GCArrayValue * arr, GCArrayValue * keys)
+{
+	int count = keys->values.count;
+	if(count < 2){
+		return;
+	}
+	int * order = (int*)malloc(sizeof(int) * count OS_DBG_FILEPOS);
+	sortKeys(keys->values.buf, count, order);
+	if(arr->values.count == count){
+		Value * values = (Value*)malloc(sizeof(Value) * count OS_DBG_FILEPOS);
+		for(int i = 0; i < count; i++){
+			values[i] = arr->values[order[i]];
+		}
+		OS_MEMCPY(arr->values.buf, values, sizeof(Value) * count);
+		free(values);
+	}else{
+		allocator->setException(OS_TEXT("array has been modified during sort"));
+	}
+	free(order);
+}
+
+void OS::Core::sortTableByKeys(Table * table, GCArrayValue * indices, GCArrayValue * keys)
+{
+	int count = keys->values.count;
+	OS_ASSERT(indices->values.count == count);
+	if(count < 2){
+		return;
+	}
+	int * order = (int*)malloc(sizeof(int) * count OS_DBG_FILEPOS);
+	sortKeys(keys->values.buf, count, order);
+	Property ** props = (Property**)malloc(sizeof(Property*) * count OS_DBG_FILEPOS);
+	bool valid = table->count == count;
+	for(int i = 0; valid && i < count; i++){
+		const Value& index = indices->values[order[i]];
+		valid = (props[i] = table->get(index, OS_VALUE_TYPE(index))) != NULL;
+	}
+	if(valid){
+		reorderTable(table, props, false);
+	}else{
+		allocator->setException(OS_TEXT("object has been modified during sort"));
+	}
+	free(props);
+	free(order);
+}
+
+int OS::Core::comparePropValues(OS * os, const void * a, const void * b, void*)
+{
+	Property * props[] = {*(Property**)a, *(Property**)b};
+	os->core->pushOpResultValue(OP_COMPARE, props[0]->value, props[1]->value);
+	return compareResult(os->popNumber());
+}
+
+int OS::Core::comparePropValuesReverse(OS * os, const void * a, const void * b, void * user_param)
+{
+	return comparePropValues(os, b, a, user_param);
+}
+
+int OS::Core::compareObjectProperties(OS * os, const void * a, const void * b, void * user_param)
+{
+	Property * props[] = {*(Property**)a, *(Property**)b};
+	const String& name = *(String*)user_param;
+
+	os->core->pushValue(props[0]->value);
+	os->core->pushStringValue(name);
+	os->getProperty();
+
+	os->core->pushValue(props[1]->value);
+	os->core->pushStringValue(name);
+	os->getProperty();
+
+	os->runOp(ObjectScript::OP_COMPARE);
+	return compareResult(os->popNumber());
+}
+
+int OS::Core::compareObjectPropertiesReverse(OS * os, const void * a, const void * b, void * user_param)
+{
+	return compareObjectProperties(os, b, a, user_param);
+}
+
+int OS::Core::compareUserPropValues(OS * os, const void * a, const void * b, void*)
+{
+	Property * props[] = {*(Property**)a, *(Property**)b};
+	os->pushStackValue(-1);
 	os->core->pushValue(props[0]->value);
 	os->core->pushValue(props[1]->value);
 	os->core->pushValue(props[0]->index);
@@ -12826,6 +13366,7 @@ OS::Core::GCValue::GCValue()
 	type = OS_VALUE_TYPE_NULL;
 	// is_object_instance = false;
 	is_destructor_called = false;
+	is_frozen = false;
 }
 
 OS::Core::GCValue::~GCValue()
@@ -12846,11 +13387,137 @@ OS::Core::GCStringValue::GCStringValue(int p_data_size)
 	data_size = p_data_size;
 	hash = 0;
 	hash_next_ref = NULL;
+	utf8_len = -1;
+	utf8_index = NULL;
 }
 
 OS::Core::GCStringValue::~GCStringValue()
 {
 	OS_ASSERT(!hash_next_ref);
+	OS_ASSERT(!utf8_index);
+}
+
+#define UTF8_SKIP_MULTI_BYTE_SEQUENCE(input, end) \
+	if((*(OS_BYTE*)(input++)) >= 0xc0 ){ \
+		while(input < end && (*(OS_BYTE*)input & 0xc0) == 0x80) input++;	\
+	}
+
+static bool isAsciiBuffer(const OS_BYTE * buf, int size)
+{
+	const OS_BYTE * end = buf + size;
+	for(; end - buf >= (int)sizeof(OS_U64)*4; buf += sizeof(OS_U64)*4){
+		OS_U64 words[4];
+		OS_MEMCPY(words, buf, sizeof(words));
+		if((words[0] | words[1] | words[2] | words[3]) & (OS_U64)0x8080808080808080ull){
+			return false;
+		}
+	}
+	for(; buf < end; buf++){
+		if(*buf & 0x80){
+			return false;
+		}
+	}
+	return true;
+}
+
+bool OS::Core::GCStringValue::isAscii(OS * allocator)
+{
+	return getUtf8Len(allocator) == data_size;
+}
+
+int OS::Core::GCStringValue::getUtf8Len(OS * allocator)
+{
+	if(utf8_len >= 0){
+		return utf8_len;
+	}
+	const OS_BYTE * start = toBytes();
+	if(isAsciiBuffer(start, data_size)){
+		return utf8_len = data_size;
+	}
+	const OS_BYTE * cur = start, * end = start + data_size;
+	int len = 0;
+	if(data_size >= OS_UTF8_INDEX_MIN_SIZE){
+		OS_ASSERT(!utf8_index);
+		utf8_index = (int*)allocator->malloc(sizeof(int) * (data_size / OS_UTF8_INDEX_STEP + 1) OS_DBG_FILEPOS);
+		for(; cur < end; len++){
+			if(!(len % OS_UTF8_INDEX_STEP)){
+				utf8_index[len / OS_UTF8_INDEX_STEP] = (int)(cur - start);
+			}
+			UTF8_SKIP_MULTI_BYTE_SEQUENCE(cur, end);
+		}
+	}else{
+		for(; cur < end; len++){
+			UTF8_SKIP_MULTI_BYTE_SEQUENCE(cur, end);
+		}
+	}
+	return utf8_len = len;
+}
+
+int OS::Core::GCStringValue::getUtf8Offs(OS * allocator, int char_index)
+{
+	int len = getUtf8Len(allocator);
+	if(char_index <= 0){
+		return 0;
+	}
+	if(char_index >= len){
+		return data_size;
+	}
+	if(len == data_size){
+		return char_index;
+	}
+	const OS_BYTE * start = toBytes();
+	const OS_BYTE * cur = start, * end = start + data_size;
+	if(utf8_index){
+		cur += utf8_index[char_index / OS_UTF8_INDEX_STEP];
+		char_index %= OS_UTF8_INDEX_STEP;
+	}
+	for(; char_index > 0; char_index--){
+		UTF8_SKIP_MULTI_BYTE_SEQUENCE(cur, end);
+	}
+	return (int)(cur - start);
+}
+
+int OS::Core::GCStringValue::getUtf8CharIndex(OS * allocator, int offs)
+{
+	int len = getUtf8Len(allocator);
+	if(offs <= 0){
+		return 0;
+	}
+	if(offs >= data_size){
+		return len;
+	}
+	if(len == data_size){
+		return offs;
+	}
+	const OS_BYTE * start = toBytes();
+	const OS_BYTE * cur = start, * end = start + offs;
+	int char_index = 0;
+	if(utf8_index){
+		int left = 0, right = (len - 1) / OS_UTF8_INDEX_STEP;
+		while(left < right){
+			int mid = (left + right + 1) / 2;
+			if(utf8_index[mid] <= offs){
+				left = mid;
+			}else{
+				right = mid - 1;
+			}
+		}
+		cur += utf8_index[left];
+		char_index = left * OS_UTF8_INDEX_STEP;
+	}
+	for(; cur < end; char_index++){
+		UTF8_SKIP_MULTI_BYTE_SEQUENCE(cur, end);
+	}
+	// offs is inside of multi byte sequence
+	return cur == end ? char_index : -1;
+}
+
+void OS::Core::GCStringValue::freeUtf8Index(OS * allocator)
+{
+	if(utf8_index){
+		allocator->free(utf8_index);
+		utf8_index = NULL;
+	}
 }
 
 OS::Core::GCStringValue * OS::Core::GCStringValue::allocAndPush(OS * allocator, int p_hash, const void * buf, int data_size OS_DBG_FILEPOS_DECL)
@@ -13743,47 +14410,20 @@ void OS::Core::addFreeCandidateValue(GCValue * value)
 	}
 }
 
-void OS::Core::registerFreeCandidateValue(GCValue * value)
+void OS::Core::resizeFreeCandidateValues(int new_size)
 {
-	OS_ASSERT(value->value_id);
-	OS_ASSERT(!gc_candidate_values.get(value->value_id));
-	if((gc_candidate_values.count>>HASH_GROW_SHIFT) >= gc_candidate_values.head_mask){
-		int new_size = gc_candidate_values.heads ? (gc_candidate_values.head_mask+1) * 2 : 32;
-		int alloc_size = sizeof(GCValue*) * new_size;
-		GCValue ** new_heads = (GCValue**)malloc(alloc_size OS_DBG_FILEPOS); // new Value*[new_size];
-		OS_ASSERT(new_heads);
-		OS_MEMSET(new_heads, 0, alloc_size);
-
-		GCValue ** old_heads = gc_candidate_values.heads;
-		int old_mask = gc_candidate_values.head_mask;
+	int alloc_size = sizeof(GCValue*) * new_size;
+	GCValue ** new_heads = (GCValue**)malloc(alloc_size OS_DBG_FILEPOS); // new Value*[new_size];
+	OS_ASSERT(new_heads);
+	OS_MEMSET(new_heads, 0, alloc_size);
 
-		gc_candidate_values.heads = new_heads;
-		gc_candidate_values.head_mask = new_size-1;
+	GCValue ** old_heads = gc_candidate_values.heads;
+	int old_mask = gc_candidate_values.head_mask;
 
-		if(old_heads){
-			for(int i = 0; i <= old_mask; i++){
-				for(GCValue * value = old_heads[i], * next; value; value = next){
-					next = value->hash_next_free_candidate;
-					int slot = value->value_id & gc_candidate_values.head_mask;
-					value->hash_next_free_candidate = gc_candidate_values.heads[slot];
-					gc_candidate_values.heads[slot] = value;
-				}
-			}
-			free(old_heads);
-		}
-	}else if(0 && (gc_candidate_values.head_mask>>1) > gc_candidate_values.count && gc_candidate_values.head_mask >= 256-1){
-		int new_size = (gc_candidate_values.head_mask+1) >> 1;
-		int alloc_size = sizeof(GCValue*) * new_size;
-		GCValue ** new_heads = (GCValue**)malloc(alloc_size OS_DBG_FILEPOS); // new Value*[new_size];
-		OS_ASSERT(new_heads);
-		OS_MEMSET(new_heads, 0, alloc_size);
-
-		GCValue ** old_heads = gc_candidate_values.heads;
-		int old_mask = gc_candidate_values.head_mask;
-
-		gc_candidate_values.heads = new_heads;
-		gc_candidate_values.head_mask = new_size-1;
+	gc_candidate_values.heads = new_heads;
+	gc_candidate_values.head_mask = new_size-1;
 
+	if(old_heads){
 		for(int i = 0; i <= old_mask; i++){
 			for(GCValue * value = old_heads[i], * next; value; value = next){
 				next = value->hash_next_free_candidate;
@@ -13794,6 +14434,15 @@ void OS::Core::registerFreeCandidateValue(GCValue * value)
 		}
 		free(old_heads);
 	}
+}
+
+void OS::Core::registerFreeCandidateValue(GCValue * value)
+{
+	OS_ASSERT(value->value_id);
+	OS_ASSERT(!gc_candidate_values.get(value->value_id));
+	if((gc_candidate_values.count>>HASH_GROW_SHIFT) >= gc_candidate_values.head_mask){
+		resizeFreeCandidateValues(gc_candidate_values.heads ? (gc_candidate_values.head_mask+1) * 2 : 32);
+	}
 
 	int slot = value->value_id & gc_candidate_values.head_mask;
 	value->hash_next_free_candidate = gc_candidate_values.heads[slot];
@@ -14165,6 +14814,11 @@ void OS::Core::gcFreeCandidateValues(bool full)
 		}
 	}
 
+	if(gc_candidate_values.head_mask >= 1024-1 && (gc_candidate_values.count<<4) < gc_candidate_values.head_mask){
+		// the table is scanned every time so it's shrunk after big allocations are finished
+		resizeFreeCandidateValues((gc_candidate_values.head_mask+1) >> 1);
+	}
+
 	int used_bytes = allocator->getUsedBytes();
 	if(full || used_bytes >= gc_next_when_used_bytes){		
 		lib.gc_step_type = ++gc_step_type;
@@ -14716,15 +15370,1449 @@ void OS::Core::appendQuotedString(Buffer& buf, const String& string)
 		case OS_TEXT('\f'): buf += OS_TEXT("\\f"); continue;
 		case OS_TEXT('\\'): buf += OS_TEXT("\\\\"); continue;
 		}
-		if(*str < OS_TEXT(' ')){
-			buf += OS_TEXT("0x");
-			buf.append(UPPER_DIGITS[((int)*str >> 4) & 0xF]);
-			buf.append(UPPER_DIGITS[((int)*str >> 0) & 0xF]);
-			continue;
+		if(*str < OS_TEXT(' ')){
+			buf += OS_TEXT("0x");
+			buf.append(UPPER_DIGITS[((int)*str >> 4) & 0xF]);
+			buf.append(UPPER_DIGITS[((int)*str >> 0) & 0xF]);
+			continue;
+		}
+		buf.append(*str);
+	}
+	buf += OS_TEXT("\"");
+}
+
+OS::Core::JsonEncoder::JsonEncoder(Core * p_core, Buffer& p_out, int p_echo_size)
+	: out(p_out), indent(p_core->allocator)
+{
+	core = p_core;
+	depth = 0;
+	echo_size = p_echo_size;
+	core->getPropertyValue(native_func, core->prototypes[PROTOTYPE_OBJECT], core->strings->func_toJson, false);
+
+	// primitive values could not have own properties so their toJson is resolved once
+	Value * funcs[] = {&bool_func, &number_func, &string_func};
+	int prototypes[] = {PROTOTYPE_BOOL, PROTOTYPE_NUMBER, PROTOTYPE_STRING};
+	for(int i = 0; i < 3; i++){
+		Value func;
+		if(core->getPropertyValue(func, core->prototypes[prototypes[i]], core->strings->func_toJson, true) 
+			&& !isEqualExactly(func, native_func))
+		{
+			*funcs[i] = func;
+		}
+	}
+}
+
+void OS::Core::JsonEncoder::setIndent(const Value& val)
+{
+	switch(OS_VALUE_TYPE(val)){
+	case OS_VALUE_TYPE_NUMBER:
+		{
+			int count = (int)OS_VALUE_NUMBER(val);
+			count = count < 0 ? 0 : count > 16 ? 16 : count;
+			indent = String(core->allocator, OS_TEXT("                "), count);
+			return;
+		}
+
+	case OS_VALUE_TYPE_BOOL:
+		indent = String(core->allocator, OS_VALUE_VARIANT(val).boolean ? OS_TEXT("\t") : OS_TEXT(""));
+		return;
+
+	case OS_VALUE_TYPE_STRING:
+		OS_ASSERT(dynamic_cast<GCStringValue*>(OS_VALUE_VARIANT(val).string));
+		indent = String(core->allocator, OS_VALUE_VARIANT(val).string);
+		return;
+	}
+	indent = String(core->allocator);
+}
+
+bool OS::Core::JsonEncoder::callToJson(const Value& val)
+{
+	Value func;
+	switch(OS_VALUE_TYPE(val)){
+	case OS_VALUE_TYPE_NULL:
+		return false;
+
+	case OS_VALUE_TYPE_BOOL:
+		func = bool_func;
+		break;
+
+	case OS_VALUE_TYPE_NUMBER:
+		func = number_func;
+		break;
+
+	case OS_VALUE_TYPE_STRING:
+		func = string_func;
+		break;
+
+	default:
+		if(!core->getPropertyValue(func, val, core->strings->func_toJson, true) || isEqualExactly(func, native_func)){
+			return false;
+		}
+	}
+	switch(OS_VALUE_TYPE(func)){
+	case OS_VALUE_TYPE_FUNCTION:
+	case OS_VALUE_TYPE_CFUNCTION:
+		break;
+
+	default:
+		return false;
+	}
+	core->pushValue(func);
+	core->pushValue(val);
+	core->callFT(0, 1, OS_CALLTYPE_FUNC);
+	out += core->valueToString(core->stack_values.lastElement());
+	core->pop();
+	return true;
+}
+
+void OS::Core::JsonEncoder::appendNewLine()
+{
+	if(indent.getDataSize() > 0){
+		out.append(OS_TEXT('\n'));
+		for(int i = 0; i < depth; i++){
+			out += indent;
+		}
+	}
+}
+
+void OS::Core::JsonEncoder::appendString(const void * p_buf, int size)
+{
+	// the same escaping as json extension uses, non ascii chars are written as utf-16 escapes
+	const OS_BYTE * str = (const OS_BYTE*)p_buf;
+	const OS_BYTE * end = str + size;
+	int start_pos = out.buffer.count;
+	out.append(OS_TEXT('"'));
+	while(str < end){
+		const OS_BYTE * start = str;
+		for(; str < end; str++){
+			int c = *str;
+			if(c < 0x20 || c >= 0x80 || c == '"' || c == '\\' || c == '<' || c == '>' || c == '&' || c == '\''){
+				break;
+			}
+		}
+		if(str > start){
+			out.append(start, (int)(str - start));
+			if(str == end){
+				break;
+			}
+		}
+		int c = *str++;
+		switch(c){
+		case '\\': out.append(OS_TEXT("\\\\"), 2); continue;
+		case '\b': out.append(OS_TEXT("\\b"), 2); continue;
+		case '\f': out.append(OS_TEXT("\\f"), 2); continue;
+		case '\n': out.append(OS_TEXT("\\n"), 2); continue;
+		case '\r': out.append(OS_TEXT("\\r"), 2); continue;
+		case '\t': out.append(OS_TEXT("\\t"), 2); continue;
+		}
+		if(c >= 0x80){
+			// decode utf-8 sequence, overlong forms and surrogates are invalid
+			int need, min;
+			if(c >= 0xc2 && c <= 0xdf){
+				c &= 0x1f; need = 1; min = 0x80;
+			}else if(c >= 0xe0 && c <= 0xef){
+				c &= 0x0f; need = 2; min = 0x800;
+			}else if(c >= 0xf0 && c <= 0xf4){
+				c &= 0x07; need = 3; min = 0x10000;
+			}else{
+				need = -1;
+			}
+			if(need > 0 && end - str >= need){
+				for(; need > 0; need--, str++){
+					if((*str & 0xc0) != 0x80){
+						break;
+					}
+					c = (c << 6) | (*str & 0x3f);
+				}
+			}
+			if(need != 0 || c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)){
+				// invalid utf-8 string is written as null
+				out.buffer.count = out.pos = start_pos;
+				out.append(OS_TEXT("null"), 4);
+				return;
+			}
+			if(c >= 0x10000){
+				c -= 0x10000;
+				int high = 0xd800 | (c >> 10);
+				OS_CHAR hex[6] = {OS_TEXT('\\'), OS_TEXT('u'), DIGITS[high >> 12], DIGITS[(high >> 8) & 0xf], 
+					DIGITS[(high >> 4) & 0xf], DIGITS[high & 0xf]};
+				out.append(hex, 6);
+				c = 0xdc00 | (c & 0x3ff);
+			}
+		}
+		const OS_CHAR * digits = c > 0x20 && c < 0x80 ? UPPER_DIGITS : DIGITS; // \u003C like php does
+		OS_CHAR hex[6] = {OS_TEXT('\\'), OS_TEXT('u'), digits[c >> 12], digits[(c >> 8) & 0xf], digits[(c >> 4) & 0xf], digits[c & 0xf]};
+		out.append(hex, 6);
+	}
+	out.append(OS_TEXT('"'));
+}
+
+void OS::Core::JsonEncoder::flush(bool force)
+{
+	if(echo_size > 0 && (force || out.buffer.count >= echo_size)){
+		core->allocator->echo(out.buffer.buf, out.buffer.count);
+		out.freeCacheStr();
+		out.buffer.count = out.pos = 0;
+	}
+}
+
+void OS::Core::JsonEncoder::encode(const Value& val, bool override_enabled)
+{
+	if(override_enabled && callToJson(val)){
+		return;
+	}
+	switch(OS_VALUE_TYPE(val)){
+	default:
+		out += core->strings->typeof_null;
+		return;
+
+	case OS_VALUE_TYPE_BOOL:
+		out += OS_VALUE_VARIANT(val).boolean ? core->strings->syntax_true : core->strings->syntax_false;
+		return;
+
+	case OS_VALUE_TYPE_NUMBER:
+		{
+			OS_CHAR str[128];
+			Utils::numToStr(str, (OS_FLOAT)OS_VALUE_NUMBER(val));
+			out += str;
+			return;
+		}
+
+	case OS_VALUE_TYPE_STRING:
+		OS_ASSERT(dynamic_cast<GCStringValue*>(OS_VALUE_VARIANT(val).string));
+		appendString(OS_VALUE_VARIANT(val).string->toBytes(), OS_VALUE_VARIANT(val).string->getDataSize());
+		return;
+
+	case OS_VALUE_TYPE_ARRAY:
+		{
+			if(!core->pushValueOfRecursion(val)){
+				out += core->strings->typeof_null;
+				return;
+			}
+			OS_ASSERT(dynamic_cast<GCArrayValue*>(OS_VALUE_VARIANT(val).arr));
+			GCArrayValue * arr = OS_VALUE_VARIANT(val).arr;
+			out.append(OS_TEXT('['));
+			depth++;
+			int i = 0;
+			// count is checked every step and item is copied, toJson of item could resize the array
+			for(; i < arr->values.count && !core->allocator->isExceptionSet(); i++){
+				if(i > 0){
+					out.append(OS_TEXT(','));
+				}
+				appendNewLine();
+				Value value = arr->values[i];
+				encode(value);
+				flush();
+			}
+			depth--;
+			if(i > 0){
+				appendNewLine();
+			}
+			out.append(OS_TEXT(']'));
+			core->popValueOfRecursion(val);
+			return;
+		}
+
+	case OS_VALUE_TYPE_USERDATA:
+	case OS_VALUE_TYPE_USERPTR:
+	case OS_VALUE_TYPE_OBJECT:
+		{
+			if(!core->pushValueOfRecursion(val)){
+				out += core->strings->typeof_null;
+				return;
+			}
+			OS_ASSERT(dynamic_cast<GCValue*>(OS_VALUE_VARIANT(val).value));
+			Table * table = OS_VALUE_VARIANT(val).value->table;
+			out.append(OS_TEXT('{'));
+			depth++;
+			int i = 0;
+			if(table){
+				Table::IteratorState iter;
+				table->addIterator(&iter);
+				while(iter.prop && !core->allocator->isExceptionSet()){
+					Property * prop = iter.prop;
+					iter.prop = prop->next;
+					switch(OS_VALUE_TYPE(prop->index)){
+					case OS_VALUE_TYPE_NUMBER:
+					case OS_VALUE_TYPE_STRING:
+						break;
+
+					default:
+						// skip value
+						continue;
+					}
+					if(i++ > 0){
+						out.append(OS_TEXT(','));
+					}
+					appendNewLine();
+					Value value = prop->value;
+					encode(prop->index);
+					out.append(OS_TEXT(':'));
+					if(indent.getDataSize() > 0){
+						out.append(OS_TEXT(' '));
+					}
+					encode(value);
+					flush();
+				}
+				if(iter.table){
+					table->removeIterator(&iter);
+				}
+			}
+			depth--;
+			if(i > 0){
+				appendNewLine();
+			}
+			out.append(OS_TEXT('}'));
+			core->popValueOfRecursion(val);
+			return;
+		}
+	}
+}
+
+static inline bool isJsonSpace(int c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool isJsonDigit(int c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline bool isJsonNumberChar(int c)
+{
+	return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static inline bool isJsonAlpha(int c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline int dehexJsonChar(int c)
+{
+	if(c >= '0' && c <= '9'){
+		return c - '0';
+	}
+	if(c >= 'A' && c <= 'F'){
+		return c - ('A' - 10);
+	}
+	if(c >= 'a' && c <= 'f'){
+		return c - ('a' - 10);
+	}
+	return -1;
+}
+
+OS::Core::JsonDecoder::JsonDecoder(Core * p_core, int p_max_depth): token(p_core->allocator)
+{
+	core = p_core;
+	max_depth = p_max_depth;
+	pending = core->pushArrayValue();
+	pending_id = pending->value_id;
+	core->allocator->retainValueById(pending_id);
+	core->allocator->pop();
+	reset();
+}
+
+OS::Core::JsonDecoder::~JsonDecoder()
+{
+	core->allocator->vectorClear(frames);
+	core->allocator->releaseValueById(pending_id);
+}
+
+void OS::Core::JsonDecoder::reset()
+{
+	core->releaseValues(pending->values.buf, pending->values.count);
+	pending->values.count = 0;
+	frames.count = 0;
+	token.clear();
+	state = STATE_VALUE;
+	error_code = ERROR_NONE;
+	is_key = false;
+	unicode_len = unicode_char = high_surrogate = 0;
+	utf8_need = 0;
+	utf8_lo = 0x80;
+	utf8_hi = 0xbf;
+}
+
+const OS_BYTE * OS::Core::JsonDecoder::setError(int code)
+{
+	if(state != STATE_ERROR){
+		error_code = code;
+		state = STATE_ERROR;
+	}
+	return NULL;
+}
+
+// skips string chars which don't need special processing (not ", \, control or non ascii),
+// uses 8 bytes words to run through long ascii texts
+const OS_BYTE * OS::Core::JsonDecoder::skipStringChars(const OS_BYTE * str, const OS_BYTE * end)
+{
+	const OS_U64 ones = (OS_U64)-1 / 255;
+	const OS_U64 highs = ones * 0x80;
+	for(; str + sizeof(OS_U64) <= end; str += sizeof(OS_U64)){
+		OS_U64 w;
+		OS_MEMCPY(&w, str, sizeof(w));
+		OS_U64 quote = w ^ (ones * '"');
+		OS_U64 backslash = w ^ (ones * '\\');
+		OS_U64 special = ((quote - ones) & ~quote) | ((backslash - ones) & ~backslash) | (w - ones * 0x20) | w;
+		if(special & highs){
+			break;
+		}
+	}
+	for(; str < end; str++){
+		int c = *str;
+		if(c == '"' || c == '\\' || c < 0x20 || c >= 0x80){
+			break;
+		}
+	}
+	return str;
+}
+
+const OS_BYTE * OS::Core::JsonDecoder::skipSpaces(const OS_BYTE * str, const OS_BYTE * end)
+{
+	while(str < end && isJsonSpace(*str)){
+		str++;
+	}
+	return str;
+}
+
+bool OS::Core::JsonDecoder::isValidNumber(const OS_BYTE * str, int len)
+{
+	const OS_BYTE * end = str + len;
+	if(str < end && *str == '-'){
+		str++;
+	}
+	if(str == end){
+		return false;
+	}
+	if(*str == '0'){
+		str++;
+	}else if(isJsonDigit(*str)){
+		while(++str < end && isJsonDigit(*str));
+	}else{
+		return false;
+	}
+	if(str < end && *str == '.'){
+		while(++str < end && isJsonDigit(*str));
+	}
+	if(str < end && (*str == 'e' || *str == 'E')){
+		if(++str < end && (*str == '+' || *str == '-')){
+			str++;
+		}
+		if(str == end || !isJsonDigit(*str)){
+			return false;
+		}
+		while(++str < end && isJsonDigit(*str));
+	}
+	return str == end;
+}
+
+OS_NUMBER OS::Core::JsonDecoder::parseNumber(const OS_BYTE * str, int len)
+{
+	// exact powers of ten, a mantissa below 2^53 scaled by one of them is rounded correctly
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const OS_BYTE * cur = str, * end = str + len;
+	bool neg = cur < end && *cur == '-';
+	if(neg){
+		cur++;
+	}
+	// fraction digits are folded into decimal exponent so the number is mantissa * 10^exp
+	OS_U64 mantissa = 0;
+	int digits = 0, exp = 0;
+	for(; cur < end && isJsonDigit(*cur); cur++){
+		if(digits < 19){
+			mantissa = mantissa * 10 + (*cur - '0');
+			digits += mantissa != 0;
+		}else{
+			exp++;
+		}
+	}
+	if(cur < end && *cur == '.'){
+		for(cur++; cur < end && isJsonDigit(*cur); cur++){
+			if(digits < 19){
+				mantissa = mantissa * 10 + (*cur - '0');
+				digits += mantissa != 0;
+				exp--;
+			}
+		}
+	}
+	if(cur < end && (*cur == 'e' || *cur == 'E')){
+		bool exp_neg = ++cur < end && *cur == '-';
+		if(cur < end && (*cur == '-' || *cur == '+')){
+			cur++;
+		}
+		int e = 0;
+		for(; cur < end && isJsonDigit(*cur); cur++){
+			if(e < 10000){
+				e = e * 10 + (*cur - '0');
+			}
+		}
+		exp += exp_neg ? -e : e;
+	}
+	if(!mantissa){
+		return neg ? -(OS_NUMBER)0 : (OS_NUMBER)0;
+	}
+	if(mantissa <= ((OS_U64)1 << 53) && exp >= -22 && exp <= 22){
+		double val = (double)mantissa;
+		val = exp < 0 ? val / pow10[-exp] : val * pow10[exp];
+		return (OS_NUMBER)(neg ? -val : val);
+	}
+	// long mantissa or large exponent, strtod rounds such numbers correctly
+	double val;
+	char temp[64];
+	if(len < (int)sizeof(temp)){
+		OS_MEMCPY(temp, str, len);
+		temp[len] = '\0';
+		val = ::strtod(temp, NULL);
+	}else{
+		val = ::strtod(String(core->allocator, (const OS_CHAR*)str, len).toChar(), NULL);
+	}
+	return (OS_NUMBER)val;
+}
+
+void OS::Core::JsonDecoder::appendUtf8(int code)
+{
+	if(code < 0x80){
+		token.append((OS_CHAR)code);
+	}else if(code < 0x800){
+		token.append((OS_CHAR)(0xc0 | (code >> 6)));
+		token.append((OS_CHAR)(0x80 | (code & 0x3f)));
+	}else if(code < 0x10000){
+		token.append((OS_CHAR)(0xe0 | (code >> 12)));
+		token.append((OS_CHAR)(0x80 | ((code >> 6) & 0x3f)));
+		token.append((OS_CHAR)(0x80 | (code & 0x3f)));
+	}else{
+		token.append((OS_CHAR)(0xf0 | (code >> 18)));
+		token.append((OS_CHAR)(0x80 | ((code >> 12) & 0x3f)));
+		token.append((OS_CHAR)(0x80 | ((code >> 6) & 0x3f)));
+		token.append((OS_CHAR)(0x80 | (code & 0x3f)));
+	}
+}
+
+void OS::Core::JsonDecoder::flushHighSurrogate()
+{
+	if(high_surrogate){
+		// not paired surrogate is kept as is
+		appendUtf8(high_surrogate);
+		high_surrogate = 0;
+	}
+}
+
+void OS::Core::JsonDecoder::appendStringChars(const OS_BYTE * str, int len)
+{
+	if(len > 0){
+		flushHighSurrogate();
+		token.append(str, len);
+	}
+}
+
+bool OS::Core::JsonDecoder::addValue(const Value& val)
+{
+	core->retainValue(val);
+	core->allocator->vectorAddItem(pending->values, val OS_DBG_FILEPOS);
+	if(!frames.count){
+		state = STATE_DONE;
+	}else if(is_key){
+		is_key = false;
+		state = STATE_COLON;
+	}else{
+		state = STATE_NEXT;
+	}
+	return true;
+}
+
+bool OS::Core::JsonDecoder::addString(const void * buf, int size)
+{
+	if(is_key && !size){
+		core->pushStringValue(OS_TEXT("_empty_"));
+	}else{
+		core->pushStringValue(buf, size);
+	}
+	addValue(core->stack_values.lastElement());
+	core->allocator->pop();
+	return true;
+}
+
+bool OS::Core::JsonDecoder::addNumber(const OS_BYTE * str, int len)
+{
+	if(!isValidNumber(str, len)){
+		setError(ERROR_SYNTAX);
+		return false;
+	}
+	return addValue(parseNumber(str, len));
+}
+
+bool OS::Core::JsonDecoder::isLiteral(const OS_BYTE * str, int len, const char * literal, bool ignore_case)
+{
+	for(int i = 0; i < len; i++){
+		int c = ignore_case ? str[i] | 0x20 : str[i]; // literal contains letters only
+		if(c != literal[i]){
+			return false;
+		}
+	}
+	return !literal[len];
+}
+
+bool OS::Core::JsonDecoder::addLiteral(const OS_BYTE * str, int len)
+{
+	// case insensitive literals are allowed at top level only as it was before
+	bool ignore_case = !frames.count;
+	if(isLiteral(str, len, "null", ignore_case)){
+		return addValue(Value());
+	}
+	if(isLiteral(str, len, "true", ignore_case)){
+		return addValue(Value(true));
+	}
+	if(isLiteral(str, len, "false", ignore_case)){
+		return addValue(Value(false));
+	}
+	setError(ERROR_SYNTAX);
+	return false;
+}
+
+bool OS::Core::JsonDecoder::openFrame(int type)
+{
+	if(frames.count+1 >= max_depth){
+		setError(ERROR_DEPTH);
+		return false;
+	}
+	Frame frame = {type, pending->values.count};
+	core->allocator->vectorAddItem(frames, frame OS_DBG_FILEPOS);
+	state = type == FRAME_ARRAY ? STATE_FIRST_VALUE : STATE_FIRST_KEY;
+	return true;
+}
+
+bool OS::Core::JsonDecoder::closeArray()
+{
+	int start = frames.lastElement().start;
+	int count = pending->values.count - start;
+	frames.count--;
+	GCArrayValue * arr = core->pushArrayValue(count);
+	if(count > 0){
+		// retained items are moved to the new array
+		OS_MEMCPY(arr->values.buf, pending->values.buf + start, sizeof(Value) * count);
+		arr->values.count = count;
+		pending->values.count = start;
+	}
+	addValue(arr);
+	core->allocator->pop();
+	return true;
+}
+
+bool OS::Core::JsonDecoder::closeObject()
+{
+	int start = frames.lastElement().start;
+	int count = pending->values.count - start;
+	OS_ASSERT(!(count & 1));
+	frames.count--;
+	GCObjectValue * obj = core->pushObjectValue();
+	if(count > 0){
+		obj->table = core->newTable(OS_DBG_FILEPOS_START);
+		core->reserveTable(obj->table, count / 2);
+		Value * items = pending->values.buf + start;
+		for(int i = 0; i < count; i += 2){
+			core->setPropertyValue(obj, items[i], items[i+1], false);
+		}
+		core->releaseValues(items, count);
+		pending->values.count = start;
+	}
+	addValue(obj);
+	core->allocator->pop();
+	return true;
+}
+
+const OS_BYTE * OS::Core::JsonDecoder::parseStructure(const OS_BYTE * str, const OS_BYTE * end)
+{
+	int c = *str;
+	switch(state){
+	case STATE_DONE:
+		return setError(ERROR_SYNTAX);
+
+	case STATE_COLON:
+		if(c != ':'){
+			return setError(ERROR_SYNTAX);
+		}
+		state = STATE_VALUE;
+		return str + 1;
+
+	case STATE_NEXT:
+		OS_ASSERT(frames.count > 0);
+		if(frames.lastElement().type == FRAME_ARRAY){
+			if(c == ','){
+				state = STATE_VALUE;
+				return str + 1;
+			}
+			if(c == ']' && closeArray()){
+				return str + 1;
+			}
+		}else{
+			if(c == ','){
+				state = STATE_KEY;
+				return str + 1;
+			}
+			if(c == '}' && closeObject()){
+				return str + 1;
+			}
+		}
+		return setError(ERROR_SYNTAX);
+
+	case STATE_FIRST_KEY:
+		if(c == '}'){
+			closeObject();
+			return str + 1;
+		}
+		// no break
+
+	case STATE_KEY:
+		is_key = true;
+		if(c == '"'){
+			state = STATE_STRING;
+			return str + 1;
+		}
+		if(isJsonDigit(c)){
+			// numeric keys are allowed
+			state = STATE_NUMBER;
+			return str;
+		}
+		return setError(ERROR_SYNTAX);
+
+	case STATE_FIRST_VALUE:
+		if(c == ']'){
+			closeArray();
+			return str + 1;
+		}
+		// no break
+
+	case STATE_VALUE:
+		if(c == '"'){
+			state = STATE_STRING;
+			return str + 1;
+		}
+		if(c == '-' || isJsonDigit(c)){
+			state = STATE_NUMBER;
+			return str;
+		}
+		if(c == '{'){
+			return openFrame(FRAME_OBJECT) ? str + 1 : NULL;
+		}
+		if(c == '['){
+			return openFrame(FRAME_ARRAY) ? str + 1 : NULL;
+		}
+		if(isJsonAlpha(c)){
+			state = STATE_LITERAL;
+			return str;
+		}
+		if(c < 0x20 && !isJsonSpace(c)){
+			return setError(ERROR_CTRL_CHAR);
+		}
+		return setError(ERROR_SYNTAX);
+	}
+	OS_ASSERT(false);
+	return setError(ERROR_STATE_MISMATCH);
+}
+
+const OS_BYTE * OS::Core::JsonDecoder::parseString(const OS_BYTE * str, const OS_BYTE * end)
+{
+	const OS_BYTE * start = str;
+	for(;;){
+		for(; utf8_need > 0; utf8_need--, str++){
+			if(str == end){
+				appendStringChars(start, (int)(str - start));
+				return str;
+			}
+			int c = *str;
+			if(c < utf8_lo || c > utf8_hi){
+				return setError(ERROR_UTF8);
+			}
+			utf8_lo = 0x80;
+			utf8_hi = 0xbf;
+		}
+		str = skipStringChars(str, end);
+		if(str == end){
+			appendStringChars(start, (int)(str - start));
+			return str;
+		}
+		int c = *str;
+		if(c == '"'){
+			if(!token.buffer.count && !high_surrogate){
+				// the whole string is inside of the chunk
+				addString(start, (int)(str - start));
+			}else{
+				appendStringChars(start, (int)(str - start));
+				flushHighSurrogate();
+				addString(token.buffer.buf, token.buffer.count);
+				token.clear();
+			}
+			return str + 1;
+		}
+		if(c == '\\'){
+			appendStringChars(start, (int)(str - start));
+			state = STATE_ESCAPE;
+			return str + 1;
+		}
+		if(c < 0x20){
+			return setError(ERROR_CTRL_CHAR);
+		}
+		// leading byte of utf-8 sequence, overlong forms and surrogates are not allowed
+		if(c >= 0xc2 && c <= 0xdf){
+			utf8_need = 1;
+		}else if(c >= 0xe0 && c <= 0xef){
+			utf8_need = 2;
+			if(c == 0xe0) utf8_lo = 0xa0;
+			else if(c == 0xed) utf8_hi = 0x9f;
+		}else if(c >= 0xf0 && c <= 0xf4){
+			utf8_need = 3;
+			if(c == 0xf0) utf8_lo = 0x90;
+			else if(c == 0xf4) utf8_hi = 0x8f;
+		}else{
+			return setError(ERROR_UTF8);
+		}
+		str++;
+	}
+}
+
+const OS_BYTE * OS::Core::JsonDecoder::parseEscape(const OS_BYTE * str, const OS_BYTE * end)
+{
+	int c = *str;
+	if(c != 'u'){
+		flushHighSurrogate();
+	}
+	switch(c){
+	case '"': case '\\': case '/': token.append((OS_CHAR)c); break;
+	case 'b': token.append('\b'); break;
+	case 'f': token.append('\f'); break;
+	case 'n': token.append('\n'); break;
+	case 'r': token.append('\r'); break;
+	case 't': token.append('\t'); break;
+	case 'u':
+		state = STATE_UNICODE;
+		unicode_len = 0;
+		unicode_char = 0;
+		return str + 1;
+
+	default:
+		return setError(ERROR_SYNTAX);
+	}
+	state = STATE_STRING;
+	return str + 1;
+}
+
+const OS_BYTE * OS::Core::JsonDecoder::parseUnicode(const OS_BYTE * str, const OS_BYTE * end)
+{
+	for(; unicode_len < 4; unicode_len++, str++){
+		if(str == end){
+			return str;
+		}
+		int digit = dehexJsonChar(*str);
+		if(digit < 0){
+			return setError(ERROR_SYNTAX);
+		}
+		unicode_char = (unicode_char << 4) | digit;
+	}
+	if(high_surrogate && unicode_char >= 0xdc00 && unicode_char <= 0xdfff){
+		appendUtf8((((high_surrogate & 0x3ff) << 10) | (unicode_char & 0x3ff)) + 0x10000);
+		high_surrogate = 0;
+	}else{
+		flushHighSurrogate();
+		if(unicode_char >= 0xd800 && unicode_char <= 0xdbff){
+			high_surrogate = unicode_char;
+		}else{
+			appendUtf8(unicode_char);
+		}
+	}
+	state = STATE_STRING;
+	return str;
+}
+
+// number or literal is finished by any char which could not be part of it,
+// so it's completed when such char is found or at the end of input
+const OS_BYTE * OS::Core::JsonDecoder::parseToken(const OS_BYTE * str, const OS_BYTE * end)
+{
+	bool number = state == STATE_NUMBER;
+	const OS_BYTE * start = str;
+	if(number){
+		while(str < end && isJsonNumberChar(*str)) str++;
+	}else{
+		while(str < end && isJsonAlpha(*str)) str++;
+	}
+	if(str == end){
+		token.append(start, (int)(str - start));
+		return str;
+	}
+	if(!token.buffer.count){
+		// the whole token is inside of the chunk
+		return finishToken(start, (int)(str - start)) ? str : NULL;
+	}
+	token.append(start, (int)(str - start));
+	return finishToken(token.buffer.buf, token.buffer.count) ? str : NULL;
+}
+
+bool OS::Core::JsonDecoder::finishToken(const OS_BYTE * str, int len)
+{
+	bool ok = state == STATE_NUMBER ? addNumber(str, len) : addLiteral(str, len);
+	token.clear();
+	return ok;
+}
+
+bool OS::Core::JsonDecoder::write(const void * buf, int size)
+{
+	const OS_BYTE * str = (const OS_BYTE*)buf;
+	const OS_BYTE * end = str + size;
+	if(state == STATE_VALUE && !pending->values.count){
+		// error of the previous text is cleared when the next one is started
+		error_code = ERROR_NONE;
+	}
+	while(str < end){
+		switch(state){
+		case STATE_STRING:
+			str = parseString(str, end);
+			break;
+
+		case STATE_ESCAPE:
+			str = parseEscape(str, end);
+			break;
+
+		case STATE_UNICODE:
+			str = parseUnicode(str, end);
+			break;
+
+		case STATE_NUMBER:
+		case STATE_LITERAL:
+			str = parseToken(str, end);
+			break;
+
+		case STATE_ERROR:
+			return false;
+
+		default:
+			str = skipSpaces(str, end);
+			if(str < end){
+				str = parseStructure(str, end);
+			}
+			break;
+		}
+		if(!str){
+			return false;
+		}
+	}
+	return state != STATE_ERROR;
+}
+
+// finishes decoding and pushes result, returns false if text is not valid json
+bool OS::Core::JsonDecoder::finish()
+{
+	if(state == STATE_NUMBER || state == STATE_LITERAL){
+		if(!frames.count){
+			finishToken(token.buffer.buf, token.buffer.count);
+		}else{
+			setError(ERROR_SYNTAX);
+		}
+	}
+	if(state != STATE_DONE){
+		setError(ERROR_SYNTAX);
+		return false;
+	}
+	OS_ASSERT(pending->values.count == 1);
+	core->pushValue(pending->values[0]);
+	return true;
+}
+
+OS::Core::ValueSerializer::ValueSerializer(Core * p_core): writer(p_core->allocator)
+{
+	core = p_core;
+	num_refs = 0;
+	depth = 0;
+	writer.writeBytes(OS_SERIALIZE_SIGNATURE, sizeof(OS_SERIALIZE_SIGNATURE)-1);
+}
+
+OS::Core::ValueSerializer::~ValueSerializer()
+{
+	core->allocator->vectorClear(refs);
+}
+
+bool OS::Core::ValueSerializer::writeRef(GCValue * value)
+{
+	if(num_refs*2 >= refs.count){
+		Vector<Ref> old_refs = refs;
+		int new_size = refs.count ? refs.count * 2 : 256;
+		refs.buf = (Ref*)core->allocator->malloc(sizeof(Ref) * new_size OS_DBG_FILEPOS);
+		refs.capacity = refs.count = new_size;
+		OS_MEMSET(refs.buf, 0, sizeof(Ref) * new_size);
+		for(int i = 0; i < old_refs.count; i++){
+			if(old_refs[i].value){
+				int slot = OS_PTR_SLOT(old_refs[i].value, new_size-1);
+				while(refs[slot].value){
+					slot = (slot + 1) & (new_size-1);
+				}
+				refs[slot] = old_refs[i];
+			}
+		}
+		core->allocator->vectorClear(old_refs);
+	}
+	int mask = refs.count-1;
+	int slot = OS_PTR_SLOT(value, mask);
+	for(; refs[slot].value; slot = (slot + 1) & mask){
+		if(refs[slot].value == value){
+			writer.writeByte(SERIALIZE_REF);
+			writer.writeUVariable(refs[slot].index);
+			return true;
+		}
+	}
+	refs[slot].value = value;
+	refs[slot].index = num_refs++;
+	return false;
+}
+
+bool OS::Core::ValueSerializer::isSerializableKey(const Value& index)
+{
+	switch(OS_VALUE_TYPE(index)){
+	case OS_VALUE_TYPE_BOOL:
+	case OS_VALUE_TYPE_NUMBER:
+	case OS_VALUE_TYPE_STRING:
+	case OS_VALUE_TYPE_ARRAY:
+	case OS_VALUE_TYPE_OBJECT:
+		return true;
+	}
+	return false;
+}
+
+bool OS::Core::ValueSerializer::enter()
+{
+	// unserializer doesn't restore deeper values so they are not written
+	if(depth >= OS_SERIALIZE_MAX_DEPTH){
+		core->allocator->setException(String::format(core->allocator, OS_TEXT("value is too deep to serialize, max depth is %d"), OS_SERIALIZE_MAX_DEPTH));
+		return false;
+	}
+	depth++;
+	return true;
+}
+
+bool OS::Core::ValueSerializer::serialize(const Value& val)
+{
+	switch(OS_VALUE_TYPE(val)){
+	default:
+		// functions and userdata could not be restored
+		writer.writeByte(SERIALIZE_NULL);
+		return true;
+
+	case OS_VALUE_TYPE_BOOL:
+		writer.writeByte(OS_VALUE_VARIANT(val).boolean ? SERIALIZE_TRUE : SERIALIZE_FALSE);
+		return true;
+
+	case OS_VALUE_TYPE_NUMBER:
+		{
+			OS_NUMBER number = OS_VALUE_NUMBER(val);
+			if(number >= -0x7fffffff && number <= 0x7fffffff && (OS_NUMBER)(int)number == number 
+				&& (number != 0 || 1 / number > 0))
+			{
+				int i = (int)number;
+				if(i >= 0 && i <= 0xff - SERIALIZE_SMALL_INT){
+					writer.writeByte(SERIALIZE_SMALL_INT + i);
+				}else if(i >= 0){
+					writer.writeByte(SERIALIZE_INT);
+					writer.writeUVariable(i);
+				}else{
+					writer.writeByte(SERIALIZE_NEG_INT);
+					writer.writeUVariable(-i-1);
+				}
+				return true;
+			}
+			writer.writeByte(SERIALIZE_DOUBLE);
+			writer.writeDouble((double)number);
+			return true;
+		}
+
+	case OS_VALUE_TYPE_STRING:
+		if(!writeRef(OS_VALUE_VARIANT(val).value)){
+			OS_ASSERT(dynamic_cast<GCStringValue*>(OS_VALUE_VARIANT(val).string));
+			GCStringValue * string = OS_VALUE_VARIANT(val).string;
+			writer.writeByte(SERIALIZE_STRING);
+			writer.writeUVariable(string->getDataSize());
+			writer.writeBytes(string->toBytes(), string->getDataSize());
+		}
+		return true;
+
+	case OS_VALUE_TYPE_ARRAY:
+		if(!writeRef(OS_VALUE_VARIANT(val).value)){
+			OS_ASSERT(dynamic_cast<GCArrayValue*>(OS_VALUE_VARIANT(val).arr));
+			GCArrayValue * arr = OS_VALUE_VARIANT(val).arr;
+			if(!enter()){
+				return false;
+			}
+			writer.writeByte(SERIALIZE_ARRAY);
+			writer.writeUVariable(arr->values.count);
+			for(int i = 0; i < arr->values.count; i++){
+				if(!serialize(arr->values[i])){
+					return false;
+				}
+			}
+			depth--;
+		}
+		return true;
+
+	case OS_VALUE_TYPE_OBJECT:
+		if(!writeRef(OS_VALUE_VARIANT(val).value)){
+			OS_ASSERT(dynamic_cast<GCValue*>(OS_VALUE_VARIANT(val).value));
+			Table * table = OS_VALUE_VARIANT(val).value->table;
+			if(!enter()){
+				return false;
+			}
+			// properties with function or userdata keys could not be restored so they are skipped
+			int count = 0;
+			Property * prop;
+			for(prop = table ? table->first : NULL; prop; prop = prop->next){
+				count += isSerializableKey(prop->index);
+			}
+			writer.writeByte(SERIALIZE_OBJECT);
+			writer.writeUVariable(count);
+			for(prop = table ? table->first : NULL; prop; prop = prop->next){
+				if(isSerializableKey(prop->index) && (!serialize(prop->index) || !serialize(prop->value))){
+					return false;
+				}
+			}
+			depth--;
+		}
+		return true;
+	}
+	return true;
+}
+
+OS::Core::ValueUnserializer::ValueUnserializer(Core * p_core, const void * buf, int size)
+	: reader(NULL, (OS_BYTE*)buf, size) // buffer is not owned
+{
+	core = p_core;
+	depth = 0;
+}
+
+OS::Core::ValueUnserializer::~ValueUnserializer()
+{
+	for(int i = 0; i < refs.count; i++){
+		core->releaseValue(refs[i]);
+	}
+	core->allocator->vectorClear(refs);
+}
+
+void OS::Core::ValueUnserializer::addRef(const Value& val)
+{
+	// value could be dropped before the next reference to it (e.g. value of rejected key)
+	core->retainValue(val);
+	core->allocator->vectorAddItem(refs, val OS_DBG_FILEPOS);
+}
+
+bool OS::Core::ValueUnserializer::readUVariable(int& value)
+{
+	// the buffer is null terminated string so broken variable could not go far out of the buffer
+	if(reader.getPos() >= reader.getSize()){
+		return false;
+	}
+	value = reader.readUVariable();
+	return value >= 0 && reader.getPos() <= reader.getSize();
+}
+
+bool OS::Core::ValueUnserializer::readSize(int& size, int item_size)
+{
+	// every item takes one byte at least so size could be checked before allocation
+	return readUVariable(size) && size <= (reader.getSize() - reader.getPos()) / item_size;
+}
+
+bool OS::Core::ValueUnserializer::readValue()
+{
+	if(reader.getPos() >= reader.getSize()){
+		return false;
+	}
+	int tag = reader.readByte(), size;
+	switch(tag){
+	case SERIALIZE_NULL:
+		core->pushNull();
+		return true;
+
+	case SERIALIZE_TRUE:
+	case SERIALIZE_FALSE:
+		core->pushBool(tag == SERIALIZE_TRUE);
+		return true;
+
+	case SERIALIZE_INT:
+	case SERIALIZE_NEG_INT:
+		if(!readUVariable(size)){
+			return false;
+		}
+		core->pushNumber(tag == SERIALIZE_INT ? (OS_NUMBER)size : -(OS_NUMBER)size - 1);
+		return true;
+
+	case SERIALIZE_DOUBLE:
+		if(reader.getSize() - reader.getPos() < (int)sizeof(double)){
+			return false;
+		}
+		core->pushNumber((OS_NUMBER)reader.readDouble());
+		return true;
+
+	case SERIALIZE_STRING:
+		if(!readSize(size, 1)){
+			return false;
+		}
+		core->pushStringValue(reader.cur, size);
+		reader.movePos(size);
+		addRef(core->stack_values.lastElement());
+		return true;
+
+	case SERIALIZE_REF:
+		if(!readUVariable(size) || size >= refs.count){
+			return false;
+		}
+		core->pushValue(refs[size]);
+		return true;
+
+	case SERIALIZE_ARRAY:
+		{
+			if(!readSize(size, 1) || depth >= OS_SERIALIZE_MAX_DEPTH){
+				return false;
+			}
+			GCArrayValue * arr = core->pushArrayValue(size);
+			addRef(arr);
+			depth++;
+			for(int i = 0; i < size; i++){
+				if(!readValue()){
+					return false;
+				}
+				Value item = core->stack_values.lastElement();
+				core->retainValue(item);
+				core->allocator->vectorAddItem(arr->values, item OS_DBG_FILEPOS);
+				core->pop();
+			}
+			depth--;
+			return true;
+		}
+
+	case SERIALIZE_OBJECT:
+		{
+			if(!readSize(size, 2) || depth >= OS_SERIALIZE_MAX_DEPTH){
+				return false;
+			}
+			GCObjectValue * obj = core->pushObjectValue();
+			addRef(obj);
+			if(size > 0){
+				obj->table = core->newTable(OS_DBG_FILEPOS_START);
+				core->reserveTable(obj->table, size);
+			}
+			depth++;
+			for(int i = 0; i < size; i++){
+				if(!readValue() || !readValue()){
+					return false;
+				}
+				if(core->stack_values[core->stack_values.count-2].isNull()){
+					// null key is never written
+					return false;
+				}
+				core->setPropertyValue(obj, core->stack_values[core->stack_values.count-2], core->stack_values.lastElement(), false);
+				core->pop(2);
+			}
+			depth--;
+			return true;
+		}
+	}
+	OS_ASSERT(tag >= SERIALIZE_SMALL_INT);
+	if(tag >= SERIALIZE_SMALL_INT){
+		core->pushNumber(tag - SERIALIZE_SMALL_INT);
+		return true;
+	}
+	return false;
+}
+
+bool OS::Core::ValueUnserializer::unserialize()
+{
+	int start_count = core->stack_values.count;
+	int len = sizeof(OS_SERIALIZE_SIGNATURE)-1;
+	if(reader.getSize() >= len && reader.checkBytes(OS_SERIALIZE_SIGNATURE, len) && readValue() && reader.getPos() == reader.getSize()){
+		return true;
+	}
+	core->pop(core->stack_values.count - start_count);
+	return false;
+}
+
+// =====================================================================
+
+OS::Core::ValueCloner::ValueCloner(Core * p_core, Core * p_src_core)
+{
+	core = p_core;
+	src_core = p_src_core;
+	num_refs = 0;
+}
+
+OS::Core::ValueCloner::~ValueCloner()
+{
+	core->allocator->vectorClear(refs);
+	core->allocator->vectorClear(pending);
+}
+
+OS::Core::GCValue * OS::Core::ValueCloner::findRef(GCValue * src)
+{
+	if(!refs.count){
+		return NULL;
+	}
+	int mask = refs.count-1;
+	int slot = OS_PTR_SLOT(src, mask);
+	for(; refs[slot].src; slot = (slot + 1) & mask){
+		if(refs[slot].src == src){
+			return refs[slot].dest;
+		}
+	}
+	return NULL;
+}
+
+void OS::Core::ValueCloner::addRef(GCValue * src, GCValue * dest)
+{
+	if(num_refs*2 >= refs.count){
+		Vector<Ref> old_refs = refs;
+		int new_size = refs.count ? refs.count * 2 : 64;
+		refs.buf = (Ref*)core->allocator->malloc(sizeof(Ref) * new_size OS_DBG_FILEPOS);
+		refs.capacity = refs.count = new_size;
+		OS_MEMSET(refs.buf, 0, sizeof(Ref) * new_size);
+		for(int i = 0; i < old_refs.count; i++){
+			if(old_refs[i].src){
+				int slot = OS_PTR_SLOT(old_refs[i].src, new_size-1);
+				while(refs[slot].src){
+					slot = (slot + 1) & (new_size-1);
+				}
+				refs[slot] = old_refs[i];
+			}
+		}
+		core->allocator->vectorClear(old_refs);
+	}
+	int mask = refs.count-1;
+	int slot = OS_PTR_SLOT(src, mask);
+	while(refs[slot].src){
+		slot = (slot + 1) & mask;
+	}
+	refs[slot].src = src;
+	refs[slot].dest = dest;
+	num_refs++;
+}
+
+int OS::Core::ValueCloner::cloneValue(const Value& val, Value& dest)
+{
+	GCValue * src, * new_value;
+	switch(OS_VALUE_TYPE(val)){
+	case OS_VALUE_TYPE_NULL:
+	case OS_VALUE_TYPE_BOOL:
+	case OS_VALUE_TYPE_NUMBER:
+		dest = val;
+		return 0;
+
+	case OS_VALUE_TYPE_STRING:
+		if(src_core == core){
+			// strings are immutable so they are shared inside of the same OS instance
+			dest = val;
+			return 0;
+		}
+		src = OS_VALUE_VARIANT(val).value;
+		if((new_value = findRef(src)) != NULL){
+			dest = new_value;
+			return 0;
+		}
+		new_value = core->pushStringValue((void*)OS_VALUE_VARIANT(val).string->toChar(), OS_VALUE_VARIANT(val).string->getDataSize());
+		addRef(src, new_value);
+		dest = new_value;
+		return 1;
+
+	case OS_VALUE_TYPE_ARRAY:
+		OS_ASSERT(dynamic_cast<GCArrayValue*>(OS_VALUE_VARIANT(val).arr));
+		src = OS_VALUE_VARIANT(val).value;
+		if((new_value = findRef(src)) != NULL){
+			dest = new_value;
+			return 0;
+		}
+		if(src_core == core && src->is_frozen){
+			dest = val;
+			return 0;
+		}
+		new_value = core->pushArrayValue(((GCArrayValue*)src)->values.count);
+		if(src_core == core && new_value->prototype != src->prototype){
+			core->setValue(new_value->prototype, src->prototype);
+		}
+		break;
+
+	case OS_VALUE_TYPE_OBJECT:
+		OS_ASSERT(dynamic_cast<GCObjectValue*>(OS_VALUE_VARIANT(val).object));
+		src = OS_VALUE_VARIANT(val).value;
+		if((new_value = findRef(src)) != NULL){
+			dest = new_value;
+			return 0;
+		}
+		if(src_core == core && src->is_frozen){
+			dest = val;
+			return 0;
+		}
+		new_value = core->pushObjectValue(src_core == core ? src->prototype : core->prototypes[PROTOTYPE_OBJECT]);
+		break;
+
+	default:
+		// functions & userdata are shared inside of the same OS instance and could not be moved to other one
+		if(src_core == core){
+			dest = val;
+		}else{
+			dest = Value();
+		}
+		return 0;
+	}
+	// frozen value is shared inside of the same OS instance so copy of frozen value is frozen in other one
+	new_value->is_frozen = src->is_frozen;
+	addRef(src, new_value);
+	Ref item = {src, new_value};
+	core->allocator->vectorAddItem(pending, item OS_DBG_FILEPOS);
+	dest = new_value;
+	return 1;
+}
+
+void OS::Core::ValueCloner::fill(GCValue * src, GCValue * dest)
+{
+	Value index, value;
+	int pushed;
+	if(src->type == OS_VALUE_TYPE_ARRAY){
+		GCArrayValue * src_arr = (GCArrayValue*)src;
+		GCArrayValue * dest_arr = (GCArrayValue*)dest;
+		for(int i = 0; i < src_arr->values.count; i++){
+			pushed = cloneValue(src_arr->values[i], value);
+			core->retainValue(value);
+			core->allocator->vectorAddItem(dest_arr->values, value OS_DBG_FILEPOS);
+			core->pop(pushed);
+		}
+		if(src_core != core){
+			return;
+		}
+	}
+	if(src->table && src->table->count > 0){
+		// keys of source table are unique so properties are added without lookup
+		OS_ASSERT(!dest->table);
+		dest->table = core->newTable(OS_DBG_FILEPOS_START);
+		core->reserveTable(dest->table, src->table->count);
+		for(Property * prop = src->table->first; prop; prop = prop->next){
+			pushed = cloneValue(prop->index, index);
+			pushed += cloneValue(prop->value, value);
+			if(OS_VALUE_TYPE(index) != OS_VALUE_TYPE_NULL){
+				core->addTableProperty(dest->table, index, value);
+			}
+			core->pop(pushed);
 		}
-		buf.append(*str);
+		dest->table->next_index = src->table->next_index;
+	}
+}
+
+void OS::Core::ValueCloner::pushClone(const Value& val)
+{
+	Value dest;
+	if(!cloneValue(val, dest)){
+		core->pushValue(dest);
+	}
+	// containers are filled in any order because every one is already linked to own parent
+	while(pending.count > 0){
+		Ref item = pending.lastElement();
+		pending.count--;
+		fill(item.src, item.dest);
 	}
-	buf += OS_TEXT("\"");
 }
 
 // =====================================================================
@@ -14797,6 +16885,7 @@ OS::Core::Strings::Strings(OS * allocator)
 	func_push(allocator, OS_TEXT("push")),
 	func_valueOf(allocator, OS_TEXT("valueOf")),
 	func_clone(allocator, OS_TEXT("clone")),
+	func_toJson(allocator, OS_TEXT("toJson")),
 	func_concat(allocator, OS_TEXT("concat")),
 	func_echo(allocator, OS_TEXT("echo")),
 	func_require(allocator, OS_TEXT("require")),
@@ -14960,6 +17049,188 @@ int OS::seekFile(FileHandle * f, int offset, int whence)
 	return 0;
 }
 
+static void * mapFileData(const OS_CHAR * filename, int& size)
+{
+#ifdef OS_MMAP_SUPPORTED
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0){
+		return NULL;
+	}
+	void * data = NULL;
+	struct stat st;
+	if(::fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size < 0x7fffffff){
+		data = ::mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED){
+			data = NULL;
+		}else{
+			size = (int)st.st_size;
+		}
+	}
+	::close(fd);
+	return data;
+#else
+	return NULL;
+#endif
+}
+
+static void unmapFileData(void * data, int size)
+{
+#ifdef OS_MMAP_SUPPORTED
+	::munmap(data, (size_t)size);
+#endif
+}
+
+void * OS::mapFile(const OS_CHAR * filename, int& size)
+{
+	return mapFileData(filename, size);
+}
+
+void OS::unmapFile(void * data, int size)
+{
+	unmapFileData(data, size);
+}
+
+// =====================================================================
+
+OS::Bundle::Bundle()
+{
+	data = NULL;
+	size = 0;
+	mapped = false;
+	root_path = NULL;
+	root_path_len = 0;
+	entries = NULL;
+	num_entries = 0;
+}
+
+OS::Bundle::~Bundle()
+{
+	::free(entries);
+	::free(root_path);
+	if(mapped){
+		unmapFileData(data, size);
+	}else{
+		::free(data);
+	}
+}
+
+OS::Bundle * OS::Bundle::load(OS * os, const OS_CHAR * filename, const OS_CHAR * p_root_path)
+{
+	Bundle * bundle = new Bundle();
+	// bundle is process wide so it's mapped directly, not by OS::mapFile of the instance
+	bundle->data = (OS_BYTE*)mapFileData(filename, bundle->size);
+	bundle->mapped = bundle->data != NULL;
+	if(!bundle->data){
+		FileHandle * f = os->openFile(filename, "rb");
+		if(!f){
+			delete bundle;
+			return NULL;
+		}
+		bundle->size = os->getFileSize(f);
+		bundle->data = (OS_BYTE*)::malloc(bundle->size > 0 ? bundle->size : 1);
+		if(os->readFile(bundle->data, bundle->size, f) != bundle->size){
+			bundle->size = 0;
+		}
+		os->closeFile(f);
+	}
+
+	Core::MemStreamReader reader(NULL, bundle->data, bundle->size);
+	int len = (int)OS_STRLEN(OS_BUNDLE_HEADER);
+	int version_len = (int)OS_STRLEN(OS_VERSION)+1;
+	if(bundle->size < len + version_len + 10 || !reader.checkBytes(OS_BUNDLE_HEADER, len) 
+		|| reader.readByte() != version_len || !reader.checkBytes(OS_VERSION, version_len) 
+		|| reader.readByte() != OS_COMPILED_FORMAT)
+	{
+		delete bundle;
+		return NULL;
+	}
+	int num_entries = reader.readInt32();
+	len = reader.readInt32();
+	if(num_entries < 0 || len < 0 || len > bundle->size - reader.getPos()){
+		delete bundle;
+		return NULL;
+	}
+	const OS_CHAR * saved_root_path = (const OS_CHAR*)reader.cur;
+	reader.movePos(len);
+	if(p_root_path){
+		len = (int)OS_STRLEN(p_root_path);
+	}else{
+		p_root_path = saved_root_path;
+	}
+	for(; len > 0 && OS_IS_SLASH(p_root_path[len-1]); len--);
+	bundle->root_path = (OS_CHAR*)::malloc((len + 1) * sizeof(OS_CHAR));
+	OS_MEMCPY(bundle->root_path, p_root_path, len * sizeof(OS_CHAR));
+	bundle->root_path[len] = OS_TEXT('\0');
+	bundle->root_path_len = len;
+
+	reader.movePos((4 - (reader.getPos() & 3)) & 3);
+	if(num_entries > (bundle->size - reader.getPos()) / 16){
+		delete bundle;
+		return NULL;
+	}
+	bundle->entries = (Entry*)::malloc(sizeof(Entry) * (num_entries > 0 ? num_entries : 1));
+	for(int i = 0; i < num_entries; i++){
+		Entry * entry = bundle->entries + i;
+		int name_pos = reader.readInt32();
+		entry->name_len = reader.readInt32();
+		int data_pos = reader.readInt32();
+		entry->size = reader.readInt32();
+		if(name_pos < 0 || entry->name_len < 0 || name_pos > bundle->size - entry->name_len
+			|| data_pos < 0 || entry->size < 0 || data_pos > bundle->size - entry->size)
+		{
+			delete bundle;
+			return NULL;
+		}
+		entry->name = (const OS_CHAR*)(bundle->data + name_pos);
+		entry->data = bundle->data + data_pos;
+		bundle->num_entries++;
+	}
+	return bundle;
+}
+
+const OS_CHAR * OS::Bundle::getRootPath() const
+{
+	return root_path;
+}
+
+int OS::Bundle::getCount() const
+{
+	return num_entries;
+}
+
+const OS::Bundle::Entry * OS::Bundle::getEntry(int i) const
+{
+	return i >= 0 && i < num_entries ? entries + i : NULL;
+}
+
+const OS::Bundle::Entry * OS::Bundle::find(const OS_CHAR * filename, int len) const
+{
+	if(root_path_len > 0){
+		if(len <= root_path_len+1 || OS_MEMCMP(filename, root_path, root_path_len * sizeof(OS_CHAR)) != 0 
+			|| !OS_IS_SLASH(filename[root_path_len]))
+		{
+			return NULL;
+		}
+		filename += root_path_len + 1;
+		len -= root_path_len + 1;
+	}
+	int start = 0, end = num_entries;
+	while(start < end){
+		int mid = (start + end) >> 1;
+		const Entry * entry = entries + mid;
+		int cmp = Utils::cmp(filename, len * sizeof(OS_CHAR), entry->name, entry->name_len * sizeof(OS_CHAR));
+		if(!cmp){
+			return entry;
+		}
+		if(cmp < 0){
+			end = mid;
+		}else{
+			start = mid + 1;
+		}
+	}
+	return NULL;
+}
+
 void OS::closeFile(FileHandle * f)
 {
 	if(f){
@@ -15230,6 +17501,8 @@ OS::Core::Core(OS * p_allocator)
 	settings.primary_compiled_file = false;
 	settings.sourcecode_must_exist = false;
 
+	bundle = NULL;
+
 	// gcInitGreyList();
 	gc_start_when_used_bytes = 2*1024*1024;
 	gc_next_when_used_bytes = 2*1024*1024;
@@ -15660,17 +17933,17 @@ OS::String OS::resolvePath(const String& filename, const String& cur_path)
 			resolved_path = cur_path + OS_PATH_SEPARATOR + filename;
 		}
 	}
-	if(isFileExist(resolved_path)){
+	if(isBundleFile(resolved_path) || isFileExist(resolved_path)){
 		return resolved_path;
 	}
 	String ext = getFilenameExt(resolved_path);
 	if(ext.isEmpty()){ // || ext == OS_EXT_COMPILED){
 		String filename = resolved_path + OS_EXT_SOURCECODE; // changeFilenameExt(resolved_path, OS_EXT_SOURCECODE);
-		if(isFileExist(filename)){
+		if(isBundleFile(filename) || isFileExist(filename)){
 			return filename;
 		}
 		filename = resolved_path + OS_EXT_TEMPLATE; // changeFilenameExt(resolved_path, OS_EXT_SOURCECODE);
-		if(isFileExist(filename)){
+		if(isBundleFile(filename) || isFileExist(filename)){
 			return filename;
 		}
 		/* resolved_path = getCompiledFilename(resolved_path);
@@ -15839,6 +18112,7 @@ void OS::Core::clearValue(GCValue * val)
 		{
 			OS_ASSERT(dynamic_cast<GCStringValue*>(val));
 			unregisterStringRef((GCStringValue*)val);
+			((GCStringValue*)val)->freeUtf8Index(allocator);
 			break;
 		}
 
@@ -16503,6 +18777,10 @@ bool OS::Core::hasSpecialPrefix(const Value& value)
 		OS_ASSERT(OS_VALUE_TYPE(local7_index) == (local7_index_type)); \
 		const Value& local7_value = (_value); \
 		OS_ASSERT(local7_table_value->type != OS_VALUE_TYPE_STRING); \
+		if(local7_table_value->is_frozen){ \
+			checkValueWritable(Value(local7_table_value, Value::Valid())); \
+			break; \
+		} \
 		if(local7_table_value->type == OS_VALUE_TYPE_ARRAY && local7_index_type == OS_VALUE_TYPE_NUMBER){ \
 			OS_ASSERT(dynamic_cast<GCArrayValue*>(local7_table_value)); \
 			GCArrayValue * arr = (GCArrayValue*)local7_table_value; \
@@ -16609,6 +18887,10 @@ void OS::Core::setPropertyValue(GCValue * table_value, const Value& _index, Valu
 		if(type == OS_VALUE_TYPE_ARRAY && local8_index_type == OS_VALUE_TYPE_NUMBER){ \
 			OS_ASSERT(dynamic_cast<GCArrayValue*>(OS_VALUE_VARIANT(local8_table_value).value)); \
 			GCArrayValue * arr = (GCArrayValue*)OS_VALUE_VARIANT(local8_table_value).value; \
+			if(arr->is_frozen){ \
+				checkValueWritable(local8_table_value); \
+				break; \
+			} \
 			int i; OS_NUMBER_TO_INT(i, OS_VALUE_NUMBER(local8_index)); \
 			if(i >= 0 || (i += arr->values.count) >= 0){ \
 				if(i == arr->values.count){ \
@@ -17311,54 +19593,69 @@ void OS::Core::pushCloneValue(Value value)
 
 void OS::Core::pushCloneValueFrom(OS * other, Value other_val)
 {
-	switch(OS_VALUE_TYPE(other_val)){
-	default:
-	case OS_VALUE_TYPE_NULL:
-		pushNull();
-		return;
-
-	case OS_VALUE_TYPE_BOOL:
-		pushBool(OS_VALUE_VARIANT(other_val).boolean ? true : false);
-		return;
+	ValueCloner cloner(this, other->core);
+	cloner.pushClone(other_val);
+}
 
-	case OS_VALUE_TYPE_NUMBER:
-		pushNumber(OS_VALUE_NUMBER(other_val));
-		return;
+void OS::Core::pushDeepCloneValue(Value val)
+{
+	ValueCloner cloner(this, this);
+	cloner.pushClone(val);
+}
 
-	case OS_VALUE_TYPE_STRING:
-		pushStringValue((void*)OS_VALUE_VARIANT(other_val).string->toChar(), OS_VALUE_VARIANT(other_val).string->getDataSize());
+void OS::Core::freezeValue(const Value& val)
+{
+	Vector<GCValue*> list;
+	GCValue * value = val.getGCValue();
+	if(value && (value->type == OS_VALUE_TYPE_USERDATA || value->type == OS_VALUE_TYPE_USERPTR) && !value->is_frozen){
+		// userdata is frozen only if it's passed directly, e.g. native view of shared frozen value
+		value->is_frozen = true;
 		return;
-
-	case OS_VALUE_TYPE_ARRAY:
-		{
-			OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(other_val).arr));
-			Core::GCArrayValue * src_arr = OS_VALUE_VARIANT(other_val).arr;
-			Core::GCArrayValue * dest_arr = pushArrayValue(src_arr->values.count);
-			for(int i = 0; i < src_arr->values.count; i++){
-				pushCloneValueFrom(other, src_arr->values[i]);
-				retainValue(stack_values.lastElement());
-				allocator->vectorAddItem(dest_arr->values, stack_values.lastElement() OS_DBG_FILEPOS);
-				pop();
+	}
+	if(value && (value->type == OS_VALUE_TYPE_ARRAY || value->type == OS_VALUE_TYPE_OBJECT) && !value->is_frozen){
+		allocator->vectorAddItem(list, value OS_DBG_FILEPOS);
+	}
+	// items of frozen value are frozen too so already frozen values are not visited again
+	while(list.count > 0){
+		value = list.lastElement();
+		list.count--;
+		if(value->is_frozen){
+			continue;
+		}
+		value->is_frozen = true;
+		if(value->type == OS_VALUE_TYPE_ARRAY){
+			GCArrayValue * arr = (GCArrayValue*)value;
+			for(int i = 0; i < arr->values.count; i++){
+				GCValue * item = arr->values[i].getGCValue();
+				if(item && (item->type == OS_VALUE_TYPE_ARRAY || item->type == OS_VALUE_TYPE_OBJECT) && !item->is_frozen){
+					allocator->vectorAddItem(list, item OS_DBG_FILEPOS);
+				}
 			}
-			return;
 		}
-
-	case OS_VALUE_TYPE_OBJECT:
-		{
-			OS_ASSERT(dynamic_cast<Core::GCObjectValue*>(OS_VALUE_VARIANT(other_val).object));
-			Core::GCObjectValue * src_obj = OS_VALUE_VARIANT(other_val).object;
-			Core::GCObjectValue * dest_obj = pushObjectValue();
-			if(src_obj->table && src_obj->table->count > 0){
-				for(Property * prop = src_obj->table->first; prop; prop = prop->next){
-					pushStackValue(-1);
-					pushCloneValueFrom(other, prop->index);
-					pushCloneValueFrom(other, prop->value);
-					allocator->setProperty(false);
+		if(value->table){
+			for(Property * prop = value->table->first; prop; prop = prop->next){
+				GCValue * item = prop->index.getGCValue();
+				if(item && (item->type == OS_VALUE_TYPE_ARRAY || item->type == OS_VALUE_TYPE_OBJECT) && !item->is_frozen){
+					allocator->vectorAddItem(list, item OS_DBG_FILEPOS);
+				}
+				item = prop->value.getGCValue();
+				if(item && (item->type == OS_VALUE_TYPE_ARRAY || item->type == OS_VALUE_TYPE_OBJECT) && !item->is_frozen){
+					allocator->vectorAddItem(list, item OS_DBG_FILEPOS);
 				}
 			}
-			return;
 		}
 	}
+	allocator->vectorClear(list);
+}
+
+bool OS::Core::checkValueWritable(const Value& val)
+{
+	GCValue * value = val.getGCValue();
+	if(value && value->is_frozen){
+		allocator->setException(String::format(allocator, OS_TEXT("%s is frozen, you should not modify the one"), getValueClassname(value).toChar()));
+		return false;
+	}
+	return true;
 }
 
 void OS::Core::pushOpResultValue(OpcodeType opcode, const Value& value)
@@ -18148,6 +20445,22 @@ void OS::clone(int offs)
 	core->pushCloneValue(core->getStackValue(offs));
 }
 
+void OS::deepClone(int offs)
+{
+	core->pushDeepCloneValue(core->getStackValue(offs));
+}
+
+void OS::freeze(int offs)
+{
+	core->freezeValue(core->getStackValue(offs));
+}
+
+bool OS::isFrozen(int offs)
+{
+	Core::GCValue * value = core->getStackValue(offs).getGCValue();
+	return value && value->is_frozen;
+}
+
 int OS::getStackSize()
 {
 	return core->stack_values.count;
@@ -20507,6 +22820,9 @@ corrupted:
 				prog = stack_func->func->prog;
 				OS_ASSERT(b > 0 && b < prog->num_functions);
 				FunctionDecl * func_decl = prog->functions + b;
+				if(func_decl->decl_data_pos >= 0){
+					prog->decodeFunction(func_decl);
+				}
 				allocator->vectorReserveCapacity(stack_func->sub_funcs, b+1 OS_DBG_FILEPOS);
 				while(stack_func->sub_funcs.count <= b){
 					allocator->vectorAddItem(stack_func->sub_funcs, (GCFunctionValue*)NULL OS_DBG_FILEPOS);
@@ -21864,6 +24180,18 @@ void OS::initCoreFunctions()
 			return 0;
 		}
 
+		static int buildBundle(OS * os, int params, int, int, void*)
+		{
+			if(params < 3){
+				return 0;
+			}
+			String bundle_filename = os->toString(-params);
+			String root_path = os->toString(-params+1);
+			os->pushStackValue(-params+2);
+			os->pushBool(os->buildBundle(bundle_filename, root_path));
+			return 1;
+		}
+
 		static int resolvePath(OS * os, int params, int, int, void*)
 		{
 			if(params >= 1){
@@ -22110,6 +24438,42 @@ void OS::initCoreFunctions()
 			return 1;
 		}
 
+		static int serialize(OS * os, int params, int, int, void*)
+		{
+			if(params < 1) return 0;
+			Core::ValueSerializer serializer(os->core);
+			if(!serializer.serialize(os->core->getStackValue(-params))){
+				return 0;
+			}
+			os->core->pushStringValue(serializer.writer.buffer.buf, serializer.writer.buffer.count);
+			return 1;
+		}
+
+		static int unserialize(OS * os, int params, int, int, void*)
+		{
+			if(params < 1) return 0;
+			OS::String data = os->toString(-params);
+			Core::ValueUnserializer unserializer(os->core, data.toChar(), data.getDataSize());
+			if(!unserializer.unserialize()){
+				os->pushNull();
+			}
+			return 1;
+		}
+
+		static int freeze(OS * os, int params, int, int, void*)
+		{
+			if(params < 1) return 0;
+			os->freeze(-params);
+			os->pushStackValue(-params);
+			return 1;
+		}
+
+		static int isFrozen(OS * os, int params, int, int, void*)
+		{
+			os->pushBool(params > 0 && os->isFrozen(-params));
+			return 1;
+		}
+
 		static int getFilename(OS * os, int params, int, int, void*)
 		{
 			Core * core = os->core;
@@ -22188,7 +24552,12 @@ void OS::initCoreFunctions()
 		{OS_TEXT("compileText"), Lib::compileText},
 		{OS_TEXT("compileFile"), Lib::compileFile},
 		{OS_TEXT("compileFakeFile"), Lib::compileFakeFile},
+		{OS_TEXT("buildBundle"), Lib::buildBundle},
 		// {OS_TEXT("resolvePath"), Lib::resolvePath},
+		{OS_TEXT("serialize"), Lib::serialize},
+		{OS_TEXT("unserialize"), Lib::unserialize},
+		{OS_TEXT("freeze"), Lib::freeze},
+		{OS_TEXT("isFrozen"), Lib::isFrozen},
 		{OS_TEXT("debugBackTrace"), Lib::debugBackTrace},
 		{OS_TEXT("terminate"), Lib::terminate},
 		{OS_TEXT("__initnewinstance"), Lib::initNewInstance},
@@ -22403,180 +24772,122 @@ void OS::initObjectClass()
 			return 0;
 		}
 
-		static int sort(OS * os, int params, int, int, void*)
-		{
-			if(params < 1){
-				return smartSort(os, params, Core::compareArrayValues, Core::comparePropValues);
-			}
-			String prop_name(os);
-			if(os->core->isValueString(os->core->getStackValue(-params), &prop_name)){
-				return smartSort(os, params, NULL, Core::compareObjectProperties, &prop_name);
-			}
-			return smartSort(os, params, Core::compareUserArrayValues, Core::compareUserPropValues);
-		}
-
-		static int length(OS * os, int params, int closure_values, int, void*)
+		static int keySort(OS * os, int params, const String * prop_name)
 		{
-			Core::Value self_var = os->core->getStackValue(-params-closure_values-1);
+			int offs = os->getAbsoluteOffs(-params-1);
+			Core::Value self_var = os->core->getStackValue(offs);
 			Core::GCValue * self = self_var.getGCValue();
-			if(self){
-				os->pushNumber(self->table ? self->table->count : 0);
-				return 1;
-			}
-			return 0;
-		}
-
-		static int toJson(OS * os, int params, int, int, void*)
-		{
-			// allow usage with parameter toJson(v)
-			Core::Buffer buf(os);
-			Core::Value self_var = os->core->getStackValue(-params-1 + (params > 0));
-			OS_EValueType type = (OS_EValueType)OS_VALUE_TYPE(self_var);
-			if(type == OS_VALUE_TYPE_NULL){
-				os->pushString(os->core->strings->typeof_null);
-				return 1;
-			}			
-			if(params > 0){
-				Core::Value func_var = os->core->getStackValue(-params-2);
-				os->core->pushValue(self_var);
-				os->getProperty("toJson");
-				if(!os->core->isEqualExactly(func_var, os->core->getStackValue(-1))){
-					os->core->pushValue(self_var);
-					os->callFT(0, 1, OS_CALLTYPE_FUNC);
-#if 1
-					return 1;
-#else
-					self_var = os->core->getStackValue(-1);
-					type = (OS_EValueType)OS_VALUE_TYPE(self_var);
-					if(type == OS_VALUE_TYPE_STRING){
-						OS_ASSERT(dynamic_cast<Core::GCStringValue*>(OS_VALUE_VARIANT(self_var).string));
-						Core::GCStringValue * string = OS_VALUE_VARIANT(self_var).string;
-						if(string->getLen() >= 2 && (string->toChar()[0] == OS_TEXT('\"') || string->toChar()[0] == OS_TEXT('\''))){
-							return 1;
-						}
-						OS_ASSERT(false);
-					}
-#endif
-				}else{
-					os->pop();
-				}
+			if(!self){
+				return 0;
 			}
-			switch(type){
-			// case OS_VALUE_TYPE_NULL:
-			default:
-				os->pushString(os->core->strings->typeof_null);
-				return 1;
-
-			case OS_VALUE_TYPE_BOOL:
-				os->pushString(OS_VALUE_VARIANT(self_var).boolean ? os->core->strings->syntax_true : os->core->strings->syntax_false);
-				return 1;
-
-			case OS_VALUE_TYPE_NUMBER:
-				os->pushString(OS::Core::String(os, (OS_FLOAT)OS_VALUE_NUMBER(self_var)));
-				return 1;
-
-			case OS_VALUE_TYPE_STRING:
-				OS_ASSERT(dynamic_cast<Core::GCStringValue*>(OS_VALUE_VARIANT(self_var).string));
-				os->core->appendQuotedString(buf, OS::Core::String(os, OS_VALUE_VARIANT(self_var).string));
-				os->pushString(buf.toString());
-				return 1;
-
-			case OS_VALUE_TYPE_ARRAY:
-				{
-					if(!os->core->pushValueOfRecursion(self_var)){
-						os->pushString(os->core->strings->typeof_null);
-						return 1;
-					}
-					struct Finalizer {
-						Core * core;
-						Core::Value val;
-						~Finalizer(){ core->popValueOfRecursion(val); }
-					} finalizer = {os->core, self_var}; (void)finalizer;
-
-					OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(self_var).arr));
-					Core::GCArrayValue * arr = OS_VALUE_VARIANT(self_var).arr;
-					buf += OS_TEXT("[");
-					for(int i = 0; i < arr->values.count && !os->isExceptionSet(); i++){
-						if(i > 0){
-							buf += OS_TEXT(",");
-						}						
-						os->pushCFunction(toJson);
-						os->core->pushValue(arr->values[i]);
-						os->callF(1, 1, OS_CALLTYPE_FUNC);
-						buf += os->popString();
-					}
-					if(!os->isExceptionSet()){
-						buf += OS_TEXT("]");
-					}
-					os->pushString(buf);
-					return 1;
-				}
-
-			case OS_VALUE_TYPE_USERDATA:
-			case OS_VALUE_TYPE_USERPTR:
-			case OS_VALUE_TYPE_OBJECT:
-				{
-					if(!os->core->pushValueOfRecursion(self_var)){
-						os->pushString(os->core->strings->typeof_null);
-						return 1;
-					}
-					struct Finalizer {
-						Core * core;
-						Core::Value val;
-						~Finalizer(){ core->popValueOfRecursion(val); }
-					} finalizer = {os->core, self_var}; (void)finalizer;
-
-					OS_ASSERT(dynamic_cast<Core::GCValue*>(OS_VALUE_VARIANT(self_var).value));
-					Core::GCValue * self = OS_VALUE_VARIANT(self_var).value;
-					buf += OS_TEXT("{");
-					Core::Property * prop = self->table ? self->table->first : NULL;
-					for(int i = 0; prop && !os->isExceptionSet(); prop = prop->next, i++){
-						if(i > 0){
-							buf += OS_TEXT(",");
-						}
-						switch(OS_VALUE_TYPE(prop->index)){
-						/* case OS_VALUE_TYPE_NULL:
-							buf += os->core->strings->typeof_null;
-							break; */
-
-						/* case OS_VALUE_TYPE_BOOL:
-							buf += OS_VALUE_VARIANT(prop->index).boolean ? os->core->strings->syntax_true : os->core->strings->syntax_false;
-							break; */
-
-						/* case OS_VALUE_TYPE_NUMBER:
-							buf += OS::Core::String(os, (OS_FLOAT)OS_VALUE_NUMBER(prop->index));
-							break; */
-
-						case OS_VALUE_TYPE_NUMBER:
-						case OS_VALUE_TYPE_STRING:
-#if 1
-							os->pushCFunction(toJson);
-							os->core->pushValue(prop->index);
-							os->callF(1, 1, OS_CALLTYPE_FUNC);
-							buf += os->popString();
-#else
-							OS_ASSERT(dynamic_cast<Core::GCStringValue*>(OS_VALUE_VARIANT(prop->index).string));
-							os->core->appendQuotedString(buf, OS::Core::String(os, OS_VALUE_VARIANT(prop->index).string));
-#endif
+			bool is_array = OS_VALUE_TYPE(self_var) == OS_VALUE_TYPE_ARRAY;
+			int count = is_array ? OS_VALUE_VARIANT(self_var).arr->values.count : (self->table ? self->table->count : 0);
+			if(count > 1){
+				// key of each item is calculated once, then keys are sorted natively
+				Core::GCArrayValue * keys = os->core->pushArrayValue(count);
+				Core::GCArrayValue * indices = NULL;
+				if(!is_array){
+					indices = os->core->pushArrayValue(count);
+					for(Core::Property * prop = self->table->first; prop; prop = prop->next){
+						os->core->retainValue(prop->index);
+						os->vectorAddItem(indices->values, prop->index OS_DBG_FILEPOS);
+					}
+				}
+				for(int i = 0; i < count; i++){
+					Core::Value value, index;
+					if(is_array){
+						if(i >= OS_VALUE_VARIANT(self_var).arr->values.count){
 							break;
-
-						default:
-							// skip value
-							continue;						
 						}
-						buf += OS_TEXT(":");
-						os->pushCFunction(toJson);
-						os->core->pushValue(prop->value);
-						os->callF(1, 1, OS_CALLTYPE_FUNC);
-						buf += os->popString();
+						value = OS_VALUE_VARIANT(self_var).arr->values[i];
+						index = Core::Value(i);
+					}else{
+						index = indices->values[i];
+						Core::Property * prop = self->table ? self->table->get(index, OS_VALUE_TYPE(index)) : NULL;
+						if(!prop){
+							break;
+						}
+						value = prop->value;
 					}
-					if(!os->isExceptionSet()){
-						buf += OS_TEXT("}");
+					if(prop_name){
+						os->core->pushValue(value);
+						os->core->pushStringValue(*prop_name);
+						os->getProperty();
+					}else{
+						os->pushStackValue(offs+1);
+						os->core->pushValue(value);
+						os->core->pushValue(index);
+						os->callF(2, 1, OS_CALLTYPE_FUNC);
 					}
-					os->pushString(buf);
-					return 1;
+					os->core->retainValue(os->core->stack_values.lastElement());
+					os->vectorAddItem(keys->values, os->core->stack_values.lastElement() OS_DBG_FILEPOS);
+					os->pop();
+				}
+				if(keys->values.count != count){
+					os->setException(is_array ? OS_TEXT("array has been modified during sort") : OS_TEXT("object has been modified during sort"));
+				}else if(is_array){
+					os->core->sortArrayByKeys(OS_VALUE_VARIANT(self_var).arr, keys);
+				}else if(self->table){
+					os->core->sortTableByKeys(self->table, indices, keys);
+				}
+				os->pop(is_array ? 1 : 2);
+			}
+			os->core->pushValue(self_var);
+			return 1;
+		}
+
+		static int sort(OS * os, int params, int, int, void*)
+		{
+			if(!os->core->checkValueWritable(os->core->getStackValue(-params-1))) return 0;
+			if(params < 1){
+				return smartSort(os, params, Core::compareArrayValues, Core::comparePropValues);
+			}
+			String prop_name(os);
+			if(os->core->isValueString(os->core->getStackValue(-params), &prop_name)){
+				if(OS_VALUE_TYPE(os->core->getStackValue(-params-1)) == OS_VALUE_TYPE_ARRAY){
+					return keySort(os, params, &prop_name);
 				}
+				return smartSort(os, params, NULL, Core::compareObjectProperties, &prop_name);
+			}
+			return smartSort(os, params, Core::compareUserArrayValues, Core::compareUserPropValues);
+		}
+
+		static int sortBy(OS * os, int params, int, int, void*)
+		{
+			if(!os->core->checkValueWritable(os->core->getStackValue(-params-1))) return 0;
+			if(params < 1){
+				return sort(os, params, 0, 0, NULL);
+			}
+			String prop_name(os);
+			if(os->core->isValueString(os->core->getStackValue(-params), &prop_name)){
+				return keySort(os, params, &prop_name);
+			}
+			return keySort(os, params, NULL);
+		}
+
+		static int length(OS * os, int params, int closure_values, int, void*)
+		{
+			Core::Value self_var = os->core->getStackValue(-params-closure_values-1);
+			Core::GCValue * self = self_var.getGCValue();
+			if(self){
+				os->pushNumber(self->table ? self->table->count : 0);
+				return 1;
+			}
+			return 0;
+		}
+
+		static int toJson(OS * os, int params, int, int, void*)
+		{
+			// allow usage with parameter toJson(v, indent)
+			Core::Value self_var = os->core->getStackValue(-params-1 + (params > 0));
+			Core::Buffer buf(os);
+			Core::JsonEncoder encoder(os->core, buf);
+			if(params > 1){
+				encoder.setIndent(os->core->getStackValue(-params+1));
 			}
+			encoder.encode(self_var, params > 0);
+			os->pushString(buf);
+			return 1;
 		}
 
 		static int valueOf(OS * os, int params, int closure_values, int, void*)
@@ -22749,6 +25060,7 @@ dump_object:
 		static int push(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			Core::Value value = os->core->getStackValue(-params);
 			OS_INT num_index = 0;
 			switch(OS_VALUE_TYPE(self_var)){
@@ -22771,6 +25083,7 @@ dump_object:
 		static int pop(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_OBJECT:
 			case OS_VALUE_TYPE_USERDATA:
@@ -22799,6 +25112,7 @@ dump_object:
 		static int shift(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_OBJECT:
 			case OS_VALUE_TYPE_USERDATA:
@@ -23054,6 +25368,7 @@ dump_object:
 		{
 			Core::GCValue * value = os->core->getStackValue(-params-1).getGCValue();
 			if(value){
+				if(!os->core->checkValueWritable(Core::Value(value))) return 0;
 				if(value->table){
 					Core::Table * table = value->table;
 					value->table = NULL;
@@ -23121,6 +25436,12 @@ dump_object:
 			return 1;
 		}
 
+		static int deepClone(OS * os, int params, int, int, void*)
+		{
+			os->core->pushDeepCloneValue(os->core->getStackValue(-params-1));
+			return 1;
+		}
+
 		static int unpack(OS * os, int params, int, int need_ret_values, void*)
 		{
 			Core::GCValue * value = os->core->getStackValue(-params-1).getGCValue();
@@ -23156,6 +25477,7 @@ dump_object:
 		static int setFirst(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_OBJECT:
 			case OS_VALUE_TYPE_USERDATA:
@@ -23176,6 +25498,7 @@ dump_object:
 		static int deleteFirst(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_OBJECT:
 			case OS_VALUE_TYPE_USERDATA:
@@ -23211,6 +25534,7 @@ dump_object:
 		static int setLast(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_OBJECT:
 			case OS_VALUE_TYPE_USERDATA:
@@ -23231,6 +25555,7 @@ dump_object:
 		static int deleteLast(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_OBJECT:
 			case OS_VALUE_TYPE_USERDATA:
@@ -23268,8 +25593,10 @@ dump_object:
 		{OS_TEXT("reverseIter"), Object::reverseIterator},
 		{core->strings->func_valueOf, Object::valueOf},
 		{core->strings->func_clone, Object::clone},
+		{OS_TEXT("deepClone"), Object::deepClone},
 		{OS_TEXT("toJson"), Object::toJson},
 		{OS_TEXT("sort"), Object::sort},
+		{OS_TEXT("sortBy"), Object::sortBy},
 		{core->strings->func_push, Object::push},
 		{OS_TEXT("pop"), Object::pop},
 		{core->strings->__setempty, Object::push},
@@ -23528,6 +25855,7 @@ void OS::initArrayClass()
 		static int push(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			Core::Value value = os->core->getStackValue(-params);
 			if(OS_VALUE_TYPE(self_var) == OS_VALUE_TYPE_ARRAY){
 				OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(self_var).arr));
@@ -23542,6 +25870,7 @@ void OS::initArrayClass()
 		static int pop(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			if(OS_VALUE_TYPE(self_var) == OS_VALUE_TYPE_ARRAY){
 				OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(self_var).arr));
 				if(OS_VALUE_VARIANT(self_var).arr->values.count > 0){
@@ -23558,6 +25887,7 @@ void OS::initArrayClass()
 		static int unshift(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			Core::Value value = os->core->getStackValue(-params);
 			if(OS_VALUE_TYPE(self_var) == OS_VALUE_TYPE_ARRAY){
 				OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(self_var).arr));
@@ -23572,6 +25902,7 @@ void OS::initArrayClass()
 		static int shift(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			if(OS_VALUE_TYPE(self_var) == OS_VALUE_TYPE_ARRAY){
 				OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(self_var).arr));
 				if(OS_VALUE_VARIANT(self_var).arr->values.count > 0){
@@ -23723,6 +26054,7 @@ void OS::initArrayClass()
 		static int setFirst(OS * os, int params, int, int need_ret_values, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_ARRAY:
 				if(OS_VALUE_VARIANT(self_var).arr->values.count > 0){
@@ -23738,6 +26070,7 @@ void OS::initArrayClass()
 		static int deleteFirst(OS * os, int params, int, int need_ret_values, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_ARRAY:
 				if(OS_VALUE_VARIANT(self_var).arr->values.count > 0){
@@ -23764,6 +26097,7 @@ void OS::initArrayClass()
 		static int setLast(OS * os, int params, int, int need_ret_values, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_ARRAY:
 				if(OS_VALUE_VARIANT(self_var).arr->values.count > 0){
@@ -23779,6 +26113,7 @@ void OS::initArrayClass()
 		static int deleteLast(OS * os, int params, int, int need_ret_values, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(!os->core->checkValueWritable(self_var)) return 0;
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_ARRAY:
 				if(OS_VALUE_VARIANT(self_var).arr->values.count > 0){
@@ -23790,6 +26125,186 @@ void OS::initArrayClass()
 			return 0;
 		}
 		
+		enum EIterateType
+		{
+			ITERATE_FOREACH,
+			ITERATE_MAP,
+			ITERATE_FILTER,
+			ITERATE_SOME,
+			ITERATE_EVERY,
+			ITERATE_FIND,
+			ITERATE_REDUCE
+		};
+
+		static int iterate(OS * os, int params, EIterateType type)
+		{
+			int offs = os->getAbsoluteOffs(-params-1);
+			Core::Value self_var = os->core->getStackValue(offs);
+			if(OS_VALUE_TYPE(self_var) != OS_VALUE_TYPE_ARRAY || params < 1){
+				return 0;
+			}
+			Core::Value func = os->core->getStackValue(offs+1);
+
+			// callback gets ([acc,] value, index, self)
+			int func_params = type == ITERATE_REDUCE ? 4 : 3;
+			int count = OS_VALUE_VARIANT(self_var).arr->values.count;
+			os->core->reserveStackValues(os->core->stack_values.count + func_params + 4);
+
+			Core::GCArrayValue * result = NULL;
+			int acc_offs = 0;
+			switch(type){
+			case ITERATE_MAP:
+			case ITERATE_FILTER:
+				result = os->core->pushArrayValue(type == ITERATE_MAP ? count : 0);
+				break;
+
+			case ITERATE_REDUCE:
+				acc_offs = os->getAbsoluteOffs(-1) + 1;
+				if(params >= 2){
+					os->pushStackValue(offs+2);
+				}else{
+					os->pushNull();
+				}
+				break;
+
+			default:
+				break;
+			}
+			bool skip_first = type == ITERATE_REDUCE && params < 2;
+			// keep current value referenced while callback is running, it could be removed from self
+			int value_offs = os->getAbsoluteOffs(-1) + 1;
+			os->pushNull();
+
+			// count is checked for each item, callback could modify self
+			for(int i = 0; !os->isExceptionSet() && i < OS_VALUE_VARIANT(self_var).arr->values.count; i++){
+				Core::Value value = OS_VALUE_VARIANT(self_var).arr->values[i];
+				os->core->stack_values[value_offs] = value;
+				if(skip_first){
+					// reduce without initial value starts from the first item
+					os->core->stack_values[acc_offs] = value;
+					skip_first = false;
+					continue;
+				}
+				os->core->pushValue(func);
+				os->core->pushNull();
+				if(type == ITERATE_REDUCE){
+					os->core->pushValue(os->core->stack_values[acc_offs]);
+				}
+				os->core->pushValue(value);
+				os->core->pushValue(Core::Value(i));
+				os->core->pushValue(self_var);
+				os->core->callFT(func_params, 1, OS_CALLTYPE_FUNC);
+				if(os->isExceptionSet()){
+					os->pop();
+					break;
+				}
+				Core::Value& ret = os->core->stack_values.lastElement();
+				bool done = false;
+				switch(type){
+				case ITERATE_MAP:
+					os->core->retainValue(ret);
+					os->vectorAddItem(result->values, ret OS_DBG_FILEPOS);
+					break;
+
+				case ITERATE_FILTER:
+					if(os->core->valueToBool(ret)){
+						os->core->retainValue(value);
+						os->vectorAddItem(result->values, value OS_DBG_FILEPOS);
+					}
+					break;
+
+				case ITERATE_SOME:
+				case ITERATE_FIND:
+					done = os->core->valueToBool(ret);
+					break;
+
+				case ITERATE_EVERY:
+					done = !os->core->valueToBool(ret);
+					break;
+
+				case ITERATE_REDUCE:
+					os->core->stack_values[acc_offs] = ret;
+					break;
+
+				default:
+					break;
+				}
+				os->pop();
+				if(done){
+					switch(type){
+					case ITERATE_SOME:
+						os->pushBool(true);
+						return 1;
+
+					case ITERATE_EVERY:
+						os->pushBool(false);
+						return 1;
+
+					default:
+						break;
+					}
+					OS_ASSERT(type == ITERATE_FIND);
+					os->core->pushValue(value);
+					os->pushNumber(i);
+					return 2;
+				}
+			}
+			os->pop(); // value
+			switch(type){
+			case ITERATE_MAP:
+			case ITERATE_FILTER:
+			case ITERATE_REDUCE:
+				return 1;
+
+			case ITERATE_SOME:
+				os->pushBool(false);
+				return 1;
+
+			case ITERATE_EVERY:
+				os->pushBool(!os->isExceptionSet());
+				return 1;
+
+			default:
+				break;
+			}
+			return 0;
+		}
+
+		static int forEach(OS * os, int params, int, int, void*)
+		{
+			return iterate(os, params, ITERATE_FOREACH);
+		}
+
+		static int map(OS * os, int params, int, int, void*)
+		{
+			return iterate(os, params, ITERATE_MAP);
+		}
+
+		static int filter(OS * os, int params, int, int, void*)
+		{
+			return iterate(os, params, ITERATE_FILTER);
+		}
+
+		static int some(OS * os, int params, int, int, void*)
+		{
+			return iterate(os, params, ITERATE_SOME);
+		}
+
+		static int every(OS * os, int params, int, int, void*)
+		{
+			return iterate(os, params, ITERATE_EVERY);
+		}
+
+		static int find(OS * os, int params, int, int, void*)
+		{
+			return iterate(os, params, ITERATE_FIND);
+		}
+
+		static int reduce(OS * os, int params, int, int, void*)
+		{
+			return iterate(os, params, ITERATE_REDUCE);
+		}
+
 		static int construct(OS * os, int params, int, int, void*)
 		{
 			// TODO: correct?
@@ -23830,6 +26345,13 @@ void OS::initArrayClass()
 		{OS_TEXT("setLast"), Array::setLast},
 		{OS_TEXT("__del@last"), Array::deleteLast},
 		{OS_TEXT("deleteLast"), Array::deleteLast},
+		{OS_TEXT("forEach"), Array::forEach},
+		{OS_TEXT("map"), Array::map},
+		{OS_TEXT("filter"), Array::filter},
+		{OS_TEXT("some"), Array::some},
+		{OS_TEXT("every"), Array::every},
+		{OS_TEXT("find"), Array::find},
+		{OS_TEXT("reduce"), Array::reduce},
 		{}
 	};
 	core->pushValue(core->prototypes[Core::PROTOTYPE_ARRAY]);
@@ -23926,11 +26448,6 @@ void OS::initBufferClass()
 	setPrototype(CtypeId<Core::Buffer>::getId());
 }
 
-#define UTF8_SKIP_MULTI_BYTE_SEQUENCE(input, end) \
-	if((*(OS_BYTE*)(input++)) >= 0xc0 ){ \
-		while(input < end && (*(OS_BYTE*)input & 0xc0) == 0x80) input++;	\
-	}
-
 static int machine_little_endian;
 
 /* Mapping of byte from char (8bit) to long for machine endian */
@@ -24767,15 +27284,8 @@ void OS::initStringClass()
 
 		static int lengthUtf8(OS * os, int params, int, int, void*)
 		{
-			int len = 0;
 			OS::String str = os->toString(-params-1);
-			const OS_BYTE * string = (OS_BYTE*)str.toChar();
-			const OS_BYTE * end = string + str.getDataSize();
-			while(string < end){
-				len++;
-				UTF8_SKIP_MULTI_BYTE_SEQUENCE(string, end);
-			}
-			os->pushNumber(len);
+			os->pushNumber(str.string->getUtf8Len(os));
 			return 1;
 		}
 
@@ -24830,14 +27340,7 @@ void OS::initStringClass()
 		{
 			int start, len;
 			OS::String str = os->toString(-params-1);
-			
-			int size = 0;
-			const OS_BYTE * string = (OS_BYTE*)str.toChar();
-			const OS_BYTE * end = string + str.getDataSize();
-			while(string < end){
-				size++;
-				UTF8_SKIP_MULTI_BYTE_SEQUENCE(string, end);
-			}
+			int size = str.string->getUtf8Len(os);
 
 			switch(params){
 			case 0:
@@ -24878,17 +27381,9 @@ void OS::initStringClass()
 				return 1;
 			}
 
-			string = (OS_BYTE*)str.toChar();
-			for(; start > 0; start--){
-				UTF8_SKIP_MULTI_BYTE_SEQUENCE(string, end);
-			}
-			const OS_BYTE * cur_end = string;
-			for(; len > 0; len--){
-				UTF8_SKIP_MULTI_BYTE_SEQUENCE(cur_end, end);
-			}
-
-			size = (int)(cur_end - string);
-			os->pushString((void*)string, size);
+			int start_offs = str.string->getUtf8Offs(os, start);
+			int end_offs = str.string->getUtf8Offs(os, start + len);
+			os->pushString((void*)(str.toChar() + start_offs), end_offs - start_offs);
 			return 1;
 		}
 
@@ -24937,21 +27432,16 @@ void OS::initStringClass()
 					const OS_CHAR * subject_str = subject.toChar();
 					const OS_CHAR * search_str = search.toChar();
 					
-					OS::Core::Buffer buf(os);
-					bool found = false;
-					int start = 0;
-					for(int i = 0; i < subject_len-search_len+1;){
-						if(OS_MEMCMP(subject_str + i, search_str, sizeof(OS_CHAR)*search_len) == 0){
+					int i = Utils::find(subject_str, subject_len, search_str, search_len);
+					if(i >= 0){
+						Utils::StringSearch searcher(search_str, search_len);
+						OS::Core::Buffer buf(os);
+						int start = 0;
+						do{
 							buf.append(subject_str + start, i - start);
 							buf.append(replace, replace_len);
-							i += search_len;
-							start = i;
-							found = true;
-						}else{
-							i++;
-						}
-					}
-					if(found){
+							start = i + search_len;
+						}while((i = searcher.find(subject_str, subject_len, start)) >= 0);
 						buf.append(subject_str + start, subject_len - start);
 						os->pushString(buf);
 						return 1;
@@ -24970,16 +27460,10 @@ void OS::initStringClass()
 				OS::String search = os->toString(-params);
 				int search_len = search.getLen();
 				int i = params >= 2 ? os->toInt(-params+1) : 0;
-				if(search_len > 0 && search_len <= subject_len && i >= 0){
-					const OS_CHAR * subject_str = subject.toChar();
-					const OS_CHAR * search_str = search.toChar();
-					int end = subject_len - search_len;
-					for(; i <= end; i++){
-						if(OS_MEMCMP(subject_str + i, search_str, sizeof(OS_CHAR)*search_len) == 0){
-							os->pushNumber(i);
-							return 1;
-						}
-					}
+				i = Utils::find(subject.toChar(), subject_len, search.toChar(), search_len, i);
+				if(i >= 0){
+					os->pushNumber(i);
+					return 1;
 				}
 			}
 			return 0;
@@ -24995,15 +27479,9 @@ void OS::initStringClass()
 			int ret = find(os, params, closure_values, need_ret_values, user_param);
 			if(ret > 0){
 				int pos = os->toInt(-ret);
-				int subject_len = subject.getLen();
-				OS_ASSERT(pos < subject_len);
-				const OS_CHAR * start = subject.toChar();
-				const OS_CHAR * end = start + pos;
-				int new_pos = 0;
-				for(; start < end; new_pos++){
-					UTF8_SKIP_MULTI_BYTE_SEQUENCE(start, end);
-				}
-				if(start != end){
+				OS_ASSERT(pos < subject.getLen());
+				int new_pos = subject.string->getUtf8CharIndex(os, pos);
+				if(new_pos < 0){
 					os->setException(OS_TEXT("find utf-8 error: illegal seq"));
 					return 0;
 				}
@@ -25136,32 +27614,22 @@ void OS::initStringClass()
 					const OS_CHAR * search_str = search.toChar();
 					
 					int max_count = params >= 2 ? os->toInt(offs+2) : INT_MAX;
-					if(max_count > 1){
-						bool found = false;
+					int i;
+					if(max_count > 1 && (i = Utils::find(subject_str, subject_len, search_str, search_len)) >= 0){
+						Utils::StringSearch searcher(search_str, search_len);
 						int start = 0;
-						for(int i = 0; i < subject_len-search_len+1;){
-							if(OS_MEMCMP(subject_str + i, search_str, sizeof(OS_CHAR)*search_len) == 0){
-								os->pushStackValue();
-								os->pushNumber(count++);
-								os->pushString(subject_str + start, i - start);
-								os->setProperty();
-								i += search_len;
-								start = i;
-								found = true;
-								if(count+1 >= max_count){
-									break;
-								}
-							}else{
-								i++;
-							}
-						}
-						if(found){
+						do{
 							os->pushStackValue();
 							os->pushNumber(count++);
-							os->pushString(subject_str + start, subject_len - start);
+							os->pushString(subject_str + start, i - start);
 							os->setProperty();
-							return 1;
-						}
+							start = i + search_len;
+						}while(count+1 < max_count && (i = searcher.find(subject_str, subject_len, start)) >= 0);
+						os->pushStackValue();
+						os->pushNumber(count++);
+						os->pushString(subject_str + start, subject_len - start);
+						os->setProperty();
+						return 1;
 					}
 				}
 			}
@@ -25988,50 +28456,47 @@ void OS::initJsonModule()
 		static int encode(OS * os, int params, int, int, void*)
 		{
 			if(params > 0){
-				int offs = os->getAbsoluteOffs(-params+0);
-				os->getGlobal(OS_TEXT("Object"));
-				os->getProperty(OS_TEXT("toJson"));
-				os->pushNull();
-				os->pushStackValue(offs);
-				os->callFT(1, 1, OS_CALLTYPE_FUNC);
+				Core::Buffer buf(os);
+				Core::JsonEncoder encoder(os->core, buf);
+				if(params > 1){
+					encoder.setIndent(os->core->getStackValue(-params+1));
+				}
+				encoder.encode(os->core->getStackValue(-params));
+				os->pushString(buf);
 				return 1;
 			}
 			return 0;
 		}
 
+		static int echo(OS * os, int params, int, int, void*)
+		{
+			// the text is echoed by parts so big values don't have to be kept in memory
+			if(params > 0){
+				Core::Buffer buf(os);
+				Core::JsonEncoder encoder(os->core, buf, OS_JSON_ECHO_BUF_SIZE);
+				if(params > 1){
+					encoder.setIndent(os->core->getStackValue(-params+1));
+				}
+				encoder.encode(os->core->getStackValue(-params));
+				encoder.flush(true);
+			}
+			return 0;
+		}
+
 		static int decode(OS * os, int params, int, int, void*)
 		{
 			if(params > 0){
-				int ret = 0;
-				OS * new_os = OS::create(os->memory_manager);
-				{
-					OS::Core::Buffer buf(new_os);
-					buf += OS_TEXT("return (");
-					OS::String str = os->toString(-params+0);
-					if(str.getLen() >= 3 && OS_STRNCMP(str.toChar(), OS_TEXT("\xef\xbb\xbf"), 3) == 0){
-						buf.append(str.toChar()+3, str.getLen()-3); // skip utf8 BOM
-					}else{
-						buf += str;
-					}
-					buf += OS_TEXT(")");
-
-					new_os->compile(buf.toStringOS(), OS_SOURCECODE_PLAIN, false);
-					/* new_os->getGlobal(OS_TEXT("compileText"));
-					new_os->pushGlobals();
-					new_os->pushString(buf);
-					new_os->pushNumber(OS_SOURCECODE_PLAIN);
-					new_os->pushBool(false);
-					new_os->call(3, 1); */
-				}
-				if(new_os->isFunction()){
-					new_os->pushNull();
-					new_os->callFT(0, 1, OS_CALLTYPE_FUNC);
-					os->core->pushCloneValueFrom(new_os, new_os->core->getStackValue(-1));
-					ret = 1;
-				}
-				new_os->pop();
-				new_os->release();
-				return ret;
+				OS::String str = os->toString(-params+0);
+				const OS_CHAR * buf = str.toChar();
+				int len = str.getLen();
+				if(len >= 3 && OS_STRNCMP(buf, OS_TEXT("\xef\xbb\xbf"), 3) == 0){
+					buf += 3; len -= 3; // skip utf8 BOM
+				}
+				Core::JsonDecoder decoder(os->core);
+				if(!decoder.write(buf, len) || !decoder.finish()){
+					os->pushNull();
+				}
+				return 1;
 			}
 			return 0;
 		}
@@ -26040,6 +28505,7 @@ void OS::initJsonModule()
 	OS::FuncDef funcs[] = {
 		{OS_TEXT("encode"), &Lib::encode},
 		{OS_TEXT("decode"), &Lib::decode},
+		{OS_TEXT("echo"), &Lib::echo},
 		{}
 	};
 
@@ -26892,6 +29358,25 @@ OS_ESourceCodeType OS::getSourceCodeType(const String& filename)
 bool OS::compileFile(const String& p_filename, bool required, OS_ESourceCodeType source_code_type, bool check_utf8_bom)
 {
 	String filename = resolvePath(p_filename);
+	const Bundle::Entry * bundle_entry = core->bundle ? core->bundle->find(filename, filename.getLen()) : NULL;
+	if(bundle_entry){
+		Core::Program * prog = new (malloc(sizeof(Core::Program) OS_DBG_FILEPOS)) Core::Program(this);
+		prog->bundle = core->bundle;
+		prog->mapped_data = bundle_entry->data;
+		prog->mapped_size = bundle_entry->size;
+		Core::MemStreamReader prog_reader(NULL, bundle_entry->data, bundle_entry->size);
+		if(prog->loadFromStream(&prog_reader)){
+			// program is compiled with filename relative to root path of the bundle
+			prog->filename = filename;
+			prog->pushStartFunction();
+			prog->release();
+			return true;
+		}
+		prog->release();
+		setException(String::format(this, OS_TEXT("bundle entry %s is corrupted"), filename.toChar()));
+		pushNull();
+		return false;
+	}
 	bool is_compiled = getFilenameExt(filename) == OS_EXT_COMPILED;
 	String compiled_filename = is_compiled ? filename : getCompiledFilename(filename);
 	bool sourcecode_file_exist = is_compiled ? false : isFileExist(filename);
@@ -26922,12 +29407,19 @@ bool OS::compileFile(const String& p_filename, bool required, OS_ESourceCodeType
 		Core::Program * prog = new (malloc(sizeof(Core::Program) OS_DBG_FILEPOS)) Core::Program(this);
 		// prog->filename = compiled_filename;
 
-		Core::FileStreamReader prog_file_reader(this, compiled_filename);
-		Core::MemStreamWriter prog_file_data(this);
-		prog_file_data.writeFromStream(&prog_file_reader);
-		Core::MemStreamReader prog_reader(NULL, prog_file_data.buffer.buf, prog_file_data.getSize());
-
-		if(prog->loadFromStream(&prog_reader)){
+		bool loaded;
+		prog->mapped_data = mapFile(compiled_filename, prog->mapped_size);
+		if(prog->mapped_data){
+			Core::MemStreamReader prog_reader(NULL, (OS_BYTE*)prog->mapped_data, prog->mapped_size);
+			loaded = prog->loadFromStream(&prog_reader);
+		}else{
+			Core::FileStreamReader prog_file_reader(this, compiled_filename);
+			Core::MemStreamWriter prog_file_data(this);
+			prog_file_data.writeFromStream(&prog_file_reader);
+			Core::MemStreamReader prog_reader(NULL, prog_file_data.buffer.buf, prog_file_data.getSize());
+			loaded = prog->loadFromStream(&prog_reader);
+		}
+		if(loaded){
 			prog->pushStartFunction();
 			prog->release();
 			return true;
@@ -26991,6 +29483,157 @@ bool OS::compile(OS_ESourceCodeType source_code_type, bool check_utf8_bom)
 	return compile(popString(), source_code_type, check_utf8_bom);
 }
 
+bool OS::buildBundle(const String& bundle_filename, const String& root_path)
+{
+	struct Lib {
+		static int compareNames(OS*, const void * a, const void * b, void * user_param)
+		{
+			const String * names = (const String*)user_param;
+			const String& name_a = names[*(const int*)a];
+			const String& name_b = names[*(const int*)b];
+			return Utils::cmp(name_a.toChar(), name_a.getDataSize(), name_b.toChar(), name_b.getDataSize());
+		}
+	};
+
+	Vector<String> names;
+	Vector<int> sorted;
+	int i, count = getLen();
+	for(i = 0; i < count; i++){
+		pushStackValue();
+		pushNumber(i);
+		getProperty();
+		String name = popString();
+		if(!name.isEmpty()){
+			vectorAddItem(sorted, names.count OS_DBG_FILEPOS);
+			vectorAddItem(names, name OS_DBG_FILEPOS);
+		}
+	}
+	pop();
+	qsort(sorted.buf, sorted.count, sizeof(int), Lib::compareNames, names.buf);
+	for(count = 0, i = 0; i < sorted.count; i++){
+		if(!count || names[sorted[i]] != names[sorted[count-1]]){
+			sorted[count++] = sorted[i];
+		}
+	}
+	sorted.count = count;
+
+	// programs are compiled with filenames relative to root_path, loader sets real ones
+	bool create_compiled_file = core->settings.create_compiled_file;
+	bool create_text_opcodes = core->settings.create_text_opcodes;
+	core->settings.create_compiled_file = false;
+	core->settings.create_text_opcodes = false;
+
+	Core::MemStreamWriter programs(this);
+	Vector<int> offsets;
+	bool ok = true;
+	for(i = 0; i < sorted.count && ok; i++){
+		const String& name = names[sorted[i]];
+		String filename = root_path.isEmpty() ? name : root_path + OS_PATH_SEPARATOR + name;
+		Core::FileStreamReader file(this, filename);
+		if(!file.f){
+			setException(String::format(this, OS_TEXT("error open filename %s"), filename.toChar()));
+			ok = false;
+			break;
+		}
+		Core::MemStreamWriter file_data(this);
+		file_data.writeFromStream(&file);
+
+		Core::Tokenizer tokenizer(this);
+		tokenizer.parseText((OS_CHAR*)file_data.buffer.buf, file_data.buffer.count, name, true, getSourceCodeType(name), true);
+
+		for(; programs.getPos() & 3;){
+			programs.writeByte(0); // program should be aligned so its opcodes could be used in place
+		}
+		vectorAddItem(offsets, programs.getPos() OS_DBG_FILEPOS);
+
+		Core::Compiler compiler(&tokenizer);
+		compiler.compiled_stream = &programs;
+		ok = compiler.compile();
+		pop();
+		vectorAddItem(offsets, programs.getPos() - offsets.lastElement() OS_DBG_FILEPOS);
+	}
+	core->settings.create_compiled_file = create_compiled_file;
+	core->settings.create_text_opcodes = create_text_opcodes;
+
+	if(ok){
+		Core::MemStreamWriter writer(this);
+		int len = (int)OS_STRLEN(OS_BUNDLE_HEADER);
+		writer.writeBytes(OS_BUNDLE_HEADER, len);
+		len = (int)OS_STRLEN(OS_VERSION)+1;
+		writer.writeByte(len);
+		writer.writeBytes(OS_VERSION, len);
+		writer.writeByte(OS_COMPILED_FORMAT);
+		writer.writeInt32(sorted.count);
+		writer.writeInt32(root_path.getDataSize());
+		writer.writeBytes(root_path.toChar(), root_path.getDataSize());
+		for(; writer.getPos() & 3;){
+			writer.writeByte(0);
+		}
+
+		// entry: name pos, name size, program pos, program size
+		int names_pos = writer.getPos() + sorted.count * 16;
+		int programs_pos = names_pos;
+		for(i = 0; i < sorted.count; i++){
+			programs_pos += names[sorted[i]].getDataSize();
+		}
+		programs_pos = (programs_pos + 3) & ~3;
+		for(i = 0; i < sorted.count; i++){
+			const String& name = names[sorted[i]];
+			writer.writeInt32(names_pos);
+			writer.writeInt32(name.getDataSize());
+			writer.writeInt32(programs_pos + offsets[i*2]);
+			writer.writeInt32(offsets[i*2+1]);
+			names_pos += name.getDataSize();
+		}
+		for(i = 0; i < sorted.count; i++){
+			const String& name = names[sorted[i]];
+			writer.writeBytes(name.toChar(), name.getDataSize());
+		}
+		for(; writer.getPos() & 3;){
+			writer.writeByte(0);
+		}
+		OS_ASSERT(writer.getPos() == programs_pos);
+		writer.writeBytes(programs.buffer.buf, programs.buffer.count);
+
+		// the file is replaced atomically because running processes could map previous one
+		String temp_filename = String::format(this, OS_TEXT("%s.%d.%p.tmp"), bundle_filename.toChar(), (int)OS_GETPID(), this);
+		{
+			Core::FileStreamWriter file(this, temp_filename);
+			ok = file.f != NULL;
+			if(ok){
+				file.writeBytes(writer.buffer.buf, writer.buffer.count);
+			}
+		}
+#ifdef _MSC_VER
+		::remove(bundle_filename.toChar());
+#endif
+		if(!ok || ::rename(temp_filename.toChar(), bundle_filename.toChar()) != 0){
+			::remove(temp_filename.toChar());
+			setException(String::format(this, OS_TEXT("error write bundle %s"), bundle_filename.toChar()));
+			ok = false;
+		}
+	}
+	vectorClear(names);
+	vectorClear(sorted);
+	vectorClear(offsets);
+	return ok;
+}
+
+void OS::setBundle(Bundle * bundle)
+{
+	core->bundle = bundle;
+}
+
+OS::Bundle * OS::getBundle()
+{
+	return core->bundle;
+}
+
+bool OS::isBundleFile(const String& filename)
+{
+	return core->bundle && core->bundle->find(filename, filename.getLen());
+}
+
 /* void OS::call(int params, int ret_values, OS_ECallType call_type, OS_ECallThisUsage call_this_usage)
 {
 	core->call(params, ret_values, call_type, call_this_usage);
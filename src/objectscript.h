@@ -136,6 +136,7 @@ inline void operator delete(void *, void *){}
 #endif
 
 #define OS_MEMCMP ::memcmp
+#define OS_MEMCHR ::memchr
 #define OS_MEMMOVE ::memmove
 #define OS_MEMSET ::memset
 #define OS_MEMCPY ::memcpy
@@ -161,6 +162,17 @@ inline void operator delete(void *, void *){}
 #define OS_DEF_FMT_BUF_LEN (1024*10)
 #define OS_PATH_SEPARATOR OS_TEXT("/")
 
+#define OS_UTF8_INDEX_STEP 64
+#define OS_UTF8_INDEX_MIN_SIZE 256
+
+#define OS_JSON_ECHO_BUF_SIZE (1024*64)
+#define OS_JSON_DEFAULT_DEPTH 512
+#define OS_SERIALIZE_MAX_DEPTH 512
+#define OS_SERIALIZE_SIGNATURE "OSV1"
+
+// slot of open addressing hash by pointer, mask is size-1 of the hash
+#define OS_PTR_SLOT(p, mask) ((int)(((OS_U32)(intptr_t)(p) >> 3) * 2654435761u) & (mask))
+
 // uncomment it if need
 // #define OS_INFINITE_LOOP_OPCODES 100000000
 
@@ -171,11 +183,14 @@ inline void operator delete(void *, void *){}
 #endif
 
 #define OS_COMPILED_HEADER OS_TEXT("OBJECTSCRIPT")
+#define OS_COMPILED_FORMAT 3 // opcodes & debug info are 4 bytes aligned, function declarations are sized so they could be decoded on demand
 #define OS_EXT_SOURCECODE OS_TEXT(".os")
 #define OS_EXT_TEMPLATE OS_TEXT(".osh")
 #define OS_EXT_TEMPLATE_HTML OS_TEXT(".html")
 #define OS_EXT_TEMPLATE_HTM OS_TEXT(".htm")
 #define OS_EXT_COMPILED OS_TEXT(".osc")
+#define OS_EXT_BUNDLE OS_TEXT(".osb")
+#define OS_BUNDLE_HEADER OS_TEXT("OSBUNDLE")
 #define OS_EXT_TEXT_OPCODES OS_TEXT(".ost")
 
 #ifdef OS_DEBUG
@@ -375,6 +390,50 @@ namespace ObjectScript
 			virtual int getCachedBytes() = 0;
 		};
 
+		// single file with compiled programs of source tree, see OS::buildBundle,
+		// require resolves filenames inside of root_path by the bundle before file system.
+		// bundle is read only so one instance could be shared by OS instances of several threads,
+		// it's not retained by OS so it should be deleted after all of them are released
+		class Bundle
+		{
+		public:
+
+			struct Entry
+			{
+				const OS_CHAR * name; // relative to root_path, not null terminated
+				int name_len;
+				OS_BYTE * data; // compiled program
+				int size;
+			};
+
+		protected:
+
+			OS_BYTE * data;
+			int size;
+			bool mapped;
+
+			OS_CHAR * root_path;
+			int root_path_len;
+
+			Entry * entries; // sorted by name
+			int num_entries;
+
+			Bundle();
+
+		public:
+
+			~Bundle();
+
+			// returns NULL if bundle could not be loaded, root_path of bundle is used if the one is NULL
+			static Bundle * load(OS*, const OS_CHAR * filename, const OS_CHAR * root_path = NULL);
+
+			const OS_CHAR * getRootPath() const;
+			int getCount() const;
+			const Entry * getEntry(int i) const;
+
+			const Entry * find(const OS_CHAR * filename, int len) const;
+		};
+
 		struct Utils
 		{
 			enum ENumberParseType
@@ -400,6 +459,24 @@ namespace ObjectScript
 			static int cmp(const void * buf1, int len1, const void * buf2, int len2);
 
 			static double round(double a, int precision = 0);
+
+			// substring search, returns byte offset of search in buf or -1
+			// short search strings are scanned with memchr by the first byte,
+			// long ones use Horspool's bad character skip table
+			struct StringSearch
+			{
+				enum { SKIP_TABLE_MIN_LEN = 8 };
+
+				const OS_BYTE * search;
+				int search_len;
+				int skip[256];
+
+				StringSearch(const void * search, int search_len);
+
+				int find(const void * buf, int len, int start = 0) const;
+			};
+
+			static int find(const void * buf, int len, const void * search, int search_len, int start = 0);
 		};
 
 		class String;
@@ -788,6 +865,10 @@ namespace ObjectScript
 				OS_INT8 readInt8();
 				OS_INT16 readInt16();
 				OS_INT32 readInt32();
+
+				// data could be broken, so these ones return false instead of reading out of the buffer
+				bool hasBytes(int len) const;
+				bool readCheckedUVariable(int& value);
 			};
 
 			class FileStreamReader: public StreamReader
@@ -1254,6 +1335,7 @@ namespace ObjectScript
 				OS_EValueType type;
 				// bool is_object_instance;
 				bool is_destructor_called;
+				bool is_frozen; // array or object with frozen items, it could not be modified anymore
 
 				// EGCColor gc_color;
 
@@ -1277,6 +1359,9 @@ namespace ObjectScript
 
 				GCStringValue * hash_next_ref;
 
+				int utf8_len; // -1 if not calculated yet, equals to data_size if string is ascii only
+				int * utf8_index; // byte offset of every OS_UTF8_INDEX_STEP char, created for big not ascii strings only
+
 				GCStringValue(int p_data_size);
 				~GCStringValue();
 
@@ -1304,6 +1389,12 @@ namespace ObjectScript
 				bool isEqual(int hash, const void * buf1, int size1, const void * buf2, int size2) const;
 
 				void calcHash();
+
+				bool isAscii(OS*);
+				int getUtf8Len(OS*);
+				int getUtf8Offs(OS*, int char_index);
+				int getUtf8CharIndex(OS*, int offs);
+				void freeUtf8Index(OS*);
 			};
 
 			struct GCUserdataValue: public GCObjectValue
@@ -2209,6 +2300,8 @@ namespace ObjectScript
 				Compiler(Tokenizer*);
 				virtual ~Compiler();
 
+				MemStreamWriter * compiled_stream; // compiled program is written to the one too if it's not NULL
+
 				bool compile(); // compile text and push text root function
 			};
 
@@ -2248,6 +2341,7 @@ namespace ObjectScript
 				int num_try_blocks;
 				int opcodes_pos;
 				int opcodes_size;
+				int decl_data_pos; // locals & try blocks are not decoded yet while it's >= 0
 
 				FunctionDecl(); // Program*);
 				~FunctionDecl();
@@ -2284,6 +2378,17 @@ namespace ObjectScript
 				};
 				Vector<DebugInfoItem> debug_info;
 
+				// compiled file mapped to memory, opcodes & debug info are used in place if it's not NULL
+				void * mapped_data;
+				int mapped_size;
+				Bundle * bundle; // mapped data belongs to the bundle if it's not NULL
+
+				// string consts & function declarations are decoded on demand,
+				// decl_data points to mapped data or to own copy if mapped_data is NULL
+				OS_BYTE * decl_data;
+				int decl_data_size;
+				int * string_data_pos; // -1 if string const is already created
+
 				Program(OS * allocator);
 
 				Program * retain();
@@ -2291,9 +2396,13 @@ namespace ObjectScript
 
 				static OpcodeType getOpcodeType(Compiler::ExpressionType, Compiler::ECompiledValueType = Compiler::CVT_UNKNOWN);
 
-				bool loadFromStream(StreamReader * reader);
+				bool loadFromStream(MemStreamReader * reader);
 				DebugInfoItem * getDebugInfo(int opcode_pos);
 
+				void createConstString(int i);
+				void decodeFunction(FunctionDecl*);
+				bool checkFunctionDecl(const FunctionDecl*, MemStreamReader*);
+
 				void pushStartFunction();
 			};
 
@@ -2492,6 +2601,7 @@ namespace ObjectScript
 				String func_push;
 				String func_valueOf;
 				String func_clone;
+				String func_toJson;
 				String func_concat;
 				String func_echo;
 				String func_require;
@@ -2650,6 +2760,7 @@ namespace ObjectScript
 			bool gc_fix_in_progress;
 
 			void addFreeCandidateValue(GCValue * value);
+			void resizeFreeCandidateValues(int new_size);
 			void registerFreeCandidateValue(GCValue * value);
 			void unregisterFreeCandidateValue(GCValue * value);
 			void deleteFreeCandidateValues();
@@ -2660,6 +2771,210 @@ namespace ObjectScript
 			void dumpValuesToFile(const OS_CHAR * filename);
 			void appendQuotedString(Buffer& buf, const String& string);
 
+			// single pass json writer, toJson is called only for values overriding Object.toJson
+			struct JsonEncoder
+			{
+				Core * core;
+				Buffer& out;
+				Value native_func;
+				Value bool_func;
+				Value number_func;
+				Value string_func;
+				String indent;
+				int depth;
+				int echo_size; // out is echoed when it grows up to the size, 0 - keep whole text in out
+
+				JsonEncoder(Core*, Buffer& out, int echo_size = 0);
+
+				void setIndent(const Value& val); // number of spaces, string or true for tab
+				void encode(const Value& val, bool override_enabled = true);
+				void appendString(const void * buf, int size);
+				void appendNewLine();
+				bool callToJson(const Value& val);
+				void flush(bool force = false);
+			};
+
+			/*
+			Streaming json decoder, it takes utf-8 text by chunks of any size and builds
+			values directly without intermediate copy of the text. Items of unclosed arrays 
+			and objects are collected in the pending array and moved to exactly sized
+			containers when closing bracket is found.
+			*/
+			struct JsonDecoder
+			{
+				enum EError
+				{
+					ERROR_NONE,
+					ERROR_DEPTH, 
+					ERROR_STATE_MISMATCH,  
+					ERROR_CTRL_CHAR,   
+					ERROR_SYNTAX,
+					ERROR_UTF8
+				};
+
+				enum EState
+				{
+					STATE_VALUE,		// value is expected
+					STATE_FIRST_VALUE,	// value or ] is expected
+					STATE_KEY,			// key is expected
+					STATE_FIRST_KEY,	// key or } is expected
+					STATE_COLON,		// : is expected
+					STATE_NEXT,			// , or closing bracket is expected
+					STATE_DONE,			// only whitespaces are allowed
+					STATE_STRING,
+					STATE_ESCAPE,
+					STATE_UNICODE,
+					STATE_NUMBER,
+					STATE_LITERAL,
+					STATE_ERROR
+				};
+
+				enum EFrameType
+				{
+					FRAME_ARRAY,
+					FRAME_OBJECT
+				};
+
+				struct Frame
+				{
+					int type;
+					int start; // index of the first item in pending array
+				};
+
+				Core * core;
+				GCArrayValue * pending;
+				int pending_id;
+				Vector<Frame> frames;
+				Buffer token; // string, number or literal splitted by chunks
+				int state;
+				int max_depth;
+				int error_code;
+				bool is_key;
+
+				int unicode_len;
+				int unicode_char;
+				int high_surrogate;
+
+				int utf8_need;
+				int utf8_lo, utf8_hi;
+
+				JsonDecoder(Core*, int max_depth = OS_JSON_DEFAULT_DEPTH);
+				~JsonDecoder();
+
+				void reset();
+				bool write(const void * buf, int size);
+				bool finish(); // pushes result, returns false if text is not valid json
+
+				const OS_BYTE * setError(int code);
+
+				static const OS_BYTE * skipStringChars(const OS_BYTE * str, const OS_BYTE * end);
+				static const OS_BYTE * skipSpaces(const OS_BYTE * str, const OS_BYTE * end);
+				static bool isValidNumber(const OS_BYTE * str, int len);
+				static bool isLiteral(const OS_BYTE * str, int len, const char * literal, bool ignore_case);
+				OS_NUMBER parseNumber(const OS_BYTE * str, int len);
+
+				void appendUtf8(int code);
+				void flushHighSurrogate();
+				void appendStringChars(const OS_BYTE * str, int len);
+
+				bool addValue(const Value& val);
+				bool addString(const void * buf, int size);
+				bool addNumber(const OS_BYTE * str, int len);
+				bool addLiteral(const OS_BYTE * str, int len);
+				bool openFrame(int type);
+				bool closeArray();
+				bool closeObject();
+
+				const OS_BYTE * parseStructure(const OS_BYTE * str, const OS_BYTE * end);
+				const OS_BYTE * parseString(const OS_BYTE * str, const OS_BYTE * end);
+				const OS_BYTE * parseEscape(const OS_BYTE * str, const OS_BYTE * end);
+				const OS_BYTE * parseUnicode(const OS_BYTE * str, const OS_BYTE * end);
+				const OS_BYTE * parseToken(const OS_BYTE * str, const OS_BYTE * end);
+				bool finishToken(const OS_BYTE * str, int len);
+			};
+
+			// binary value format, strings and containers met twice are written as back references
+			// so shared parts and recursive structures are restored as is
+			enum ESerializeTag
+			{
+				SERIALIZE_NULL,
+				SERIALIZE_TRUE,
+				SERIALIZE_FALSE,
+				SERIALIZE_INT,		// uvariable
+				SERIALIZE_NEG_INT,	// uvariable of -value-1
+				SERIALIZE_DOUBLE,
+				SERIALIZE_STRING,	// uvariable size, bytes
+				SERIALIZE_ARRAY,	// uvariable count, values
+				SERIALIZE_OBJECT,	// uvariable count, key & value pairs
+				SERIALIZE_REF,		// uvariable index of string, array or object in order of appearance
+				SERIALIZE_SMALL_INT	// the tag itself contains value from 0 to 255-SERIALIZE_SMALL_INT
+			};
+
+			struct ValueSerializer
+			{
+				struct Ref
+				{
+					GCValue * value;
+					int index; // index of the first appearance
+				};
+
+				Core * core;
+				MemStreamWriter writer;
+				Vector<Ref> refs; // open addressing hash by value pointer, values are alive while serializing
+				int num_refs;
+				int depth;
+
+				ValueSerializer(Core*);
+				~ValueSerializer();
+
+				bool serialize(const Value& val); // returns false and sets exception if value is too deep
+				bool writeRef(GCValue * value);
+				bool enter();
+
+				static bool isSerializableKey(const Value& index);
+			};
+
+			struct ValueUnserializer
+			{
+				Core * core;
+				MemStreamReader reader;
+				Vector<Value> refs; // retained till unserializer is destroyed
+				int depth;
+
+				ValueUnserializer(Core*, const void * buf, int size);
+				~ValueUnserializer();
+
+				bool unserialize(); // pushes result, returns false if data is corrupted
+				bool readValue();
+				bool readUVariable(int& value);
+				bool readSize(int& size, int item_size);
+				void addRef(const Value& val);
+			};
+
+			struct ValueCloner
+			{
+				struct Ref
+				{
+					GCValue * src;
+					GCValue * dest;
+				};
+
+				Core * core;
+				Core * src_core; // source values could live in other OS instance
+				Vector<Ref> refs; // open addressing hash by source pointer, keeps cycles & shared values
+				int num_refs;
+				Vector<Ref> pending; // containers created but not filled yet
+
+				ValueCloner(Core*, Core * src_core);
+				~ValueCloner();
+
+				void pushClone(const Value& val);
+				int cloneValue(const Value& val, Value& dest); // returns number of values pushed to keep new container alive
+				GCValue * findRef(GCValue * src);
+				void addRef(GCValue * src, GCValue * dest);
+				void fill(GCValue * src, GCValue * dest);
+			};
+
 			struct {
 				bool create_text_opcodes;
 				bool create_text_eval_opcodes;
@@ -2669,6 +2984,8 @@ namespace ObjectScript
 				bool sourcecode_must_exist;
 			} settings;
 
+			Bundle * bundle;
+
 			enum {
 				RAND_STATE_SIZE = 624
 			};
@@ -2856,6 +3173,10 @@ namespace ObjectScript
 
 			void pushCloneValue(Value val);
 			void pushCloneValueFrom(OS * other, Value other_val);
+			void pushDeepCloneValue(Value val);
+
+			void freezeValue(const Value& val);
+			bool checkValueWritable(const Value& val); // sets exception if value is frozen
 
 			// unary operator
 			void pushOpResultValue(OpcodeType opcode, const Value& value);
@@ -2930,6 +3251,9 @@ namespace ObjectScript
 			void clearTable(Table*);
 			void deleteTable(Table*);
 			Property * addTableProperty(Table * table, const Value& index, const Value& value);
+			void resizeTableHeads(Table * table, int new_size);
+			// grows hash heads so count properties could be added without rehashing
+			void reserveTable(Table * table, int count);
 
 #ifdef OS_DEBUG
 			static int checkSavedType(int type, const Value& value);
@@ -2945,6 +3269,13 @@ namespace ObjectScript
 
 			void sortTable(Table * table, int(*comp)(OS*, const void*, const void*, void*), void* = NULL, bool reorder_keys = false);
 			void sortArray(GCArrayValue * arr, int(*comp)(OS*, const void*, const void*, void*), void* = NULL);
+			void reorderTable(Table * table, Property ** props, bool reorder_keys);
+
+			// fills order by indices of sorted keys, numbers are sorted using radix sort, other values using merge sort,
+			// returns false if natives_only is set and keys are not all numbers or not all strings
+			bool sortKeys(const Value * keys, int count, int * order, bool natives_only = false);
+			void sortArrayByKeys(GCArrayValue * arr, GCArrayValue * keys);
+			void sortTableByKeys(Table * table, GCArrayValue * indices, GCArrayValue * keys);
 
 			static int comparePropValues(OS*, const void*, const void*, void*);
 			static int comparePropValuesReverse(OS*, const void*, const void*, void*);
@@ -2965,6 +3296,9 @@ namespace ObjectScript
 
 			static int compareUserReverse(OS*, const void*, const void*, void*);
 
+			static int compareStringKeys(OS*, int, int, void*);
+			static int compareValueKeys(OS*, int, int, void*);
+
 			Property * setTableValue(Table * table, const Value& index, const Value& val);
 			void setPropertyValue(GCValue * table_value, const Value& index, Value val, bool setter_enabled);
 			void setPropertyValue(const Value& table_value, const Value& index, const Value& val, bool setter_enabled);
@@ -3213,6 +3547,9 @@ namespace ObjectScript
 		void releaseValueById(int id);
 
 		void clone(int offs = -1);
+		void deepClone(int offs = -1);
+		void freeze(int offs = -1);
+		bool isFrozen(int offs = -1);
 
 		int getStackSize();
 		int getAbsoluteOffs(int offs);
@@ -3292,6 +3629,12 @@ namespace ObjectScript
 		bool compile(const String& str, OS_ESourceCodeType source_code_type = OS_SOURCECODE_AUTO, bool check_utf8_bom = true);
 		bool compile(OS_ESourceCodeType source_code_type = OS_SOURCECODE_AUTO, bool check_utf8_bom = true);
 
+		// stack: array of filenames relative to root_path, it's popped
+		bool buildBundle(const String& bundle_filename, const String& root_path);
+		void setBundle(Bundle*);
+		Bundle * getBundle();
+		bool isBundleFile(const String& filename);
+
 		// deprecated, use callFT, callTF or callF
 		// void call(int params = 0, int ret_values = 0, OS_ECallType call_type = OS_CALLTYPE_AUTO, OS_ECallThisUsage call_this_usage = OS_CALLTHIS_KEEP_STACK_VALUE);
 		
@@ -3398,7 +3741,7 @@ namespace ObjectScript
 		String getFilenamePath(const OS_CHAR * filename, int len);
 
 		bool isAbsolutePath(const String& filename);
-		String resolvePath(const String& filename);
+		virtual String resolvePath(const String& filename);
 		virtual String resolvePath(const String& filename, const String& cur_path);
 		virtual String getCompiledFilename(const String& resolved_filename);
 		virtual String getTextOpcodesFilename(const String& resolved_filename);
@@ -3415,6 +3758,9 @@ namespace ObjectScript
 		virtual int writeFile(const void * buf, int size, FileHandle * f);
 		virtual int seekFile(FileHandle * f, int offset, int whence);
 		virtual void closeFile(FileHandle * f);
+		// returns NULL if file could not be mapped, host with own openFile should override it too
+		virtual void * mapFile(const OS_CHAR * filename, int& size);
+		virtual void unmapFile(void * data, int size);
 
 		virtual void echo(const void * buf, int size);
 		void echo(const OS_CHAR * str);